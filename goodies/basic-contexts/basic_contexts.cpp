@@ -26,11 +26,162 @@
 #include <unistd.h>
 #include <errno.h>
 
+#include <mutex>
+
 #include "basic_contexts.h"
 
 
 
 
+/*****************************************  BUFFER POOL  ***************************************/
+
+namespace {
+
+const int pool_min_shift = 6;               /* 64 bytes */
+const int pool_max_shift = 24;              /* 16 MiB */
+const int pool_classes = pool_max_shift - pool_min_shift + 1;
+const int thread_cache_depth = 8;           /* buffers per class cached by a thread */
+const unsigned long global_depth = 64;      /* buffers per class in the global free list */
+
+/* Free buffers are linked through their first bytes */
+struct pooled_buffer
+{
+    pooled_buffer   *next;
+};
+
+struct global_free_list
+{
+    std::mutex      mutex;
+    pooled_buffer   *buffers[pool_classes];
+    unsigned long   count[pool_classes];
+};
+
+global_free_list global_pool;
+
+
+/* Move half of the thread cache to the global list, or all of it at thread exit */
+static void release_to_global (void** cached, int* count, int size_class, int keep)
+{
+    std::lock_guard<std::mutex> lock (global_pool.mutex);
+    while (*count > keep)
+    {
+        void* buffer = cached[--*count];
+        if (global_pool.count[size_class] >= global_depth)
+        {
+            free (buffer);
+            continue;
+        }
+        pooled_buffer* pb = (pooled_buffer*)buffer;
+        pb->next = global_pool.buffers[size_class];
+        global_pool.buffers[size_class] = pb;
+        global_pool.count[size_class]++;
+    }
+}
+
+
+struct thread_cache
+{
+    void            *buffers[pool_classes][thread_cache_depth];
+    int             count[pool_classes];
+
+    ~thread_cache()
+    {
+        for (int c = 0; c < pool_classes; c++)
+            if (count[c])
+                release_to_global (buffers[c], &count[c], c, 0);
+    }
+};
+
+thread_local thread_cache cache;
+
+
+/* The smallest size class holding length, -1 if there is none */
+static inline int size_class_of (unsigned long length)
+{
+    if (length <= (1ul << pool_min_shift))
+        return 0;
+    if (length > (1ul << pool_max_shift))
+        return -1;
+    return (int)(sizeof(unsigned long) * 8) - __builtin_clzl (length - 1) - pool_min_shift;
+}
+
+}
+
+
+void* cw_buffer_pool_get (unsigned long* length)
+{
+    int c = size_class_of (*length);
+    if (c < 0)
+        return malloc (*length);
+
+    *length = 1ul << (c + pool_min_shift);
+    if (cache.count[c])
+        return cache.buffers[c][--cache.count[c]];
+
+    {
+        std::lock_guard<std::mutex> lock (global_pool.mutex);
+        pooled_buffer* pb = global_pool.buffers[c];
+        if (pb)
+        {
+            /* refill the thread cache with half its depth, keeping one for the caller */
+            while (pb->next && cache.count[c] < thread_cache_depth / 2)
+            {
+                pooled_buffer* next = pb->next;
+                cache.buffers[c][cache.count[c]++] = pb;
+                global_pool.count[c]--;
+                pb = next;
+            }
+            global_pool.buffers[c] = pb->next;
+            global_pool.count[c]--;
+            return pb;
+        }
+    }
+    return malloc (*length);
+}
+
+
+void cw_buffer_pool_put (void* buffer, unsigned long length)
+{
+    if (!buffer)
+        return;
+
+    int c = size_class_of (length);
+    if (c < 0 || length != 1ul << (c + pool_min_shift))
+    {
+        free (buffer);
+        return;
+    }
+
+    if (cache.count[c] == thread_cache_depth)
+        release_to_global (cache.buffers[c], &cache.count[c], c, thread_cache_depth / 2);
+    cache.buffers[c][cache.count[c]++] = buffer;
+}
+
+
+void cw_buffer_pool_trim (void)
+{
+    for (int c = 0; c < pool_classes; c++)
+    {
+        while (cache.count[c])
+            free (cache.buffers[c][--cache.count[c]]);
+    }
+
+    std::lock_guard<std::mutex> lock (global_pool.mutex);
+    for (int c = 0; c < pool_classes; c++)
+    {
+        while (global_pool.buffers[c])
+        {
+            pooled_buffer* pb = global_pool.buffers[c];
+            global_pool.buffers[c] = pb->next;
+            free (pb);
+        }
+        global_pool.count[c] = 0;
+    }
+}
+
+
+
+
 /*****************************************  DYNAMIC MEMORY PACK CONTEXT  ********************************/
 
 
@@ -55,7 +206,7 @@ static int handle_memory_pack_overflow(cw_pack_context* pc, unsigned long more)
 void init_dynamic_memory_pack_context (dynamic_memory_pack_context* dmpc, unsigned long initial_buffer_length)
 {
     unsigned long buffer_length = (initial_buffer_length > 0 ? initial_buffer_length : 1024);
-    void *buffer = malloc (buffer_length);
+    void *buffer = cw_buffer_pool_get (&buffer_length);
     if (!buffer)
     {
         dmpc->pc.return_code = CWP_RC_MALLOC_ERROR;
@@ -66,10 +217,22 @@ void init_dynamic_memory_pack_context (dynamic_memory_pack_context* dmpc, unsign
 }
 
 
+void reset_dynamic_memory_pack_context(dynamic_memory_pack_context* dmpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)dmpc;
+    if (pc->return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    pc->current = pc->start;
+    pc->return_code = CWP_RC_OK;
+    pc->err_no = 0;
+}
+
+
 void free_dynamic_memory_pack_context(dynamic_memory_pack_context* dmpc)
 {
     if (dmpc->pc.return_code != CWP_RC_MALLOC_ERROR)
-        free(dmpc->pc.start);
+        cw_buffer_pool_put(dmpc->pc.start, (unsigned long)(dmpc->pc.end - dmpc->pc.start));
 }
 
 
@@ -107,11 +270,11 @@ static int handle_stream_pack_overflow(cw_pack_context* pc, unsigned long more)
         while (buffer_length < more)
             buffer_length = 2 * buffer_length;
 
-        void *new_buffer = malloc (buffer_length);
+        void *new_buffer = cw_buffer_pool_get (&buffer_length);
         if (!new_buffer)
             return CWP_RC_BUFFER_OVERFLOW;
 
-        free(pc->start);
+        cw_buffer_pool_put(pc->start, (unsigned long)(pc->end - pc->start));
         pc->start = (uint8_t*)new_buffer;
         pc->end = pc->start + buffer_length;
     }
@@ -123,7 +286,7 @@ static int handle_stream_pack_overflow(cw_pack_context* pc, unsigned long more)
 void init_stream_pack_context (stream_pack_context* spc, unsigned long initial_buffer_length, FILE* file)
 {
     unsigned long buffer_length = (initial_buffer_length > 0 ? initial_buffer_length : 4096);
-    void *buffer = malloc (buffer_length);
+    void *buffer = cw_buffer_pool_get (&buffer_length);
     if (!buffer)
     {
         spc->pc.return_code = CWP_RC_MALLOC_ERROR;
@@ -136,13 +299,27 @@ void init_stream_pack_context (stream_pack_context* spc, unsigned long initial_b
 }
 
 
+void reset_stream_pack_context(stream_pack_context* spc, FILE* file)
+{
+    cw_pack_context* pc = (cw_pack_context*)spc;
+    if (pc->return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    cw_pack_flush(pc);
+    spc->file = file;
+    pc->current = pc->start;
+    pc->return_code = CWP_RC_OK;
+    pc->err_no = 0;
+}
+
+
 void terminate_stream_pack_context(stream_pack_context* spc)
 {
     cw_pack_context* pc = (cw_pack_context*)spc;
     cw_pack_flush(pc);
 
     if (pc->return_code != CWP_RC_MALLOC_ERROR)
-        free(pc->start);
+        cw_buffer_pool_put(pc->start, (unsigned long)(pc->end - pc->start));
 }
 
 
@@ -153,44 +330,14 @@ void terminate_stream_pack_context(stream_pack_context* spc)
 static int handle_stream_unpack_underflow(cw_unpack_context* uc, unsigned long more)
 {
     stream_unpack_context* suc = (stream_unpack_context*)uc;
-    unsigned long remains = (unsigned long)(uc->end - uc->current);
-    if (remains)
-    {
-        memmove (uc->start, uc->current, remains);
-    }
-
-    if (suc->buffer_length < more)
-    {
-        while (suc->buffer_length < more)
-            suc->buffer_length = 2 * suc->buffer_length;
-
-        void *new_buffer = realloc (uc->start, suc->buffer_length);
-        if (!new_buffer)
-            return CWP_RC_BUFFER_UNDERFLOW;
-
-        uc->start = (uint8_t*)new_buffer;
-    }
-    uc->current = uc->start;
-    uc->end = uc->start + remains;
-    unsigned long l = fread(uc->end, 1, suc->buffer_length - remains, suc->file);
-    if (!l)
-    {
-        if (feof(suc->file))
-            return CWP_RC_END_OF_INPUT;
-        suc->uc.err_no = ferror(suc->file);
-        return CWP_RC_ERROR_IN_HANDLER;
-    }
-
-    uc->end += l;
-
-    return CWP_RC_OK;
+    return cwpack::stream_refill(uc, suc->buffer_length, suc->file, more);
 }
 
 
 void init_stream_unpack_context (stream_unpack_context* suc, unsigned long initial_buffer_length, FILE* file)
 {
     unsigned long buffer_length = (initial_buffer_length > 0? initial_buffer_length : 1024);
-    void *buffer = malloc (buffer_length);
+    void *buffer = cw_buffer_pool_get (&buffer_length);
     if (!buffer)
     {
         suc->uc.return_code = CWP_RC_MALLOC_ERROR;
@@ -203,10 +350,22 @@ void init_stream_unpack_context (stream_unpack_context* suc, unsigned long initi
 }
 
 
+void reset_stream_unpack_context(stream_unpack_context* suc, FILE* file)
+{
+    if (suc->uc.return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    suc->file = file;
+    suc->uc.current = suc->uc.end = suc->uc.start;
+    suc->uc.return_code = CWP_RC_OK;
+    suc->uc.err_no = 0;
+}
+
+
 void terminate_stream_unpack_context(stream_unpack_context* suc)
 {
     if (suc->uc.return_code != CWP_RC_MALLOC_ERROR)
-        free(suc->uc.start);
+        cw_buffer_pool_put(suc->uc.start, suc->buffer_length);
 }
 
 
@@ -232,7 +391,7 @@ static int flush_file_pack_context(cw_pack_context* pc)
     {
         long kept = pc->current - bStart;
         if (kept) {
-            memcpy(pc->start, bStart, kept);
+            memmove(pc->start, bStart, kept);
         }
         fpc->barrier = pc->start;
         pc->current = pc->start + kept;
@@ -258,18 +417,19 @@ static int handle_file_pack_overflow(cw_pack_context* pc, unsigned long more)
         while (buffer_length < more + kept)
             buffer_length = 2 * buffer_length;
 
-        void *new_buffer = malloc (buffer_length);
+        void *new_buffer = cw_buffer_pool_get (&buffer_length);
         if (!new_buffer)
             return CWP_RC_BUFFER_OVERFLOW;
         if (kept) {
             memcpy(new_buffer, bStart, kept);
         }
+        cw_buffer_pool_put(pc->start, (unsigned long)(pc->end - pc->start));
         pc->start = (uint8_t*)new_buffer;
         pc->end = pc->start + buffer_length;
     }
-    else if (kept)
+    else if (kept && bStart != pc->start)
     {
-        memcpy(pc->start, bStart, kept);
+        memmove(pc->start, bStart, kept);
     }
 
     if (fpc->barrier)
@@ -285,7 +445,7 @@ static int handle_file_pack_overflow(cw_pack_context* pc, unsigned long more)
 void init_file_pack_context (file_pack_context* fpc, unsigned long initial_buffer_length, int fileDescriptor)
 {
     unsigned long buffer_length = (initial_buffer_length > 32 ? initial_buffer_length : 4096);
-    void *buffer = malloc (buffer_length);
+    void *buffer = cw_buffer_pool_get (&buffer_length);
     if (!buffer)
     {
         fpc->pc.return_code = CWP_RC_MALLOC_ERROR;
@@ -294,6 +454,8 @@ void init_file_pack_context (file_pack_context* fpc, unsigned long initial_buffe
 
     fpc->fileDescriptor = fileDescriptor;
     fpc->barrier = NULL;
+    fpc->open_containers = 0;
+    fpc->container_barrier = false;
 
     cw_pack_context_init((cw_pack_context*)fpc, buffer, buffer_length, &handle_file_pack_overflow);
     cw_pack_set_flush_handler((cw_pack_context*)fpc, &flush_file_pack_context);
@@ -312,6 +474,74 @@ void file_pack_context_release_barrier (file_pack_context* fpc)
 }
 
 
+/* The kept bytes are moved to start at a flush, so the slots are kept relative to the barrier */
+static cwpack::container_slot file_pack_context_begin (file_pack_context* fpc, uint8_t lead)
+{
+    if (!fpc->barrier)
+    {
+        file_pack_context_set_barrier (fpc);
+        fpc->container_barrier = true;
+    }
+    fpc->open_containers++;
+    cwpack::container_slot slot = cw_pack_container_begin ((cw_pack_context*)fpc, lead);
+    slot.offset -= (unsigned long)(fpc->barrier - fpc->pc.start);
+    return slot;
+}
+
+
+static void file_pack_context_end (file_pack_context* fpc, cwpack::container_slot slot, uint32_t n, bool compact)
+{
+    slot.offset += (unsigned long)(fpc->barrier - fpc->pc.start);
+    cw_pack_container_end ((cw_pack_context*)fpc, slot, n, compact);
+    if (--fpc->open_containers == 0 && fpc->container_barrier)
+    {
+        file_pack_context_release_barrier (fpc);
+        fpc->container_barrier = false;
+    }
+}
+
+
+cwpack::container_slot file_pack_context_array_begin (file_pack_context* fpc)
+{
+    return file_pack_context_begin (fpc, 0xdd);
+}
+
+
+cwpack::container_slot file_pack_context_map_begin (file_pack_context* fpc)
+{
+    return file_pack_context_begin (fpc, 0xdf);
+}
+
+
+void file_pack_context_array_end (file_pack_context* fpc, cwpack::container_slot slot, uint32_t n, bool compact)
+{
+    file_pack_context_end (fpc, slot, n, compact);
+}
+
+
+void file_pack_context_map_end (file_pack_context* fpc, cwpack::container_slot slot, uint32_t n, bool compact)
+{
+    file_pack_context_end (fpc, slot, n, compact);
+}
+
+
+void reset_file_pack_context(file_pack_context* fpc, int fileDescriptor)
+{
+    cw_pack_context* pc = (cw_pack_context*)fpc;
+    if (pc->return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    fpc->barrier = NULL;
+    cw_pack_flush(pc);
+    fpc->fileDescriptor = fileDescriptor;
+    fpc->open_containers = 0;
+    fpc->container_barrier = false;
+    pc->current = pc->start;
+    pc->return_code = CWP_RC_OK;
+    pc->err_no = 0;
+}
+
+
 void terminate_file_pack_context(file_pack_context* fpc)
 {
     fpc->barrier = NULL;
@@ -319,7 +549,7 @@ void terminate_file_pack_context(file_pack_context* fpc)
     cw_pack_flush(pc);
 
     if (pc->return_code != CWP_RC_MALLOC_ERROR)
-        free(pc->start);
+        cw_buffer_pool_put(pc->start, (unsigned long)(pc->end - pc->start));
 }
 
 
@@ -330,53 +560,14 @@ void terminate_file_pack_context(file_pack_context* fpc)
 static int handle_file_unpack_underflow(cw_unpack_context* uc, unsigned long more)
 {
     file_unpack_context* auc = (file_unpack_context*)uc;
-    uint8_t *bStart = auc->barrier ? auc->barrier : uc->current;
-    unsigned long kept = (unsigned long)(uc->current - bStart);
-    unsigned long remains = (unsigned long)(uc->end - bStart);
-    if (remains)
-    {
-        memcpy (uc->start, bStart, remains);
-    }
-
-    if (auc->buffer_length < more + kept)
-    {
-        while (auc->buffer_length < more + kept)
-            auc->buffer_length = 2 * auc->buffer_length;
-
-        void *new_buffer = realloc (uc->start, auc->buffer_length);
-        if (!new_buffer)
-            return CWP_RC_BUFFER_UNDERFLOW;
-
-        uc->start = (uint8_t*)new_buffer;
-    }
-    uc->current = uc->start + kept;
-    uc->end = uc->start + remains;
-    if (auc->barrier)
-        auc->barrier = uc->start;
-
-    while ((unsigned long)(uc->end - uc->current) < more)
-    {
-        long l = read(auc->fileDescriptor, uc->end, auc->buffer_length - (unsigned long)(uc->end - uc->start));
-        if (l == 0)
-        {
-            return CWP_RC_END_OF_INPUT;
-        }
-        if (l < 0)
-        {
-            auc->uc.err_no = errno;
-            return CWP_RC_ERROR_IN_HANDLER;
-        }
-        uc->end += l;
-    }
-
-    return CWP_RC_OK;
+    return cwpack::file_refill(uc, auc->buffer_length, auc->fileDescriptor, auc->barrier, more);
 }
 
 
 void init_file_unpack_context (file_unpack_context* fuc, unsigned long initial_buffer_length, int fileDescriptor)
 {
     unsigned long buffer_length = (initial_buffer_length > 0? initial_buffer_length : 1024);
-    void *buffer = malloc (buffer_length);
+    void *buffer = cw_buffer_pool_get (&buffer_length);
     if (!buffer)
     {
         fuc->uc.return_code = CWP_RC_MALLOC_ERROR;
@@ -407,11 +598,69 @@ void file_unpack_context_release_barrier (file_unpack_context* fuc)
 }
 
 
+void reset_file_unpack_context(file_unpack_context* fuc, int fileDescriptor)
+{
+    if (fuc->uc.return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    fuc->fileDescriptor = fileDescriptor;
+    fuc->barrier = NULL;
+    fuc->uc.current = fuc->uc.end = fuc->uc.start;
+    fuc->uc.return_code = CWP_RC_OK;
+    fuc->uc.err_no = 0;
+}
+
+
 void terminate_file_unpack_context(file_unpack_context* fuc)
 {
     if (fuc->uc.return_code != CWP_RC_MALLOC_ERROR)
-        free(fuc->uc.start);
+        cw_buffer_pool_put(fuc->uc.start, fuc->buffer_length);
     fuc->uc.start = 0;
 }
 
 
+
+/*****************************************  COMPILE TIME UNPACK SOURCES  ************************/
+
+
+void init_stream_source_unpack_context (stream_source_unpack_context* ssuc, unsigned long initial_buffer_length, FILE* file)
+{
+    unsigned long buffer_length = (initial_buffer_length > 0? initial_buffer_length : 1024);
+    void *buffer = cw_buffer_pool_get (&buffer_length);
+    if (!buffer)
+    {
+        ssuc->return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    cw_unpack_context_init(ssuc, buffer, 0, cwpack::stream_source{file, buffer_length});
+}
+
+
+void terminate_stream_source_unpack_context(stream_source_unpack_context* ssuc)
+{
+    if (ssuc->return_code != CWP_RC_MALLOC_ERROR)
+        cw_buffer_pool_put(ssuc->start, ssuc->buffer_length);
+}
+
+
+void init_file_source_unpack_context (file_source_unpack_context* fsuc, unsigned long initial_buffer_length, int fileDescriptor)
+{
+    unsigned long buffer_length = (initial_buffer_length > 0? initial_buffer_length : 1024);
+    void *buffer = cw_buffer_pool_get (&buffer_length);
+    if (!buffer)
+    {
+        fsuc->return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    cw_unpack_context_init(fsuc, buffer, 0, cwpack::file_descriptor_source{fileDescriptor, buffer_length, NULL});
+}
+
+
+void terminate_file_source_unpack_context(file_source_unpack_context* fsuc)
+{
+    if (fsuc->return_code != CWP_RC_MALLOC_ERROR)
+        cw_buffer_pool_put(fsuc->start, fsuc->buffer_length);
+    fsuc->start = 0;
+}
@@ -24,9 +24,34 @@
 #define basic_contexts_h
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
 #include "cwpack.hpp"
 
 
+/*****************************************  BUFFER POOL  ***************************************/
+
+/*
+ * The buffers of the contexts below come from a pool with size classes in powers of two from
+ * 64 bytes to 16 MiB. Each thread has a cache per size class that is used without locking,
+ * overflowing to and refilled from a global free list. Pooled buffers are plain malloc blocks,
+ * so a buffer taken over from a context may be given to realloc or free.
+ */
+
+/* A buffer of at least length bytes, length is updated to the size of the buffer */
+void* cw_buffer_pool_get (unsigned long* length);
+
+/* Give back a buffer of length bytes. Buffers that aren't of a size class are freed. */
+void cw_buffer_pool_put (void* buffer, unsigned long length);
+
+/* Free the buffers cached by the calling thread and in the global free list */
+void cw_buffer_pool_trim (void);
+
+
+
 /*****************************************  DYNAMIC MEMORY PACK CONTEXT  ************************/
 
 typedef struct
@@ -37,6 +62,9 @@ typedef struct
 
 void init_dynamic_memory_pack_context (dynamic_memory_pack_context* dmpc, unsigned long initial_buffer_length);
 
+/* Rewind for the next message, keeping the buffer */
+void reset_dynamic_memory_pack_context(dynamic_memory_pack_context* dmpc);
+
 void free_dynamic_memory_pack_context(dynamic_memory_pack_context* dmpc);
 
 
@@ -52,6 +80,9 @@ typedef struct
 
 void init_stream_pack_context (stream_pack_context* spc, unsigned long initial_buffer_length, FILE* file);
 
+/* Flush to the current file and go on packing to file, keeping the buffer */
+void reset_stream_pack_context(stream_pack_context* spc, FILE* file);
+
 void terminate_stream_pack_context(stream_pack_context* spc);
 
 
@@ -68,6 +99,9 @@ typedef struct
 
 void init_stream_unpack_context (stream_unpack_context* suc, unsigned long initial_buffer_length, FILE* file);
 
+/* Drop what is buffered and go on unpacking from file, keeping the buffer */
+void reset_stream_unpack_context(stream_unpack_context* suc, FILE* file);
+
 void terminate_stream_unpack_context(stream_unpack_context* suc);
 
 
@@ -79,6 +113,8 @@ typedef struct
     cw_pack_context pc;
     int             fileDescriptor;
     uint8_t         *barrier;
+    unsigned long   open_containers;
+    bool            container_barrier;
 } file_pack_context;
 
 
@@ -87,6 +123,16 @@ void init_file_pack_context (file_pack_context* spc, unsigned long initial_buffe
 void file_pack_context_set_barrier (file_pack_context* spc);
 void file_pack_context_release_barrier (file_pack_context* spc);
 
+/* Containers with deferred size. The barrier is held while a container is open, so the
+   header isn't written to file before it is patched. */
+cwpack::container_slot file_pack_context_array_begin (file_pack_context* fpc);
+cwpack::container_slot file_pack_context_map_begin (file_pack_context* fpc);
+void file_pack_context_array_end (file_pack_context* fpc, cwpack::container_slot slot, uint32_t n, bool compact);
+void file_pack_context_map_end (file_pack_context* fpc, cwpack::container_slot slot, uint32_t n, bool compact);
+
+/* Release the barrier, flush to the current file and go on packing to fileDescriptor, keeping the buffer */
+void reset_file_pack_context(file_pack_context* fpc, int fileDescriptor);
+
 void terminate_file_pack_context(file_pack_context* spc);
 
 
@@ -108,10 +154,141 @@ void file_unpack_context_set_barrier (file_unpack_context* suc);
 void file_unpack_context_rescan_from_barrier (file_unpack_context* suc);
 void file_unpack_context_release_barrier (file_unpack_context* suc);
 
+/* Drop what is buffered and go on unpacking from fileDescriptor, keeping the buffer */
+void reset_file_unpack_context(file_unpack_context* fuc, int fileDescriptor);
+
 void terminate_file_unpack_context(file_unpack_context* suc);
 
 
 
+/*****************************************  COMPILE TIME UNPACK SOURCES  ************************/
+
+/*
+ * The refill routines of the stream and file unpack contexts, shared with the sources below.
+ * With a source the refill is resolved at compile time and inlined into the decoder.
+ */
+
+namespace cwpack {
+
+template <class Context>
+inline int stream_refill (Context* uc, unsigned long& buffer_length, FILE* file, unsigned long more)
+{
+    unsigned long remains = (unsigned long)(uc->end - uc->current);
+    if (remains)
+    {
+        memmove (uc->start, uc->current, remains);
+    }
+
+    if (buffer_length < more)
+    {
+        while (buffer_length < more)
+            buffer_length = 2 * buffer_length;
+
+        void *new_buffer = realloc (uc->start, buffer_length);
+        if (!new_buffer)
+            return CWP_RC_BUFFER_UNDERFLOW;
+
+        uc->start = (uint8_t*)new_buffer;
+    }
+    uc->current = uc->start;
+    uc->end = uc->start + remains;
+    unsigned long l = fread(uc->end, 1, buffer_length - remains, file);
+    if (!l)
+    {
+        if (feof(file))
+            return CWP_RC_END_OF_INPUT;
+        uc->err_no = ferror(file);
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+
+    uc->end += l;
+
+    return CWP_RC_OK;
+}
+
+
+template <class Context>
+inline int file_refill (Context* uc, unsigned long& buffer_length, int fileDescriptor, uint8_t*& barrier, unsigned long more)
+{
+    uint8_t *bStart = barrier ? barrier : uc->current;
+    unsigned long kept = (unsigned long)(uc->current - bStart);
+    unsigned long remains = (unsigned long)(uc->end - bStart);
+    if (remains)
+    {
+        memmove (uc->start, bStart, remains);
+    }
+
+    if (buffer_length < more + kept)
+    {
+        while (buffer_length < more + kept)
+            buffer_length = 2 * buffer_length;
+
+        void *new_buffer = realloc (uc->start, buffer_length);
+        if (!new_buffer)
+            return CWP_RC_BUFFER_UNDERFLOW;
+
+        uc->start = (uint8_t*)new_buffer;
+    }
+    uc->current = uc->start + kept;
+    uc->end = uc->start + remains;
+    if (barrier)
+        barrier = uc->start;
+
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        long l = read(fileDescriptor, uc->end, buffer_length - (unsigned long)(uc->end - uc->start));
+        if (l == 0)
+        {
+            return CWP_RC_END_OF_INPUT;
+        }
+        if (l < 0)
+        {
+            uc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        uc->end += l;
+    }
+
+    return CWP_RC_OK;
+}
+
+
+struct stream_source {
+    FILE*           file;
+    unsigned long   buffer_length;
+
+    template <class Context>
+    int underflow (Context* uc, unsigned long more) { return stream_refill(uc, buffer_length, file, more); }
+};
+
+
+struct file_descriptor_source {
+    int             fileDescriptor;
+    unsigned long   buffer_length;
+    uint8_t         *barrier;
+
+    template <class Context>
+    int underflow (Context* uc, unsigned long more) { return file_refill(uc, buffer_length, fileDescriptor, barrier, more); }
+};
+
+}
+
+
+typedef cwpack::basic_unpack_context<cwpack::stream_source> stream_source_unpack_context;
+
+void init_stream_source_unpack_context (stream_source_unpack_context* ssuc, unsigned long initial_buffer_length, FILE* file);
+
+void terminate_stream_source_unpack_context(stream_source_unpack_context* ssuc);
+
+
+typedef cwpack::basic_unpack_context<cwpack::file_descriptor_source> file_source_unpack_context;
+
+void init_file_source_unpack_context (file_source_unpack_context* fsuc, unsigned long initial_buffer_length, int fileDescriptor);
+
+void terminate_file_source_unpack_context(file_source_unpack_context* fsuc);
+
+
+
 /*****************************************  E P I L O G U E  **********************************/
 
 
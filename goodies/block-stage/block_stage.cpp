@@ -0,0 +1,187 @@
+/*      CWPack/goodies - block_stage.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "block_stage.h"
+
+
+
+/*****************************************  BLOCK PACK STAGE  ***********************************/
+
+
+void init_block_pack_stage (cw_pack_context* pc, unsigned long block_length, unsigned long max_block_length,
+                            cwpack::context::overflow_handler handle_overflow, pack_flush_handler handle_flush)
+{
+    unsigned long buffer_length = block_length > 64 ? block_length : 65536;
+    if (buffer_length > max_block_length)
+        buffer_length = max_block_length;
+    void *buffer = malloc (buffer_length);
+    if (!buffer)
+    {
+        pc->return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    cw_pack_context_init (pc, buffer, buffer_length, handle_overflow);
+    cw_pack_set_flush_handler (pc, handle_flush);
+}
+
+
+int block_pack_stage_overflow (cw_pack_context* pc, unsigned long more, unsigned long max_block_length, block_writer write_block)
+{
+    int rc = write_block (pc);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    unsigned long buffer_length = (unsigned long)(pc->end - pc->start);
+    if (more > max_block_length)
+        return CWP_RC_BUFFER_OVERFLOW;
+    if (buffer_length < more)
+    {
+        while (buffer_length < more)
+            buffer_length = 2 * buffer_length;
+        if (buffer_length > max_block_length)
+            buffer_length = max_block_length;
+        void *new_buffer = realloc (pc->start, buffer_length);
+        if (!new_buffer)
+            return CWP_RC_BUFFER_OVERFLOW;
+        pc->start = pc->current = (uint8_t*)new_buffer;
+        pc->end = pc->start + buffer_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+int block_pack_stage_insert (cw_pack_context* pc, cw_pack_context* sink, const uint8_t* header, const void* data, unsigned long length)
+{
+    cw_pack_insert (sink, header, CW_BLOCK_HEADER_LENGTH);
+    cw_pack_insert (sink, data, (uint32_t)length);
+    if (sink->return_code)
+    {
+        pc->err_no = sink->err_no;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    pc->current = pc->start;
+    return CWP_RC_OK;
+}
+
+
+void terminate_block_pack_stage (cw_pack_context* pc)
+{
+    if (pc->return_code == CWP_RC_MALLOC_ERROR)
+        return;
+
+    cw_pack_flush (pc);
+    free (pc->start);
+    pc->start = pc->current = pc->end = NULL;
+}
+
+
+
+/*****************************************  BLOCK UNPACK STAGE  *********************************/
+
+
+void init_block_unpack_stage (cw_unpack_context* uc, unsigned long* buffer_length, unsigned long initial_buffer_length,
+                              cwpack::unpack_context::underflow_handler handle_underflow)
+{
+    *buffer_length = initial_buffer_length > 0 ? initial_buffer_length : 65536;
+    void *buffer = malloc (*buffer_length);
+    if (!buffer)
+    {
+        uc->return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    cw_unpack_context_init (uc, buffer, 0, handle_underflow);
+}
+
+
+/* Make length bytes available in the source, CWP_RC_END_OF_INPUT only if there are none */
+static int source_bytes (cw_unpack_context* source, unsigned long length)
+{
+    unsigned long available = (unsigned long)(source->end - source->current);
+    if (available >= length)
+        return CWP_RC_OK;
+    int rc = source->underflow (source, length);
+    if (rc == CWP_RC_END_OF_INPUT && available)
+        rc = CWP_RC_BUFFER_UNDERFLOW;
+    return rc;
+}
+
+
+int block_unpack_stage_underflow (cw_unpack_context* uc, unsigned long* buffer_length, cw_unpack_context* source, unsigned long more,
+                                  unsigned long max_block_length, block_header_parser parse_header, block_decoder decode)
+{
+    unsigned long remains = (unsigned long)(uc->end - uc->current);
+    if (remains)
+        memmove (uc->start, uc->current, remains);
+    uc->current = uc->start;
+    uc->end = uc->start + remains;
+
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        int rc = source_bytes (source, CW_BLOCK_HEADER_LENGTH);
+        if (rc)
+            return rc;
+        unsigned long raw_length, data_length;
+        rc = parse_header (source->current, &raw_length, &data_length);
+        if (rc)
+            return rc;
+        if (raw_length > max_block_length || data_length > max_block_length)
+            return CWP_RC_MALFORMED_INPUT;
+
+        unsigned long used = (unsigned long)(uc->end - uc->start);
+        if (*buffer_length < used + raw_length)
+        {
+            unsigned long new_length = *buffer_length;
+            while (new_length < used + raw_length)
+                new_length = 2 * new_length;
+            uint8_t* new_buffer = (uint8_t*)realloc (uc->start, new_length);
+            if (!new_buffer)
+                return CWP_RC_BUFFER_UNDERFLOW;
+            uc->current = uc->start = new_buffer;
+            uc->end = new_buffer + used;
+            *buffer_length = new_length;
+        }
+
+        rc = source_bytes (source, CW_BLOCK_HEADER_LENGTH + data_length);
+        if (rc)
+            return rc == CWP_RC_END_OF_INPUT ? CWP_RC_BUFFER_UNDERFLOW : rc;
+        rc = decode (uc, source->current, source->current + CW_BLOCK_HEADER_LENGTH, data_length, uc->end, raw_length);
+        if (rc)
+            return rc;
+        source->current += CW_BLOCK_HEADER_LENGTH + data_length;
+        uc->end += raw_length;
+    }
+    return CWP_RC_OK;
+}
+
+
+void terminate_block_unpack_stage (cw_unpack_context* uc)
+{
+    if (uc->return_code != CWP_RC_MALLOC_ERROR)
+        free (uc->start);
+    uc->start = uc->current = uc->end = NULL;
+}
@@ -0,0 +1,87 @@
+/*      CWPack/goodies - block_stage.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef block_stage_h
+#define block_stage_h
+
+#include "cwpack.hpp"
+
+
+/*****************************************  BLOCK STAGE  ****************************************/
+
+/*
+ * The framing shared by the compress and checksum contexts. The pack side writes its buffer
+ * as one block to a sink pack context whenever the buffer is full or flushed, the unpack side
+ * refills its buffer from the blocks it reads from a source unpack context. A block starts with
+ * a header of two 32 bit little endian words, whose meaning is up to the stage, and no block
+ * holds more than the stage's max_block_length bytes, raw or encoded.
+ */
+
+#define CW_BLOCK_HEADER_LENGTH      8
+
+inline void cw_store_le32 (uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+inline uint32_t cw_load_le32 (const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+/* Writes the packed bytes as a block to the sink, CWP_RC_OK or the error */
+typedef int (*block_writer)(cw_pack_context* pc);
+
+void init_block_pack_stage (cw_pack_context* pc, unsigned long block_length, unsigned long max_block_length,
+                            cwpack::context::overflow_handler handle_overflow, pack_flush_handler handle_flush);
+
+/* The overflow handler of a stage: write the block, then make room for more, but not beyond max_block_length */
+int block_pack_stage_overflow (cw_pack_context* pc, unsigned long more, unsigned long max_block_length, block_writer write_block);
+
+/* Insert a block header and data into the sink */
+int block_pack_stage_insert (cw_pack_context* pc, cw_pack_context* sink, const uint8_t* header, const void* data, unsigned long length);
+
+/* Write the last block and free the buffer */
+void terminate_block_pack_stage (cw_pack_context* pc);
+
+
+/* From a block header the raw length it decodes to and the length of its data, CWP_RC_OK or CWP_RC_MALFORMED_INPUT */
+typedef int (*block_header_parser)(const uint8_t* header, unsigned long* raw_length, unsigned long* data_length);
+
+/* Decode the data of a block into raw_length bytes at destination, CWP_RC_OK or the error */
+typedef int (*block_decoder)(cw_unpack_context* uc, const uint8_t* header, const uint8_t* data, unsigned long data_length, uint8_t* destination, unsigned long raw_length);
+
+void init_block_unpack_stage (cw_unpack_context* uc, unsigned long* buffer_length, unsigned long initial_buffer_length,
+                              cwpack::unpack_context::underflow_handler handle_underflow);
+
+/*
+ * The underflow handler of a stage: decode blocks from source until more bytes are buffered.
+ * A header with a length above max_block_length gives CWP_RC_MALFORMED_INPUT before anything
+ * is allocated for it, a truncated block CWP_RC_BUFFER_UNDERFLOW.
+ */
+int block_unpack_stage_underflow (cw_unpack_context* uc, unsigned long* buffer_length, cw_unpack_context* source, unsigned long more,
+                                  unsigned long max_block_length, block_header_parser parse_header, block_decoder decode);
+
+void terminate_block_unpack_stage (cw_unpack_context* uc);
+
+#endif /* block_stage_h */
@@ -0,0 +1,265 @@
+/*      CWPack/goodies - checksum_context.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include <array>
+
+#include "block_stage.h"
+#include "checksum_context.h"
+
+#if !defined(CWPACK_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CWPACK_CRC32C_X86
+#include <immintrin.h>
+#endif
+
+
+
+/*****************************************  CRC32C  *********************************************/
+
+namespace {
+
+const uint32_t crc32c_polynomial = 0x82f63b78;      /* reflected */
+
+typedef std::array<std::array<uint32_t, 256>, 8> slice_tables;
+
+constexpr slice_tables make_slice_tables ()
+{
+    slice_tables tables{};
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ crc32c_polynomial : crc >> 1;
+        tables[0][i] = crc;
+    }
+    for (int slice = 1; slice < 8; slice++)
+        for (int i = 0; i < 256; i++)
+            tables[slice][i] = (tables[slice - 1][i] >> 8) ^ tables[0][tables[slice - 1][i] & 0xff];
+    return tables;
+}
+
+constexpr slice_tables crc32c_tables = make_slice_tables();
+
+
+/* crc is the running register, without the final inversion */
+uint32_t crc32c_table (uint32_t crc, const uint8_t* p, unsigned long length)
+{
+    for (; length && ((uintptr_t)p & 7); length--)
+        crc = (crc >> 8) ^ crc32c_tables[0][(crc ^ *p++) & 0xff];
+    for (; length >= 8; length -= 8, p += 8)
+    {
+        uint32_t low, high;
+        memcpy (&low, p, 4);
+        memcpy (&high, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        low = __builtin_bswap32 (low);
+        high = __builtin_bswap32 (high);
+#endif
+        low ^= crc;
+        crc = crc32c_tables[7][low & 0xff] ^ crc32c_tables[6][(low >> 8) & 0xff] ^
+              crc32c_tables[5][(low >> 16) & 0xff] ^ crc32c_tables[4][low >> 24] ^
+              crc32c_tables[3][high & 0xff] ^ crc32c_tables[2][(high >> 8) & 0xff] ^
+              crc32c_tables[1][(high >> 16) & 0xff] ^ crc32c_tables[0][high >> 24];
+    }
+    for (; length; length--)
+        crc = (crc >> 8) ^ crc32c_tables[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+
+#ifdef CWPACK_CRC32C_X86
+
+/* Multiply two polynomials modulo the crc polynomial, bit reflected */
+uint32_t multiply_modulo (uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m; m >>= 1)
+    {
+        if (a & m)
+            product ^= b;
+        b = b & 1 ? (b >> 1) ^ crc32c_polynomial : b >> 1;
+    }
+    return product;
+}
+
+/* x^(8 * n) modulo the polynomial, for shifting a crc over n zero bytes */
+uint32_t shift_bytes (unsigned long n)
+{
+    uint32_t result = 1u << 31;             /* x^0 */
+    uint32_t power = 1u << 23;              /* x^8 */
+    for (; n; n >>= 1)
+    {
+        if (n & 1)
+            result = multiply_modulo (result, power);
+        power = multiply_modulo (power, power);
+    }
+    return result;
+}
+
+const unsigned long stream_block = 4096;    /* bytes per stream in a round of three */
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42 (uint32_t crc, const uint8_t* p, unsigned long length)
+{
+    static const uint32_t shift_block = shift_bytes (stream_block);
+    static const uint32_t shift_two_blocks = shift_bytes (2 * stream_block);
+
+    for (; length && ((uintptr_t)p & 7); length--)
+        crc = _mm_crc32_u8 (crc, *p++);
+
+    /* three independent streams hide the latency of the crc32 instruction */
+    while (length >= 3 * stream_block)
+    {
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+        const uint8_t* end = p + stream_block;
+        for (; p < end; p += 8)
+        {
+            uint64_t v0, v1, v2;
+            memcpy (&v0, p, 8);
+            memcpy (&v1, p + stream_block, 8);
+            memcpy (&v2, p + 2 * stream_block, 8);
+            crc0 = _mm_crc32_u64 (crc0, v0);
+            crc1 = _mm_crc32_u64 (crc1, v1);
+            crc2 = _mm_crc32_u64 (crc2, v2);
+        }
+        crc = multiply_modulo ((uint32_t)crc0, shift_two_blocks) ^ multiply_modulo ((uint32_t)crc1, shift_block) ^ (uint32_t)crc2;
+        p += 2 * stream_block;
+        length -= 3 * stream_block;
+    }
+
+    uint64_t crc64 = crc;
+    for (; length >= 8; length -= 8, p += 8)
+    {
+        uint64_t v;
+        memcpy (&v, p, 8);
+        crc64 = _mm_crc32_u64 (crc64, v);
+    }
+    crc = (uint32_t)crc64;
+    for (; length; length--)
+        crc = _mm_crc32_u8 (crc, *p++);
+    return crc;
+}
+
+#endif
+
+typedef uint32_t (*crc32c_function)(uint32_t crc, const uint8_t* p, unsigned long length);
+
+crc32c_function select_crc32c ()
+{
+#ifdef CWPACK_CRC32C_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+        return &crc32c_sse42;
+#endif
+    return &crc32c_table;
+}
+
+}
+
+
+uint32_t cw_crc32c (uint32_t crc, const void* data, unsigned long length)
+{
+    static const crc32c_function function = select_crc32c();
+    return ~function (~crc, (const uint8_t*)data, length);
+}
+
+
+
+/*****************************************  CHECKSUM PACK CONTEXT  ******************************/
+
+
+static int write_block (cw_pack_context* pc)
+{
+    checksum_pack_context* cpc = (checksum_pack_context*)pc;
+    unsigned long length = (unsigned long)(pc->current - pc->start);
+    if (!length)
+        return CWP_RC_OK;
+
+    uint8_t header[CW_BLOCK_HEADER_LENGTH];
+    cw_store_le32 (header, (uint32_t)length);
+    cw_store_le32 (header + 4, cw_crc32c (0, pc->start, length));
+    return block_pack_stage_insert (pc, cpc->sink, header, pc->start, length);
+}
+
+
+static int handle_checksum_pack_overflow (cw_pack_context* pc, unsigned long more)
+{
+    return block_pack_stage_overflow (pc, more, CW_CHECKSUM_MAX_BLOCK_LENGTH, &write_block);
+}
+
+
+void init_checksum_pack_context (checksum_pack_context* cpc, unsigned long block_length, cw_pack_context* sink)
+{
+    cpc->sink = sink;
+    init_block_pack_stage ((cw_pack_context*)cpc, block_length, CW_CHECKSUM_MAX_BLOCK_LENGTH, &handle_checksum_pack_overflow, &write_block);
+}
+
+
+void terminate_checksum_pack_context (checksum_pack_context* cpc)
+{
+    terminate_block_pack_stage ((cw_pack_context*)cpc);
+}
+
+
+
+/*****************************************  CHECKSUM UNPACK CONTEXT  ****************************/
+
+
+static int parse_checksum_header (const uint8_t* header, unsigned long* raw_length, unsigned long* data_length)
+{
+    *raw_length = *data_length = cw_load_le32 (header);
+    return CWP_RC_OK;
+}
+
+
+static int verify_block (cw_unpack_context* uc, const uint8_t* header, const uint8_t* data, unsigned long data_length, uint8_t* destination, unsigned long)
+{
+    if (cw_crc32c (0, data, data_length) != cw_load_le32 (header + 4))
+        return CWP_RC_CHECKSUM_ERROR;
+    memcpy (destination, data, data_length);
+    ((checksum_unpack_context*)uc)->blocks++;
+    return CWP_RC_OK;
+}
+
+
+static int handle_checksum_unpack_underflow (cw_unpack_context* uc, unsigned long more)
+{
+    checksum_unpack_context* cuc = (checksum_unpack_context*)uc;
+    return block_unpack_stage_underflow (uc, &cuc->buffer_length, cuc->source, more, CW_CHECKSUM_MAX_BLOCK_LENGTH,
+                                         &parse_checksum_header, &verify_block);
+}
+
+
+void init_checksum_unpack_context (checksum_unpack_context* cuc, unsigned long initial_buffer_length, cw_unpack_context* source)
+{
+    cuc->source = source;
+    cuc->blocks = 0;
+    init_block_unpack_stage ((cw_unpack_context*)cuc, &cuc->buffer_length, initial_buffer_length, &handle_checksum_unpack_underflow);
+}
+
+
+void terminate_checksum_unpack_context (checksum_unpack_context* cuc)
+{
+    terminate_block_unpack_stage ((cw_unpack_context*)cuc);
+}
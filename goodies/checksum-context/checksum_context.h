@@ -0,0 +1,85 @@
+/*      CWPack/goodies - checksum_context.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef checksum_context_h
+#define checksum_context_h
+
+#include "cwpack.hpp"
+
+
+/*****************************************  CRC32C  *********************************************/
+
+/*
+ * CRC-32C (Castagnoli), as in iSCSI, ext4 and many storage formats. On x86-64 with SSE4.2
+ * the crc32 instruction is used on three interleaved streams, otherwise a slice-by-8 table.
+ * Start with crc 0 and pass the result of the previous call to go on.
+ */
+uint32_t cw_crc32c (uint32_t crc, const void* data, unsigned long length);
+
+
+
+/*****************************************  CHECKSUM PACK CONTEXT  ******************************/
+
+/*
+ * Checksummed blocks, written through the block stage shared with the compress contexts. The
+ * pack context seals its buffer with a CRC-32C whenever it is full or flushed, and hands the
+ * block to the sink that does the writing. The header of a block is
+ *
+ *      length                  4 bytes little endian, at most CW_CHECKSUM_MAX_BLOCK_LENGTH
+ *      crc32c                  4 bytes little endian, of the data
+ */
+
+#define CW_CHECKSUM_MAX_BLOCK_LENGTH        (64ul << 20)
+
+typedef struct
+{
+    cw_pack_context     pc;
+    cw_pack_context     *sink;          /* gets the blocks */
+} checksum_pack_context;
+
+
+void init_checksum_pack_context (checksum_pack_context* cpc, unsigned long block_length, cw_pack_context* sink);
+
+/* Write the last block. The sink is left to its owner to flush and terminate. */
+void terminate_checksum_pack_context (checksum_pack_context* cpc);
+
+
+
+/*****************************************  CHECKSUM UNPACK CONTEXT  ****************************/
+
+/* Verifies each block as it refills from the source. A mismatch gives CWP_RC_CHECKSUM_ERROR,
+   a length above the maximum CWP_RC_MALFORMED_INPUT. */
+
+typedef struct
+{
+    cw_unpack_context   uc;
+    cw_unpack_context   *source;        /* gives the blocks */
+    unsigned long       buffer_length;
+    unsigned long       blocks;         /* verified */
+} checksum_unpack_context;
+
+
+void init_checksum_unpack_context (checksum_unpack_context* cuc, unsigned long initial_buffer_length, cw_unpack_context* source);
+
+void terminate_checksum_unpack_context (checksum_unpack_context* cuc);
+
+#endif /* checksum_context_h */
@@ -0,0 +1,300 @@
+/*      CWPack/goodies - compress_context.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "block_stage.h"
+#include "compress_context.h"
+
+
+
+/*****************************************  BLOCK COMPRESSION  **********************************/
+
+#define HASH_BITS           14
+#define MIN_MATCH           4
+#define MAX_OFFSET          65535
+#define STORED_BLOCK        0x80000000u
+
+
+static inline uint32_t read32 (const uint8_t* p)
+{
+    uint32_t v;
+    memcpy (&v, p, 4);
+    return v;
+}
+
+static inline uint32_t hash32 (uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Length in a token nibble, continued in bytes of 255 */
+static inline uint8_t* put_length (uint8_t* op, unsigned long length)
+{
+    for (length -= 15; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+
+static uint8_t* put_sequence (uint8_t* op, uint8_t* oend, const uint8_t* literals, unsigned long literal_length, unsigned long offset, unsigned long match_length)
+{
+    /* token, length bytes, literals and offset */
+    if ((unsigned long)(oend - op) < 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1)
+        return NULL;
+
+    uint8_t* token = op++;
+    *token = (uint8_t)((literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15)
+        op = put_length (op, literal_length);
+    memcpy (op, literals, literal_length);
+    op += literal_length;
+    if (!match_length)
+        return op;
+
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    match_length -= MIN_MATCH;
+    *token |= (uint8_t)(match_length < 15 ? match_length : 15);
+    if (match_length >= 15)
+        op = put_length (op, match_length);
+    return op;
+}
+
+
+unsigned long cw_block_compress (const uint8_t* source, unsigned long length, uint8_t* destination, unsigned long capacity)
+{
+    uint32_t table[1 << HASH_BITS];
+    memset (table, 0, sizeof(table));
+    const uint8_t* ip = source;
+    const uint8_t* anchor = source;
+    const uint8_t* iend = source + length;
+    uint8_t* op = destination;
+    uint8_t* oend = destination + capacity;
+
+    /* the first position can't be matched, table entries of 0 then mean nothing */
+    if (length > MIN_MATCH)
+    {
+        ip++;
+        while (ip + MIN_MATCH <= iend)
+        {
+            uint32_t sequence = read32 (ip);
+            uint32_t h = hash32 (sequence);
+            const uint8_t* candidate = source + table[h];
+            table[h] = (uint32_t)(ip - source);
+            if (candidate == source || ip - candidate > MAX_OFFSET || read32 (candidate) != sequence)
+            {
+                /* step faster through data that doesn't compress */
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            unsigned long match_length = MIN_MATCH;
+            while (ip + match_length < iend && candidate[match_length] == ip[match_length])
+                match_length++;
+            op = put_sequence (op, oend, anchor, (unsigned long)(ip - anchor), (unsigned long)(ip - candidate), match_length);
+            if (!op)
+                return 0;
+            ip += match_length;
+            anchor = ip;
+        }
+    }
+
+    op = put_sequence (op, oend, anchor, (unsigned long)(iend - anchor), 0, 0);
+    return op ? (unsigned long)(op - destination) : 0;
+}
+
+
+/* Length continued in bytes of 255, false if the input ends */
+static inline bool get_length (const uint8_t** ip, const uint8_t* iend, unsigned long* length)
+{
+    uint8_t b;
+    do
+    {
+        if (*ip >= iend)
+            return false;
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return true;
+}
+
+
+unsigned long cw_block_decompress (const uint8_t* source, unsigned long length, uint8_t* destination, unsigned long capacity)
+{
+    const uint8_t* ip = source;
+    const uint8_t* iend = source + length;
+    uint8_t* op = destination;
+    uint8_t* oend = destination + capacity;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+        unsigned long literal_length = token >> 4;
+        if (literal_length == 15 && !get_length (&ip, iend, &literal_length))
+            return 0;
+        if (literal_length > (unsigned long)(iend - ip) || literal_length > (unsigned long)(oend - op))
+            return 0;
+        memcpy (op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == iend)
+            break;              /* the last sequence has no match */
+
+        if (iend - ip < 2)
+            return 0;
+        unsigned long offset = ip[0] | (unsigned long)ip[1] << 8;
+        ip += 2;
+        unsigned long match_length = token & 15;
+        if (match_length == 15 && !get_length (&ip, iend, &match_length))
+            return 0;
+        match_length += MIN_MATCH;
+        if (!offset || offset > (unsigned long)(op - destination) || match_length > (unsigned long)(oend - op))
+            return 0;
+
+        const uint8_t* match = op - offset;
+        if (offset >= match_length)
+            memcpy (op, match, match_length);
+        else
+            for (unsigned long i = 0; i < match_length; i++)    /* overlapping, a repeated pattern */
+                op[i] = match[i];
+        op += match_length;
+    }
+    return (unsigned long)(op - destination);
+}
+
+
+
+/*****************************************  COMPRESSING PACK CONTEXT  ***************************/
+
+
+static int compress_block (cw_pack_context* pc)
+{
+    compressing_pack_context* cpc = (compressing_pack_context*)pc;
+    unsigned long length = (unsigned long)(pc->current - pc->start);
+    if (!length)
+        return CWP_RC_OK;
+
+    unsigned long needed = CW_BLOCK_HEADER_LENGTH + CW_BLOCK_COMPRESS_BOUND(length);
+    if (cpc->compressed_capacity < needed)
+    {
+        uint8_t* compressed = (uint8_t*)realloc (cpc->compressed, needed);
+        if (!compressed)
+            return CWP_RC_BUFFER_OVERFLOW;
+        cpc->compressed = compressed;
+        cpc->compressed_capacity = needed;
+    }
+
+    uint8_t* block = cpc->compressed;
+    unsigned long compressed_length = cw_block_compress (pc->start, length, block + CW_BLOCK_HEADER_LENGTH, length - 1);
+    cw_store_le32 (block, (uint32_t)length);
+    if (compressed_length)
+        cw_store_le32 (block + 4, (uint32_t)compressed_length);
+    else
+    {
+        cw_store_le32 (block + 4, (uint32_t)length | STORED_BLOCK);
+        memcpy (block + CW_BLOCK_HEADER_LENGTH, pc->start, length);
+        compressed_length = length;
+    }
+
+    int rc = block_pack_stage_insert (pc, cpc->sink, block, block + CW_BLOCK_HEADER_LENGTH, compressed_length);
+    if (rc != CWP_RC_OK)
+        return rc;
+    cpc->raw_bytes += length;
+    cpc->compressed_bytes += CW_BLOCK_HEADER_LENGTH + compressed_length;
+    return CWP_RC_OK;
+}
+
+
+static int handle_compressing_pack_overflow (cw_pack_context* pc, unsigned long more)
+{
+    return block_pack_stage_overflow (pc, more, CW_COMPRESS_MAX_BLOCK_LENGTH, &compress_block);
+}
+
+
+void init_compressing_pack_context (compressing_pack_context* cpc, unsigned long block_length, cw_pack_context* sink)
+{
+    cpc->sink = sink;
+    cpc->compressed = NULL;
+    cpc->compressed_capacity = 0;
+    cpc->raw_bytes = 0;
+    cpc->compressed_bytes = 0;
+    init_block_pack_stage ((cw_pack_context*)cpc, block_length, CW_COMPRESS_MAX_BLOCK_LENGTH, &handle_compressing_pack_overflow, &compress_block);
+}
+
+
+void terminate_compressing_pack_context (compressing_pack_context* cpc)
+{
+    terminate_block_pack_stage ((cw_pack_context*)cpc);
+    free (cpc->compressed);
+    cpc->compressed = NULL;
+}
+
+
+
+/*****************************************  DECOMPRESSING UNPACK CONTEXT  ***********************/
+
+
+static int parse_compressed_header (const uint8_t* header, unsigned long* raw_length, unsigned long* data_length)
+{
+    uint32_t compressed_length = cw_load_le32 (header + 4);
+    bool stored = compressed_length & STORED_BLOCK;
+    *raw_length = cw_load_le32 (header);
+    *data_length = compressed_length & ~STORED_BLOCK;
+    if (*data_length > *raw_length || (stored && *data_length != *raw_length))
+        return CWP_RC_MALFORMED_INPUT;
+    return CWP_RC_OK;
+}
+
+
+static int decompress_block (cw_unpack_context*, const uint8_t* header, const uint8_t* data, unsigned long data_length, uint8_t* destination, unsigned long raw_length)
+{
+    if (cw_load_le32 (header + 4) & STORED_BLOCK)
+        memcpy (destination, data, raw_length);
+    else if (cw_block_decompress (data, data_length, destination, raw_length) != raw_length)
+        return CWP_RC_MALFORMED_INPUT;
+    return CWP_RC_OK;
+}
+
+
+static int handle_decompressing_unpack_underflow (cw_unpack_context* uc, unsigned long more)
+{
+    decompressing_unpack_context* duc = (decompressing_unpack_context*)uc;
+    return block_unpack_stage_underflow (uc, &duc->buffer_length, duc->source, more, CW_COMPRESS_MAX_BLOCK_LENGTH,
+                                         &parse_compressed_header, &decompress_block);
+}
+
+
+void init_decompressing_unpack_context (decompressing_unpack_context* duc, unsigned long initial_buffer_length, cw_unpack_context* source)
+{
+    duc->source = source;
+    init_block_unpack_stage ((cw_unpack_context*)duc, &duc->buffer_length, initial_buffer_length, &handle_decompressing_unpack_underflow);
+}
+
+
+void terminate_decompressing_unpack_context (decompressing_unpack_context* duc)
+{
+    terminate_block_unpack_stage ((cw_unpack_context*)duc);
+}
@@ -0,0 +1,100 @@
+/*      CWPack/goodies - compress_context.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef compress_context_h
+#define compress_context_h
+
+#include "cwpack.hpp"
+
+
+/*****************************************  BLOCK COMPRESSION  **********************************/
+
+/*
+ * A small LZ77 compressor in the LZ4 family: sequences of literals and back references of
+ * at least 4 bytes within the last 64 KiB. It has no dependencies, compresses fast and
+ * decompresses faster, and decompression checks all lengths and offsets against the buffers.
+ */
+
+/* Largest compressed length of length bytes */
+#define CW_BLOCK_COMPRESS_BOUND(length)     ((length) + (length) / 255 + 16)
+
+/* Returns the compressed length, or 0 if it would be more than capacity */
+unsigned long cw_block_compress (const uint8_t* source, unsigned long length, uint8_t* destination, unsigned long capacity);
+
+/* Returns the decompressed length, or 0 if the block is malformed or doesn't fit in capacity */
+unsigned long cw_block_decompress (const uint8_t* source, unsigned long length, uint8_t* destination, unsigned long capacity);
+
+
+
+/*****************************************  COMPRESSING PACK CONTEXT  ***************************/
+
+/*
+ * A pack context that compresses its buffer into a block whenever it is full or flushed, and
+ * packs the blocks as raw bytes to another pack context, e.g. a file or stream pack context,
+ * that does the writing. A block is
+ *
+ *      raw length              4 bytes little endian
+ *      compressed length       4 bytes little endian, high bit set if the block is stored
+ *      data
+ *
+ * A block that doesn't compress is stored as it is. A block holds at most
+ * CW_COMPRESS_MAX_BLOCK_LENGTH raw bytes, so no item can be larger, and the unpack context
+ * rejects a block header with larger lengths as malformed.
+ */
+
+#define CW_COMPRESS_MAX_BLOCK_LENGTH        (64ul << 20)
+
+typedef struct
+{
+    cw_pack_context     pc;
+    cw_pack_context     *sink;          /* gets the blocks */
+    uint8_t             *compressed;
+    unsigned long       compressed_capacity;
+    unsigned long long  raw_bytes;
+    unsigned long long  compressed_bytes;   /* including block headers */
+} compressing_pack_context;
+
+
+void init_compressing_pack_context (compressing_pack_context* cpc, unsigned long block_length, cw_pack_context* sink);
+
+/* Compress the last block. The sink is left to its owner to flush and terminate. */
+void terminate_compressing_pack_context (compressing_pack_context* cpc);
+
+
+
+/*****************************************  DECOMPRESSING UNPACK CONTEXT  ***********************/
+
+/* An unpack context that reads blocks from another unpack context and decompresses them */
+
+typedef struct
+{
+    cw_unpack_context   uc;
+    cw_unpack_context   *source;        /* gives the blocks */
+    unsigned long       buffer_length;
+} decompressing_unpack_context;
+
+
+void init_decompressing_unpack_context (decompressing_unpack_context* duc, unsigned long initial_buffer_length, cw_unpack_context* source);
+
+void terminate_decompressing_unpack_context (decompressing_unpack_context* duc);
+
+#endif /* compress_context_h */
@@ -0,0 +1,371 @@
+/*      CWPack/goodies - frame_stream.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <sys/stat.h>
+
+#include "frame_stream.h"
+#include "cwpack_utils.h"
+
+
+#define MAX_VARINT_LENGTH CW_FRAME_MAX_VARINT
+
+
+static int encode_varint (uint64_t value, uint8_t* p)
+{
+    int length = 0;
+    while (value >= 0x80)
+    {
+        p[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    p[length++] = (uint8_t)value;
+    return length;
+}
+
+
+
+/*****************************************  FRAME WRITER  ***************************************/
+
+
+static void put_raw (cw_pack_context* pc, const void* data, unsigned long length)
+{
+    if (pc->return_code)
+        return;
+    if ((unsigned long)(pc->end - pc->current) < length)
+    {
+        int rc = pc->overflow (pc, length);
+        if (rc)
+        {
+            pc->return_code = rc;
+            return;
+        }
+    }
+    memcpy (pc->current, data, length);
+    pc->current += length;
+}
+
+
+static void add_to_index (frame_writer* fw, uint64_t offset)
+{
+    if (!fw->write_index)
+        return;
+    if (fw->count == fw->capacity)
+    {
+        unsigned long capacity = fw->capacity ? 2 * fw->capacity : 1024;
+        uint64_t* index = (uint64_t*)realloc (fw->index, capacity * sizeof(uint64_t));
+        if (!index)
+        {
+            fw->fpc.pc.return_code = CWP_RC_MALLOC_ERROR;
+            return;
+        }
+        fw->index = index;
+        fw->capacity = capacity;
+    }
+    fw->index[fw->count] = offset;
+}
+
+
+void init_frame_writer (frame_writer* fw, unsigned long buffer_length, int fileDescriptor, bool write_index)
+{
+    fw->write_index = write_index;
+    fw->position = 0;
+    fw->index = NULL;
+    fw->count = 0;
+    fw->capacity = 0;
+    init_file_pack_context (&fw->fpc, buffer_length, fileDescriptor);
+}
+
+
+void frame_writer_begin (frame_writer* fw)
+{
+    cw_pack_context* pc = &fw->fpc.pc;
+    if (pc->return_code)
+        return;
+
+    /* room for the longest varint, the record is moved down at end */
+    if (pc->end - pc->current < MAX_VARINT_LENGTH)
+    {
+        int rc = pc->overflow (pc, MAX_VARINT_LENGTH);
+        if (rc)
+        {
+            pc->return_code = rc;
+            return;
+        }
+    }
+    file_pack_context_set_barrier (&fw->fpc);
+    pc->current += MAX_VARINT_LENGTH;
+}
+
+
+void frame_writer_end (frame_writer* fw)
+{
+    cw_pack_context* pc = &fw->fpc.pc;
+    uint8_t* frame = fw->fpc.barrier;
+    file_pack_context_release_barrier (&fw->fpc);
+    if (pc->return_code || !frame)
+        return;
+
+    uint64_t length = (uint64_t)(pc->current - frame - MAX_VARINT_LENGTH);
+    if (length > CW_FRAME_MAX_RECORD_LENGTH)
+    {
+        pc->current = frame;
+        pc->return_code = CWP_RC_BUFFER_OVERFLOW;
+        return;
+    }
+    uint8_t varint[MAX_VARINT_LENGTH];
+    int varint_length = encode_varint (length, varint);
+    memmove (frame + varint_length, frame + MAX_VARINT_LENGTH, length);
+    memcpy (frame, varint, varint_length);
+    pc->current -= MAX_VARINT_LENGTH - varint_length;
+
+    add_to_index (fw, fw->position);
+    fw->count++;
+    fw->position += varint_length + length;
+}
+
+
+void frame_writer_write (frame_writer* fw, const void* record, unsigned long length)
+{
+    cw_pack_context* pc = &fw->fpc.pc;
+    if (length > CW_FRAME_MAX_RECORD_LENGTH)
+    {
+        pc->return_code = CWP_RC_BUFFER_OVERFLOW;
+        return;
+    }
+    uint8_t varint[MAX_VARINT_LENGTH];
+    int varint_length = encode_varint (length, varint);
+    put_raw (pc, varint, varint_length);
+    put_raw (pc, record, length);
+    if (pc->return_code)
+        return;
+
+    add_to_index (fw, fw->position);
+    fw->count++;
+    fw->position += varint_length + length;
+}
+
+
+void terminate_frame_writer (frame_writer* fw)
+{
+    cw_pack_context* pc = &fw->fpc.pc;
+    if (fw->write_index && !pc->return_code)
+    {
+        uint8_t trailer[16];
+        uint64_t index_offset = fw->position;
+        put_raw (pc, "", 1);
+        cw_pack_array_size (pc, (uint32_t)fw->count);
+        for (unsigned long i = 0; i < fw->count; i++)
+            cw_pack_unsigned (pc, fw->index[i]);
+        for (int i = 0; i < 8; i++)
+            trailer[i] = (uint8_t)(index_offset >> (8 * i));
+        memcpy (trailer + 8, CW_FRAME_INDEX_MAGIC, 8);
+        put_raw (pc, trailer, 16);
+    }
+    terminate_file_pack_context (&fw->fpc);
+    free (fw->index);
+    fw->index = NULL;
+}
+
+
+
+/*****************************************  FRAME READER  ***************************************/
+
+
+void init_frame_reader (frame_reader* fr, unsigned long buffer_length, int fileDescriptor)
+{
+    off_t base = lseek (fileDescriptor, 0, SEEK_CUR);
+    fr->base = base < 0 ? 0 : (uint64_t)base;
+    fr->position = 0;
+    fr->index = NULL;
+    fr->count = 0;
+    init_file_unpack_context (&fr->fuc, buffer_length, fileDescriptor);
+}
+
+
+int frame_reader_next (frame_reader* fr, const uint8_t** record, unsigned long* length)
+{
+    cw_unpack_context* uc = &fr->fuc.uc;
+    if (uc->return_code)
+        return uc->return_code;
+
+    uint64_t l;
+    int varint_length;
+    while ((varint_length = cw_frame_decode_length (uc->current, uc->end, &l)) == 0)
+    {
+        unsigned long available = (unsigned long)(uc->end - uc->current);
+        int rc = uc->underflow (uc, available + 1);
+        if (rc)
+        {
+            if (rc == CWP_RC_END_OF_INPUT && available)
+                rc = CWP_RC_BUFFER_UNDERFLOW;
+            return uc->return_code = rc;
+        }
+    }
+    if (varint_length < 0 || l > CW_FRAME_MAX_RECORD_LENGTH)
+        return uc->return_code = CWP_RC_MALFORMED_INPUT;
+    if (l == 0)
+        return uc->return_code = CWP_RC_END_OF_INPUT;
+
+    uc->current += varint_length;
+    if ((uint64_t)(uc->end - uc->current) < l)
+    {
+        int rc = uc->underflow (uc, (unsigned long)l);
+        if (rc)
+            return uc->return_code = rc == CWP_RC_END_OF_INPUT ? CWP_RC_BUFFER_UNDERFLOW : rc;
+    }
+    *record = uc->current;
+    *length = (unsigned long)l;
+    uc->current += l;
+    fr->position += varint_length + l;
+    return CWP_RC_OK;
+}
+
+
+static int read_trailer_index (frame_reader* fr, uint64_t end)
+{
+    int fileDescriptor = fr->fuc.fileDescriptor;
+    uint8_t trailer[16];
+    if (end - fr->base < 17 || pread (fileDescriptor, trailer, 16, (off_t)(end - 16)) != 16 ||
+        memcmp (trailer + 8, CW_FRAME_INDEX_MAGIC, 8))
+        return CWP_RC_END_OF_INPUT;
+
+    uint64_t index_offset = 0;
+    for (int i = 0; i < 8; i++)
+        index_offset |= (uint64_t)trailer[i] << (8 * i);
+    uint64_t index_end = end - 16 - fr->base;
+    if (index_offset >= index_end)
+        return CWP_RC_MALFORMED_INPUT;
+
+    unsigned long length = (unsigned long)(index_end - index_offset);
+    uint8_t* packed = (uint8_t*)malloc (length);
+    if (!packed)
+        return CWP_RC_MALLOC_ERROR;
+    if (pread (fileDescriptor, packed, length, (off_t)(fr->base + index_offset)) != (long)length || packed[0])
+    {
+        free (packed);
+        return CWP_RC_MALFORMED_INPUT;
+    }
+
+    cw_static_unpack_context suc;
+    cw_unpack_context_init (&suc, packed + 1, length - 1);
+    unsigned long count = cw_unpack_next_array_size (&suc);
+    uint64_t* index = (uint64_t*)malloc ((count ? count : 1) * sizeof(uint64_t));
+    for (unsigned long i = 0; index && i < count; i++)
+        index[i] = cw_unpack_next_unsigned64 (&suc);
+    int rc = index ? suc.return_code : CWP_RC_MALLOC_ERROR;
+    free (packed);
+    if (rc)
+    {
+        free (index);
+        return rc;
+    }
+    fr->index = index;
+    fr->count = count;
+    return CWP_RC_OK;
+}
+
+
+/* Hop from frame to frame, reading only the varints */
+static int scan_index (frame_reader* fr, uint64_t end)
+{
+    unsigned long capacity = 1024;
+    uint64_t* index = (uint64_t*)malloc (capacity * sizeof(uint64_t));
+    unsigned long count = 0;
+    uint64_t offset = 0;
+    while (index && fr->base + offset < end)
+    {
+        uint8_t bytes[MAX_VARINT_LENGTH];
+        long got = pread (fr->fuc.fileDescriptor, bytes, MAX_VARINT_LENGTH, (off_t)(fr->base + offset));
+        uint64_t length;
+        int varint_length = got > 0 ? cw_frame_decode_length (bytes, bytes + got, &length) : -1;
+        if (varint_length <= 0 || length > CW_FRAME_MAX_RECORD_LENGTH || length > end - fr->base - offset - varint_length)
+        {
+            free (index);
+            return CWP_RC_MALFORMED_INPUT;
+        }
+        if (!length)
+            break;
+
+        if (count == capacity)
+        {
+            capacity *= 2;
+            uint64_t* grown = (uint64_t*)realloc (index, capacity * sizeof(uint64_t));
+            if (!grown)
+                free (index);
+            index = grown;
+            if (!index)
+                break;
+        }
+        index[count++] = offset;
+        offset += varint_length + length;
+    }
+    if (!index)
+        return CWP_RC_MALLOC_ERROR;
+
+    fr->index = index;
+    fr->count = count;
+    return CWP_RC_OK;
+}
+
+
+int frame_reader_load_index (frame_reader* fr)
+{
+    struct stat status;
+    if (fstat (fr->fuc.fileDescriptor, &status) < 0 || lseek (fr->fuc.fileDescriptor, 0, SEEK_CUR) < 0)
+    {
+        fr->fuc.uc.err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+
+    free (fr->index);
+    fr->index = NULL;
+    fr->count = 0;
+    uint64_t end = (uint64_t)status.st_size;
+    int rc = read_trailer_index (fr, end);
+    return rc == CWP_RC_END_OF_INPUT ? scan_index (fr, end) : rc;
+}
+
+
+int frame_reader_seek (frame_reader* fr, unsigned long n)
+{
+    if (n >= fr->count)
+        return CWP_RC_VALUE_ERROR;
+
+    if (lseek (fr->fuc.fileDescriptor, (off_t)(fr->base + fr->index[n]), SEEK_SET) < 0)
+    {
+        fr->fuc.uc.err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    reset_file_unpack_context (&fr->fuc, fr->fuc.fileDescriptor);
+    fr->position = fr->index[n];
+    return CWP_RC_OK;
+}
+
+
+void terminate_frame_reader (frame_reader* fr)
+{
+    terminate_file_unpack_context (&fr->fuc);
+    free (fr->index);
+    fr->index = NULL;
+    fr->count = 0;
+}
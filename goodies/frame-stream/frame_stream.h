@@ -0,0 +1,120 @@
+/*      CWPack/goodies - frame_stream.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef frame_stream_h
+#define frame_stream_h
+
+#include "basic_contexts.h"
+
+
+/*****************************************  FRAME STREAM  ***************************************/
+
+/*
+ * A framed stream is a sequence of records, each preceded by its length as a varint
+ * (LEB128), so a reader can split the stream without decoding the records. The writer can
+ * end the stream with a frame index:
+ *
+ *      0x00                    a zero length, ending the records
+ *      [offset, ...]           msgpack array with the offset of each record's frame
+ *      offset                  8 bytes little endian, of the 0x00 above
+ *      "CWFRAMES"              8 bytes magic
+ *
+ * Offsets are from the start of the stream. A record is at most CW_FRAME_MAX_RECORD_LENGTH
+ * bytes; the reader takes a longer length as a corrupt stream.
+ */
+
+#define CW_FRAME_INDEX_MAGIC        "CWFRAMES"
+#define CW_FRAME_MAX_VARINT         10
+#define CW_FRAME_MAX_RECORD_LENGTH  (1ul << 30)
+
+/* Decode the varint length of a frame from p up to end. Returns the length of the varint,
+   0 if it is incomplete and -1 if it is malformed. */
+inline int cw_frame_decode_length (const uint8_t* p, const uint8_t* end, uint64_t* value)
+{
+    *value = 0;
+    for (int i = 0; i < CW_FRAME_MAX_VARINT && p + i < end; i++)
+    {
+        *value |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80))
+            return i + 1;
+    }
+    return end - p >= CW_FRAME_MAX_VARINT ? -1 : 0;
+}
+
+
+
+/*****************************************  FRAME WRITER  ***************************************/
+
+typedef struct
+{
+    file_pack_context   fpc;
+    bool                write_index;
+    uint64_t            position;       /* of the next frame */
+    uint64_t            *index;
+    unsigned long       count;          /* records written */
+    unsigned long       capacity;
+} frame_writer;
+
+
+void init_frame_writer (frame_writer* fw, unsigned long buffer_length, int fileDescriptor, bool write_index);
+
+/* A record is packed to fw->fpc.pc between begin and end. The record is held in the buffer
+   until end, which puts the length in front of it. */
+void frame_writer_begin (frame_writer* fw);
+void frame_writer_end (frame_writer* fw);
+
+/* Frame an already packed record */
+void frame_writer_write (frame_writer* fw, const void* record, unsigned long length);
+
+/* Write the index, if asked for, and flush. Errors are in fw->fpc.pc.return_code. */
+void terminate_frame_writer (frame_writer* fw);
+
+
+
+/*****************************************  FRAME READER  ***************************************/
+
+typedef struct
+{
+    file_unpack_context fuc;
+    uint64_t            base;           /* file offset of the start of the stream */
+    uint64_t            position;       /* of the next frame */
+    uint64_t            *index;         /* after frame_reader_load_index */
+    unsigned long       count;
+} frame_reader;
+
+
+void init_frame_reader (frame_reader* fr, unsigned long buffer_length, int fileDescriptor);
+
+/* The next record, valid until the next call. Returns CWP_RC_END_OF_INPUT after the last record,
+   CWP_RC_MALFORMED_INPUT for a length above CW_FRAME_MAX_RECORD_LENGTH. */
+int frame_reader_next (frame_reader* fr, const uint8_t** record, unsigned long* length);
+
+/* Load the frame index of a seekable file. Without an index at the end of the file, the index
+   is built by hopping from frame to frame, reading only the lengths. */
+int frame_reader_load_index (frame_reader* fr);
+
+/* Position the reader at record n, after frame_reader_load_index */
+int frame_reader_seek (frame_reader* fr, unsigned long n);
+
+void terminate_frame_reader (frame_reader* fr);
+
+#endif /* frame_stream_h */
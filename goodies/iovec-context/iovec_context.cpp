@@ -0,0 +1,124 @@
+/*      CWPack/goodies - iovec_context.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "iovec_context.h"
+
+
+
+void init_iovec_pack_context (iovec_pack_context* ipc, unsigned long chunk_length, unsigned long reference_threshold)
+{
+    cwpack::iovec_sink sink;
+    sink.chunk_length = chunk_length > 32 ? chunk_length : 4096;
+    sink.reference_threshold = reference_threshold;
+    uint8_t* chunk = (uint8_t*)malloc (sink.chunk_length);
+    if (chunk)
+        sink.chunks.push_back(chunk);
+    sink.segment_start = chunk;
+
+    cw_pack_context_init (ipc, chunk, chunk ? sink.chunk_length : 0, std::move(sink));
+    if (!chunk)
+        ipc->return_code = CWP_RC_MALLOC_ERROR;
+}
+
+
+const struct iovec* iovec_pack_context_iov (iovec_pack_context* ipc, int* count)
+{
+    ipc->close_segment (ipc);
+    *count = (int)ipc->segments.size();
+    return ipc->segments.data();
+}
+
+
+unsigned long iovec_pack_context_length (iovec_pack_context* ipc)
+{
+    ipc->close_segment (ipc);
+    unsigned long length = 0;
+    for (const struct iovec& segment : ipc->segments)
+        length += segment.iov_len;
+    return length;
+}
+
+
+int iovec_pack_context_writev (iovec_pack_context* ipc, int fileDescriptor)
+{
+    if (ipc->return_code)
+        return ipc->return_code;
+
+    int count;
+    struct iovec* iov = (struct iovec*)iovec_pack_context_iov (ipc, &count);
+    std::vector<struct iovec> left (iov, iov + count);
+    struct iovec* next = left.data();
+    while (count)
+    {
+        long written = writev (fileDescriptor, next, count < IOV_MAX ? count : IOV_MAX);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ipc->err_no = errno;
+            return ipc->return_code = CWP_RC_ERROR_IN_HANDLER;
+        }
+        while (count && (unsigned long)written >= next->iov_len)
+        {
+            written -= next->iov_len;
+            next++;
+            count--;
+        }
+        if (count)
+        {
+            next->iov_base = (uint8_t*)next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+    return CWP_RC_OK;
+}
+
+
+void reset_iovec_pack_context (iovec_pack_context* ipc)
+{
+    for (size_t i = 1; i < ipc->chunks.size(); i++)
+        free (ipc->chunks[i]);
+    if (ipc->chunks.size() > 1)
+        ipc->chunks.resize(1);
+    ipc->segments.clear();
+    if (ipc->chunks.empty())
+        return;
+
+    ipc->start = ipc->current = ipc->segment_start = ipc->chunks[0];
+    ipc->end = ipc->start + ipc->chunk_length;
+    ipc->return_code = CWP_RC_OK;
+}
+
+
+void terminate_iovec_pack_context (iovec_pack_context* ipc)
+{
+    for (uint8_t* chunk : ipc->chunks)
+        free (chunk);
+    std::vector<uint8_t*>().swap(ipc->chunks);
+    std::vector<struct iovec>().swap(ipc->segments);
+    ipc->start = ipc->current = ipc->end = ipc->segment_start = NULL;
+}
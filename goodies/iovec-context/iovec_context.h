@@ -0,0 +1,113 @@
+/*      CWPack/goodies - iovec_context.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef iovec_context_h
+#define iovec_context_h
+
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <vector>
+
+#include "cwpack.hpp"
+
+
+/*****************************************  IOVEC PACK CONTEXT  *********************************/
+
+/*
+ * A scatter-gather pack context. Headers and small items are packed into buffer chunks, while
+ * str, bin and ext payloads of at least reference_threshold bytes are kept by reference, not
+ * copied. The message is then a list of iovecs, that can be written with one writev or sendmsg.
+ * Referenced payloads must be kept until the message is written.
+ * A full chunk is never moved, so deferred container headers (cw_pack_array_begin) must be
+ * ended before the chunk is full, which holds when the chunk is larger than the contents.
+ * A container with a referenced payload can't be compacted: its compact end returns
+ * CWP_RC_ILLEGAL_CALL, while a plain end works.
+ */
+
+namespace cwpack {
+
+struct iovec_sink {
+    template <class Context>
+    int overflow (Context* pc, unsigned long more)
+    {
+        close_segment (pc);
+        unsigned long length = chunk_length < more ? more : chunk_length;
+        uint8_t* chunk = (uint8_t*)malloc (length);
+        if (!chunk)
+            return CWP_RC_BUFFER_OVERFLOW;
+
+        chunks.push_back(chunk);
+        pc->start = pc->current = segment_start = chunk;
+        pc->end = chunk + length;
+        return CWP_RC_OK;
+    }
+
+    template <class Context>
+    int flush (Context* pc)
+    {
+        close_segment (pc);
+        return CWP_RC_OK;
+    }
+
+    template <class Context>
+    int reference (Context* pc, const void* v, uint32_t l)
+    {
+        close_segment (pc);
+        segments.push_back({(void*)v, l});
+        return CWP_RC_OK;
+    }
+
+    template <class Context>
+    void close_segment (Context* pc)
+    {
+        if (pc->current > segment_start)
+            segments.push_back({segment_start, (size_t)(pc->current - segment_start)});
+        segment_start = pc->current;
+    }
+
+    unsigned long               reference_threshold;
+    unsigned long               chunk_length;
+    uint8_t*                    segment_start;      /* of the bytes packed since the last segment */
+    std::vector<struct iovec>   segments;
+    std::vector<uint8_t*>       chunks;             /* the current chunk is the last */
+};
+
+}
+
+typedef cwpack::basic_context<cwpack::iovec_sink> iovec_pack_context;
+
+
+void init_iovec_pack_context (iovec_pack_context* ipc, unsigned long chunk_length, unsigned long reference_threshold);
+
+/* The packed message, valid until the context is packed to, reset or terminated */
+const struct iovec* iovec_pack_context_iov (iovec_pack_context* ipc, int* count);
+unsigned long iovec_pack_context_length (iovec_pack_context* ipc);
+
+/* Write the message with writev, as many calls as needed for IOV_MAX and partial writes */
+int iovec_pack_context_writev (iovec_pack_context* ipc, int fileDescriptor);
+
+/* Start a new message, keeping the first chunk */
+void reset_iovec_pack_context (iovec_pack_context* ipc);
+
+void terminate_iovec_pack_context (iovec_pack_context* ipc);
+
+#endif /* iovec_context_h */
@@ -0,0 +1,651 @@
+/*      CWPack/goodies - cwpack_json.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include <array>
+#include <charconv>
+#include <cmath>
+
+#include "cwpack_json.h"
+
+#if !defined(CWPACK_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CWPACK_JSON_X86
+#include <immintrin.h>
+#endif
+
+
+
+/*****************************************  JSON TEXT  ******************************************/
+
+namespace {
+
+constexpr std::array<bool, 256> make_plain_bytes ()
+{
+    std::array<bool, 256> table{};
+    for (int c = 0; c < 256; c++)
+        table[c] = c >= 0x20 && c != '"' && c != '\\';
+    return table;
+}
+
+constexpr std::array<bool, 256> plain_bytes = make_plain_bytes();
+
+unsigned long scalar_plain_run (const uint8_t* p, unsigned long length)
+{
+    unsigned long i = 0;
+    while (i < length && plain_bytes[p[i]])
+        i++;
+    return i;
+}
+
+#ifdef CWPACK_JSON_X86
+
+unsigned long sse2_plain_run (const uint8_t* p, unsigned long length)
+{
+    const __m128i control = _mm_set1_epi8(0x1f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    unsigned long i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i special = _mm_cmpeq_epi8(_mm_subs_epu8(v, control), _mm_setzero_si128());
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(v, quote));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(v, backslash));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(special);
+        if (mask)
+            return i + (unsigned long)__builtin_ctz(mask);
+    }
+    return i + scalar_plain_run(p + i, length - i);
+}
+
+__attribute__((target("avx2")))
+unsigned long avx2_plain_run (const uint8_t* p, unsigned long length)
+{
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    unsigned long i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i special = _mm256_cmpeq_epi8(_mm256_subs_epu8(v, control), _mm256_setzero_si256());
+        special = _mm256_or_si256(special, _mm256_cmpeq_epi8(v, quote));
+        special = _mm256_or_si256(special, _mm256_cmpeq_epi8(v, backslash));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(special);
+        if (mask)
+            return i + (unsigned long)__builtin_ctz(mask);
+    }
+    return i + sse2_plain_run(p + i, length - i);
+}
+
+#endif
+
+typedef unsigned long (*plain_run_scanner)(const uint8_t* p, unsigned long length);
+
+plain_run_scanner select_plain_run ()
+{
+#ifdef CWPACK_JSON_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &avx2_plain_run;
+    return &sse2_plain_run;
+#else
+    return &scalar_plain_run;
+#endif
+}
+
+
+/* Make an integral looking number a real, "1e+20" is fine as it is */
+int mark_real (char* text, int length)
+{
+    if (!memchr (text, '.', (size_t)length) && !memchr (text, 'e', (size_t)length))
+    {
+        memcpy (text + length, ".0", 2);
+        length += 2;
+    }
+    return length;
+}
+
+}
+
+
+unsigned long cw_json_plain_run (const uint8_t* p, unsigned long length)
+{
+    /* most strings are short, don't pay for the indirect call on them */
+    if (length < 16)
+        return scalar_plain_run (p, length);
+    static const plain_run_scanner scanner = select_plain_run();
+    return scanner (p, length);
+}
+
+
+int cw_json_format_double (double value, char* text)
+{
+    if (!std::isfinite (value))
+    {
+        memcpy (text, "null", 4);
+        return 4;
+    }
+    int length = (int)(std::to_chars (text, text + CW_JSON_NUMBER_MAX - 2, value).ptr - text);
+    return mark_real (text, length);
+}
+
+
+int cw_json_format_float (float value, char* text)
+{
+    if (!std::isfinite (value))
+    {
+        memcpy (text, "null", 4);
+        return 4;
+    }
+    int length = (int)(std::to_chars (text, text + CW_JSON_NUMBER_MAX - 2, value).ptr - text);
+    return mark_real (text, length);
+}
+
+
+/* Civil date from days since 1970-01-01, valid for all int64 seconds (H. Hinnant) */
+int cw_json_format_timestamp (int64_t tv_sec, uint32_t tv_nsec, char* text)
+{
+    int64_t days = tv_sec / 86400;
+    int64_t seconds = tv_sec % 86400;
+    if (seconds < 0)
+    {
+        seconds += 86400;
+        days--;
+    }
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t day_of_era = days - era * 146097;
+    int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int64_t mp = (5 * day_of_year + 2) / 153;
+    int64_t day = day_of_year - (153 * mp + 2) / 5 + 1;
+    int64_t month = mp < 10 ? mp + 3 : mp - 9;
+    int64_t year = year_of_era + era * 400 + (month <= 2);
+
+    char* p = text;
+    if (year >= 0 && year <= 9999)
+    {
+        for (int i = 3; i >= 0; i--, year /= 10)
+            p[i] = (char)('0' + year % 10);
+        p += 4;
+    }
+    else
+        p = std::to_chars (p, text + CW_JSON_NUMBER_MAX, year).ptr;
+
+    int64_t fields[5] = {month, day, seconds / 3600, seconds / 60 % 60, seconds % 60};
+    const char separators[5] = {'-', '-', 'T', ':', ':'};
+    for (int i = 0; i < 5; i++)
+    {
+        *p++ = separators[i];
+        *p++ = (char)('0' + fields[i] / 10);
+        *p++ = (char)('0' + fields[i] % 10);
+    }
+    if (tv_nsec)
+    {
+        char digits[9];
+        for (int i = 8; i >= 0; i--, tv_nsec /= 10)
+            digits[i] = (char)('0' + tv_nsec % 10);
+        int n = 9;
+        while (digits[n - 1] == '0')
+            n--;
+        *p++ = '.';
+        memcpy (p, digits, (size_t)n);
+        p += n;
+    }
+    *p++ = 'Z';
+    return (int)(p - text);
+}
+
+
+void cw_base64_encode (const uint8_t* data, unsigned long length, char* text)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (; length >= 3; length -= 3, data += 3)
+    {
+        uint32_t bits = (uint32_t)data[0] << 16 | (uint32_t)data[1] << 8 | data[2];
+        *text++ = alphabet[bits >> 18];
+        *text++ = alphabet[(bits >> 12) & 0x3f];
+        *text++ = alphabet[(bits >> 6) & 0x3f];
+        *text++ = alphabet[bits & 0x3f];
+    }
+    if (length)
+    {
+        uint32_t bits = (uint32_t)data[0] << 16 | (length == 2 ? (uint32_t)data[1] << 8 : 0);
+        *text++ = alphabet[bits >> 18];
+        *text++ = alphabet[(bits >> 12) & 0x3f];
+        *text++ = length == 2 ? alphabet[(bits >> 6) & 0x3f] : '=';
+        *text++ = '=';
+    }
+}
+
+
+
+/*****************************************  JSON TO MSGPACK  ************************************/
+
+namespace {
+
+/* Bit masks of the bytes of a 64 byte block */
+struct block_masks {
+    uint64_t    quote;
+    uint64_t    backslash;
+    uint64_t    op;             /* { } [ ] : , */
+    uint64_t    space;
+};
+
+enum : uint8_t { CLASS_OTHER, CLASS_QUOTE, CLASS_BACKSLASH, CLASS_OP, CLASS_SPACE };
+
+constexpr std::array<uint8_t, 256> make_byte_classes ()
+{
+    std::array<uint8_t, 256> table{};
+    for (int c = 0; c < 256; c++)
+        table[c] = c == '"' ? CLASS_QUOTE : c == '\\' ? CLASS_BACKSLASH :
+                   c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',' ? CLASS_OP :
+                   c == ' ' || c == '\t' || c == '\n' || c == '\r' ? CLASS_SPACE : CLASS_OTHER;
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> byte_classes = make_byte_classes();
+
+#ifndef CWPACK_JSON_X86
+
+void scalar_classify (const uint8_t* p, unsigned long blocks, block_masks* masks)
+{
+    for (; blocks; blocks--, p += 64, masks++)
+    {
+        uint64_t bits[5] = {};
+        for (int i = 0; i < 64; i++)
+            bits[byte_classes[p[i]]] |= 1ull << i;
+        *masks = {bits[CLASS_QUOTE], bits[CLASS_BACKSLASH], bits[CLASS_OP], bits[CLASS_SPACE]};
+    }
+}
+
+#else
+
+void sse2_classify (const uint8_t* p, unsigned long blocks, block_masks* masks)
+{
+    for (; blocks; blocks--, p += 64, masks++)
+    {
+        uint64_t quote = 0, backslash = 0, op = 0, space = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * i));
+            __m128i o = _mm_cmpeq_epi8(v, _mm_set1_epi8('{'));
+            o = _mm_or_si128(o, _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+            o = _mm_or_si128(o, _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+            o = _mm_or_si128(o, _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+            o = _mm_or_si128(o, _mm_cmpeq_epi8(v, _mm_set1_epi8(':')));
+            o = _mm_or_si128(o, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+            __m128i s = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+            s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+            s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+            s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+            int shift = 16 * i;
+            quote |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << shift;
+            backslash |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << shift;
+            op |= (uint64_t)(unsigned int)_mm_movemask_epi8(o) << shift;
+            space |= (uint64_t)(unsigned int)_mm_movemask_epi8(s) << shift;
+        }
+        *masks = {quote, backslash, op, space};
+    }
+}
+
+/* The ops and spaces are found with a lookup on the low nibble, which each class member has
+   to itself once [ and ] are folded onto { and } by setting bit 5. The byte is then compared
+   with its table entry. */
+__attribute__((target("avx2")))
+void avx2_classify (const uint8_t* p, unsigned long blocks, block_masks* masks)
+{
+    const __m256i op_table = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, ':', '{', ',', '}', 0, 0);
+    const __m256i space_table = _mm256_setr_epi8(
+        ' ', 0, 0, 0, 0, 0, 0, 0, 0, '\t', '\n', 0, 0, '\r', 0, 0,
+        ' ', 0, 0, 0, 0, 0, 0, 0, 0, '\t', '\n', 0, 0, '\r', 0, 0);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+    const __m256i bit5 = _mm256_set1_epi8(0x20);
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    for (; blocks; blocks--, p += 64, masks++)
+    {
+        uint64_t quote = 0, backslash = 0, op = 0, space = 0;
+        for (int i = 0; i < 2; i++)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(p + 32 * i));
+            __m256i nibble = _mm256_and_si256(v, low_nibble);
+            /* the fold also takes 0x0c and 0x1a to , and :, hence the check for control bytes */
+            __m256i o = _mm256_cmpeq_epi8(_mm256_or_si256(v, bit5), _mm256_shuffle_epi8(op_table, nibble));
+            o = _mm256_and_si256(o, _mm256_cmpgt_epi8(v, control));
+            __m256i s = _mm256_cmpeq_epi8(v, _mm256_shuffle_epi8(space_table, nibble));
+            int shift = 32 * i;
+            quote |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << shift;
+            backslash |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << shift;
+            op |= (uint64_t)(unsigned int)_mm256_movemask_epi8(o) << shift;
+            space |= (uint64_t)(unsigned int)_mm256_movemask_epi8(s) << shift;
+        }
+        *masks = {quote, backslash, op, space};
+    }
+}
+
+#endif
+
+typedef void (*block_classifier)(const uint8_t* p, unsigned long blocks, block_masks* masks);
+
+block_classifier select_classify ()
+{
+#ifdef CWPACK_JSON_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &avx2_classify;
+    return &sse2_classify;
+#else
+    return &scalar_classify;
+#endif
+}
+
+/* Bit i is the xor of bits 0 to i */
+inline uint64_t prefix_xor (uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+const unsigned long window_blocks = 256;
+
+}
+
+
+namespace cwpack {
+namespace json {
+
+constexpr std::array<bool, 256> make_json_delimiters ()
+{
+    std::array<bool, 256> table{};
+    for (int c = 0; c < 256; c++)
+        table[c] = byte_classes[c] == CLASS_OP || byte_classes[c] == CLASS_SPACE || c == '"';
+    return table;
+}
+
+const std::array<bool, 256> json_delimiters = make_json_delimiters();
+
+
+/*
+ * Each window of blocks is classified in one go, then the blocks are indexed in order.
+ * Escaped bytes follow an odd run of backslashes; they are rare, so the backslashes are
+ * walked one by one. Quotes that aren't escaped open and close strings, and a prefix xor
+ * of them marks the bytes in strings. Outside strings the tokens are the ops, the opening
+ * quotes and the first byte of each run of other bytes, i.e. numbers and literals.
+ */
+bool structural_index::refill ()
+{
+    static const block_classifier classify = select_classify();
+    block_masks masks[window_blocks];
+
+    tokens.clear();
+    cursor = 0;
+    while (tokens.empty() && scanned < length)
+    {
+        unsigned long blocks = (length - scanned) / 64;
+        if (blocks > window_blocks)
+            blocks = window_blocks;
+        if (blocks)
+            classify (text + scanned, blocks, masks);
+        else
+        {
+            uint8_t tail[64];
+            memset (tail, ' ', 64);
+            memcpy (tail, text + scanned, length - scanned);
+            classify (tail, 1, masks);
+            blocks = 1;
+        }
+
+        for (unsigned long b = 0; b < blocks; b++, scanned += 64)
+        {
+            const block_masks& m = masks[b];
+            uint64_t escaped_bytes = escaped;
+            escaped = 0;
+            for (uint64_t backslashes = m.backslash & ~escaped_bytes; backslashes; backslashes &= backslashes - 1)
+            {
+                int i = __builtin_ctzll (backslashes);
+                if (escaped_bytes >> i & 1)
+                    continue;
+                if (i == 63)
+                    escaped = 1;
+                else
+                    escaped_bytes |= 1ull << (i + 1);
+            }
+
+            uint64_t quotes = m.quote & ~escaped_bytes;
+            uint64_t strings = prefix_xor (quotes) ^ in_string;
+            in_string = (uint64_t)((int64_t)strings >> 63);
+            uint64_t others = ~(m.op | m.space | quotes | strings);
+            uint64_t scalar_starts = others & ~(others << 1 | in_scalar);
+            in_scalar = others >> 63;
+
+            uint64_t found = (m.op & ~strings) | (quotes & strings) | scalar_starts;
+            for (; found; found &= found - 1)
+                tokens.push_back (scanned + (unsigned long)__builtin_ctzll (found));
+        }
+    }
+    if (scanned > length)
+        scanned = length;
+    return !tokens.empty();
+}
+
+
+static inline int hex_value (uint8_t c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static inline bool parse_hex4 (const uint8_t* p, const uint8_t* end, uint32_t* value)
+{
+    if (end - p < 4)
+        return false;
+    *value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int h = hex_value (p[i]);
+        if (h < 0)
+            return false;
+        *value = *value << 4 | (uint32_t)h;
+    }
+    return true;
+}
+
+
+const uint8_t* parse_string (const uint8_t* p, const uint8_t* end, std::vector<uint8_t>& scratch, const uint8_t** start, unsigned long* length)
+{
+    unsigned long run = cw_json_plain_run (p, (unsigned long)(end - p));
+    if (p + run < end && p[run] == '"')
+    {
+        *start = p;
+        *length = run;
+        return p + run + 1;
+    }
+
+    scratch.clear();
+    for (;;)
+    {
+        scratch.insert (scratch.end(), p, p + run);
+        p += run;
+        if (p == end || *p < 0x20)
+            return NULL;
+        if (*p == '"')
+            break;
+
+        /* a backslash */
+        if (end - p < 2)
+            return NULL;
+        uint8_t c = p[1];
+        p += 2;
+        switch (c)
+        {
+            case '"': case '\\': case '/':
+                scratch.push_back (c);
+                break;
+            case 'b':   scratch.push_back ('\b');   break;
+            case 'f':   scratch.push_back ('\f');   break;
+            case 'n':   scratch.push_back ('\n');   break;
+            case 'r':   scratch.push_back ('\r');   break;
+            case 't':   scratch.push_back ('\t');   break;
+            case 'u':
+            {
+                uint32_t code;
+                if (!parse_hex4 (p, end, &code))
+                    return NULL;
+                p += 4;
+                if (code >= 0xdc00 && code <= 0xdfff)
+                    return NULL;
+                if (code >= 0xd800 && code <= 0xdbff)
+                {
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !parse_hex4 (p + 2, end, &low) || low < 0xdc00 || low > 0xdfff)
+                        return NULL;
+                    p += 6;
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                if (code < 0x80)
+                    scratch.push_back ((uint8_t)code);
+                else if (code < 0x800)
+                {
+                    scratch.push_back ((uint8_t)(0xc0 | code >> 6));
+                    scratch.push_back ((uint8_t)(0x80 | (code & 0x3f)));
+                }
+                else if (code < 0x10000)
+                {
+                    scratch.push_back ((uint8_t)(0xe0 | code >> 12));
+                    scratch.push_back ((uint8_t)(0x80 | (code >> 6 & 0x3f)));
+                    scratch.push_back ((uint8_t)(0x80 | (code & 0x3f)));
+                }
+                else
+                {
+                    scratch.push_back ((uint8_t)(0xf0 | code >> 18));
+                    scratch.push_back ((uint8_t)(0x80 | (code >> 12 & 0x3f)));
+                    scratch.push_back ((uint8_t)(0x80 | (code >> 6 & 0x3f)));
+                    scratch.push_back ((uint8_t)(0x80 | (code & 0x3f)));
+                }
+                break;
+            }
+            default:
+                return NULL;
+        }
+        run = cw_json_plain_run (p, (unsigned long)(end - p));
+    }
+    *start = scratch.data();
+    *length = scratch.size();
+    return p + 1;
+}
+
+
+const uint8_t* parse_number (const uint8_t* p, const uint8_t* end, bool* integral, bool* negative, uint64_t* magnitude, double* real)
+{
+    const uint8_t* start = p;
+    *negative = p < end && *p == '-';
+    if (*negative)
+        p++;
+    if (p == end || *p < '0' || *p > '9')
+        return NULL;
+
+    uint64_t value = 0;
+    bool overflow = false;
+    if (*p == '0')
+        p++;
+    else
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            overflow |= __builtin_mul_overflow (value, 10, &value) || __builtin_add_overflow (value, (uint64_t)(*p - '0'), &value);
+
+    bool fraction = false, exponent = false;
+    if (p < end && *p == '.')
+    {
+        fraction = true;
+        if (++p == end || *p < '0' || *p > '9')
+            return NULL;
+        while (p < end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    if (p < end && (*p | 0x20) == 'e')
+    {
+        exponent = true;
+        if (++p < end && (*p == '+' || *p == '-'))
+            p++;
+        if (p == end || *p < '0' || *p > '9')
+            return NULL;
+        while (p < end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    if (p < end && !json_delimiters[*p])
+        return NULL;
+
+    *integral = !fraction && !exponent && !overflow && (!*negative || value <= 1ull << 63);
+    *magnitude = value;
+    if (*integral)
+        return p;
+
+    std::from_chars_result result = std::from_chars ((const char*)start, (const char*)p, *real);
+    if (result.ec == std::errc::result_out_of_range)
+    {
+        /* too large or too small for a double: the decimal order of the leading digit tells which */
+        const uint8_t* q = start + (*negative ? 1 : 0);
+        long long order = -1;
+        for (; q < p && *q >= '0' && *q <= '9'; q++)
+            if (order >= 0 || *q != '0')
+                order++;
+        if (order < 0 && q < p && *q == '.')
+            for (q++; q < p && *q == '0'; q++)
+                order--;
+        while (q < p && (*q | 0x20) != 'e')
+            q++;
+        long long scale = 0;
+        bool negative_scale = q + 1 < p && q[1] == '-';
+        for (q++; q < p; q++)
+            if (*q >= '0' && *q <= '9' && scale < 1000000)
+                scale = 10 * scale + (*q - '0');
+        bool tiny = order + (negative_scale ? -scale : scale) < 0;
+        *real = tiny ? 0.0 : HUGE_VAL;
+        if (*negative)
+            *real = -*real;
+    }
+    else if (result.ec != std::errc())
+        return NULL;
+    return p;
+}
+
+}
+}
+
+
+int cw_json_to_msgpack (const void* text, unsigned long length, file_pack_context* file_pack_context, unsigned long* position)
+{
+    return cwpack::json::parse ((const uint8_t*)text, length, cwpack::json::file_packer{file_pack_context}, position);
+}
@@ -0,0 +1,592 @@
+/*      CWPack/goodies - cwpack_json.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef cwpack_json_h
+#define cwpack_json_h
+
+#include <string.h>
+
+#include <array>
+#include <charconv>
+#include <vector>
+
+#include "cwpack.hpp"
+#include "basic_contexts.h"
+
+
+/*****************************************  JSON TEXT  ******************************************/
+
+/* Length of the run of bytes from p that can go into a JSON string as they are, i.e. up to
+   the first control character, quote or backslash. Scans 32 or 16 bytes at a time with AVX2
+   or SSE2, chosen at runtime. UTF-8 is passed through without validation. */
+unsigned long cw_json_plain_run (const uint8_t* p, unsigned long length);
+
+#define CW_JSON_NUMBER_MAX      48
+
+/* Shortest text that reads back to the same value. Integral values get a ".0" so they stay
+   reals. NaN and infinities, which JSON lacks, are written as null. Returns the length. */
+int cw_json_format_double (double value, char* text);
+int cw_json_format_float (float value, char* text);
+
+/* RFC 3339 UTC time, e.g. 2021-03-04T05:06:07.89Z, without quotes. Returns the length. */
+int cw_json_format_timestamp (int64_t tv_sec, uint32_t tv_nsec, char* text);
+
+/* Standard base64 with padding, 4 * ((length + 2) / 3) characters. */
+void cw_base64_encode (const uint8_t* data, unsigned long length, char* text);
+
+
+
+/*****************************************  MSGPACK TO JSON  ************************************/
+
+/*
+ * Transcode the next item of an unpack context, with everything in it, as JSON text into a
+ * pack context that is used as a byte buffer, e.g. a stream, file or dynamic memory pack
+ * context. Nothing is built in between: strings are copied in runs between the characters
+ * that must be escaped and the only memory used is a stack of the open containers.
+ *
+ * Bin is written as a base64 string, timestamps as RFC 3339 strings and other ext items as
+ * {"type":n,"data":"<base64>"}. Nil, boolean and number map keys are quoted; container and
+ * ext keys give CWP_RC_TYPE_ERROR. Returns the return code of the unpack context if it
+ * failed, else that of the JSON context.
+ */
+template <class Source, class Sink>
+int cw_unpack_to_json (cwpack::basic_unpack_context<Source>* unpack_context, cwpack::basic_context<Sink>* json_context);
+
+/* Transcode all items up to the end of input, one JSON text per line (JSON Lines).
+   Returns CWP_RC_OK if the input ended between items. */
+template <class Source, class Sink>
+int cw_unpack_to_json_lines (cwpack::basic_unpack_context<Source>* unpack_context, cwpack::basic_context<Sink>* json_context);
+
+
+
+/*****************************************  JSON TO MSGPACK  ************************************/
+
+/*
+ * Pack the JSON texts of a buffer, each as one item. Texts may follow each other, separated
+ * by whitespace or not, as in JSON Lines. The text is first indexed a window at a time: the
+ * structural characters, string quotes and starts of numbers and literals are found 64 bytes
+ * at a time with AVX2 or SSE2. The parser then goes from token to token and packs as it goes.
+ *
+ * Containers are begun with a deferred size and patched with their smallest header when they
+ * end, so nothing is built in between. A container must therefore stay in the buffer of the
+ * pack context until it ends: use a static or dynamic memory pack context, or the file pack
+ * context overload, which keeps open containers behind its barrier.
+ *
+ * Strings without escapes are packed straight from the text. Integers that fit 64 bits are
+ * packed as integers, other numbers as doubles. Returns CWP_RC_MALFORMED_INPUT for text that
+ * isn't JSON, else the return code of the pack context. position, if given, is set to where
+ * parsing stopped, the length of the text on success.
+ */
+template <class Sink>
+int cw_json_to_msgpack (const void* text, unsigned long length, cwpack::basic_context<Sink>* pack_context, unsigned long* position = NULL);
+
+int cw_json_to_msgpack (const void* text, unsigned long length, file_pack_context* file_pack_context, unsigned long* position = NULL);
+
+
+
+/*****************************************  IMPLEMENTATION  *************************************/
+
+namespace cwpack {
+namespace json {
+
+/* Make room for at least more bytes, or set the return code */
+template <class Sink>
+inline bool reserve (basic_context<Sink>* pc, unsigned long more)
+{
+    if ((unsigned long)(pc->end - pc->current) >= more)
+        return true;
+    if (pc->return_code)
+        return false;
+    int rc = pc->overflow (pc, more);
+    if (rc)
+    {
+        pc->return_code = rc;
+        return false;
+    }
+    return true;
+}
+
+template <class Sink>
+inline void put_char (basic_context<Sink>* pc, char c)
+{
+    if (reserve (pc, 1))
+        *pc->current++ = (uint8_t)c;
+}
+
+/* Long texts go in pieces, so a stream or file context can keep its buffer */
+template <class Sink>
+inline void put_text (basic_context<Sink>* pc, const void* text, unsigned long length)
+{
+    const uint8_t* p = (const uint8_t*)text;
+    while (length)
+    {
+        unsigned long room = (unsigned long)(pc->end - pc->current);
+        if (!room)
+        {
+            if (!reserve (pc, length < 4096 ? length : 4096))
+                return;
+            room = (unsigned long)(pc->end - pc->current);
+        }
+        unsigned long n = length < room ? length : room;
+        memcpy (pc->current, p, n);
+        pc->current += n;
+        p += n;
+        length -= n;
+    }
+}
+
+template <class Sink>
+void put_string (basic_context<Sink>* pc, const uint8_t* p, unsigned long length)
+{
+    static const char hex[] = "0123456789abcdef";
+    put_char (pc, '"');
+    while (length)
+    {
+        unsigned long run = cw_json_plain_run (p, length);
+        put_text (pc, p, run);
+        if (run == length)
+            break;
+        p += run;
+        length -= run + 1;
+        char escape[6] = {'\\', 0, 0, 0, 0, 0};
+        unsigned long escape_length = 2;
+        switch (uint8_t c = *p++)
+        {
+            case '"':   escape[1] = '"';    break;
+            case '\\':  escape[1] = '\\';   break;
+            case '\b':  escape[1] = 'b';    break;
+            case '\f':  escape[1] = 'f';    break;
+            case '\n':  escape[1] = 'n';    break;
+            case '\r':  escape[1] = 'r';    break;
+            case '\t':  escape[1] = 't';    break;
+            default:
+                memcpy (escape + 1, "u00", 3);
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 0xf];
+                escape_length = 6;
+        }
+        put_text (pc, escape, escape_length);
+    }
+    put_char (pc, '"');
+}
+
+template <class Sink>
+void put_base64 (basic_context<Sink>* pc, const uint8_t* p, unsigned long length)
+{
+    char text[4096];
+    put_char (pc, '"');
+    while (length)
+    {
+        unsigned long n = length < 3072 ? length : 3072;
+        cw_base64_encode (p, n, text);
+        put_text (pc, text, 4 * ((n + 2) / 3));
+        p += n;
+        length -= n;
+    }
+    put_char (pc, '"');
+}
+
+struct open_container {
+    uint32_t    remaining;      /* items, keys and values counted separately in a map */
+    bool        map;
+    bool        first;
+};
+
+
+/* The stack is cleared first, so cw_unpack_to_json_lines can keep it between items */
+template <class Source, class Sink>
+int transcode (basic_unpack_context<Source>* unpack_context, basic_context<Sink>* json_context, std::vector<open_container>& stack)
+{
+    stack.clear();
+    char text[CW_JSON_NUMBER_MAX];
+    do
+    {
+        bool key = false;
+        if (!stack.empty())
+        {
+            open_container& container = stack.back();
+            if (container.map && container.remaining % 2)
+                put_char (json_context, ':');
+            else
+            {
+                key = container.map;
+                if (!container.first)
+                    put_char (json_context, ',');
+            }
+            container.first = false;
+            container.remaining--;
+        }
+
+        cw_unpack_next (unpack_context);
+        if (unpack_context->return_code)
+        {
+            if (unpack_context->return_code == CWP_RC_END_OF_INPUT && !stack.empty())
+                return CWP_RC_BUFFER_UNDERFLOW;
+            return unpack_context->return_code;
+        }
+        const cwpack::item_as& item = unpack_context->item;
+
+        bool quote = false;
+        if (key)
+        {
+            switch (item.type)
+            {
+                case item_type::STR: case item_type::BIN: case item_type::TIMESTAMP:
+                    break;
+                case item_type::NIL: case item_type::BOOLEAN: case item_type::POSITIVE_INTEGER:
+                case item_type::NEGATIVE_INTEGER: case item_type::FLOAT: case item_type::DOUBLE:
+                    quote = true;
+                    put_char (json_context, '"');
+                    break;
+                default:
+                    return CWP_RC_TYPE_ERROR;
+            }
+        }
+
+        switch (item.type)
+        {
+            case item_type::NIL:
+                put_text (json_context, "null", 4);
+                break;
+
+            case item_type::BOOLEAN:
+                if (item.as.boolean)
+                    put_text (json_context, "true", 4);
+                else
+                    put_text (json_context, "false", 5);
+                break;
+
+            case item_type::POSITIVE_INTEGER:
+                put_text (json_context, text, (unsigned long)(std::to_chars (text, text + sizeof(text), item.as.u64).ptr - text));
+                break;
+
+            case item_type::NEGATIVE_INTEGER:
+                put_text (json_context, text, (unsigned long)(std::to_chars (text, text + sizeof(text), item.as.i64).ptr - text));
+                break;
+
+            case item_type::FLOAT:
+                put_text (json_context, text, (unsigned long)cw_json_format_float (item.as.real, text));
+                break;
+
+            case item_type::DOUBLE:
+                put_text (json_context, text, (unsigned long)cw_json_format_double (item.as.long_real, text));
+                break;
+
+            case item_type::STR:
+                put_string (json_context, (const uint8_t*)item.as.str.start, item.as.str.length);
+                break;
+
+            case item_type::BIN:
+                put_base64 (json_context, (const uint8_t*)item.as.bin.start, item.as.bin.length);
+                break;
+
+            case item_type::TIMESTAMP:
+                put_char (json_context, '"');
+                put_text (json_context, text, (unsigned long)cw_json_format_timestamp (item.as.time.tv_sec, item.as.time.tv_nsec, text));
+                put_char (json_context, '"');
+                break;
+
+            case item_type::ARRAY:
+            case item_type::MAP:
+            {
+                bool map = item.type == item_type::MAP;
+                uint32_t size = map ? item.as.map.size : item.as.array.size;
+                put_char (json_context, map ? '{' : '[');
+                if (size)
+                    stack.push_back ({map ? 2 * size : size, map, true});
+                else
+                    put_char (json_context, map ? '}' : ']');
+                break;
+            }
+
+            default:
+                put_text (json_context, "{\"type\":", 8);
+                put_text (json_context, text, (unsigned long)(std::to_chars (text, text + sizeof(text), (int)item.type).ptr - text));
+                put_text (json_context, ",\"data\":", 8);
+                put_base64 (json_context, (const uint8_t*)item.as.ext.start, item.as.ext.length);
+                put_char (json_context, '}');
+                break;
+        }
+        if (quote)
+            put_char (json_context, '"');
+
+        while (!stack.empty() && !stack.back().remaining)
+        {
+            put_char (json_context, stack.back().map ? '}' : ']');
+            stack.pop_back();
+        }
+        if (json_context->return_code)
+            return json_context->return_code;
+    } while (!stack.empty());
+    return CWP_RC_OK;
+}
+
+}
+}
+
+
+template <class Source, class Sink>
+int cw_unpack_to_json (cwpack::basic_unpack_context<Source>* unpack_context, cwpack::basic_context<Sink>* json_context)
+{
+    std::vector<cwpack::json::open_container> stack;
+    return cwpack::json::transcode (unpack_context, json_context, stack);
+}
+
+
+template <class Source, class Sink>
+int cw_unpack_to_json_lines (cwpack::basic_unpack_context<Source>* unpack_context, cwpack::basic_context<Sink>* json_context)
+{
+    std::vector<cwpack::json::open_container> stack;
+    for (;;)
+    {
+        int rc = cwpack::json::transcode (unpack_context, json_context, stack);
+        if (rc)
+            return rc == CWP_RC_END_OF_INPUT ? CWP_RC_OK : rc;
+        cwpack::json::put_char (json_context, '\n');
+    }
+}
+
+
+namespace cwpack {
+namespace json {
+
+/* Offsets of the tokens of a JSON text in text order, found a window at a time */
+class structural_index {
+public:
+    structural_index (const uint8_t* text, unsigned long length)
+        : text{text}, length{length}
+    {}
+
+    /* Offset of the next token, length at the end of the text */
+    unsigned long next ()
+    {
+        if (cursor == tokens.size() && !refill())
+            return length;
+        return tokens[cursor++];
+    }
+
+private:
+    bool refill ();
+
+    const uint8_t*              text;
+    unsigned long               length;
+    unsigned long               scanned = 0;
+    uint64_t                    escaped = 0;        /* the first byte of the next block is escaped */
+    uint64_t                    in_string = 0;      /* all ones if the next block starts in a string */
+    uint64_t                    in_scalar = 0;      /* the last byte of the previous block is part of a number or literal */
+    std::vector<unsigned long>  tokens;
+    size_t                      cursor = 0;
+};
+
+extern const std::array<bool, 256> json_delimiters;
+
+/* Parse the string starting after the quote at p. Returns the byte after the closing
+   quote, NULL if malformed. Escaped strings are unescaped into scratch. */
+const uint8_t* parse_string (const uint8_t* p, const uint8_t* end, std::vector<uint8_t>& scratch, const uint8_t** start, unsigned long* length);
+
+/* Parse a number. Returns the byte after it, NULL if malformed. */
+const uint8_t* parse_number (const uint8_t* p, const uint8_t* end, bool* integral, bool* negative, uint64_t* magnitude, double* real);
+
+template <class Sink>
+struct context_packer {
+    basic_context<Sink>* pc;
+
+    basic_context<Sink>* context () { return pc; }
+    container_slot begin (bool map) { return map ? cw_pack_map_begin (pc) : cw_pack_array_begin (pc); }
+    void end (container_slot slot, uint32_t n) { cw_pack_container_end (pc, slot, n, true); }
+};
+
+struct file_packer {
+    file_pack_context* fpc;
+
+    cw_pack_context* context () { return &fpc->pc; }
+    container_slot begin (bool map) { return map ? file_pack_context_map_begin (fpc) : file_pack_context_array_begin (fpc); }
+    void end (container_slot slot, uint32_t n)
+    {
+        if (slot.lead == 0xdf)
+            file_pack_context_map_end (fpc, slot, n, true);
+        else
+            file_pack_context_array_end (fpc, slot, n, true);
+    }
+};
+
+struct open_json_container {
+    container_slot  slot;
+    uint32_t        count;          /* elements of an array, pairs of a map */
+    bool            map;
+};
+
+template <class Packer>
+int parse (const uint8_t* text, unsigned long length, Packer packer, unsigned long* position)
+{
+    enum { VALUE, FIRST_VALUE, KEY, FIRST_KEY, COLON, COMMA } expect = VALUE;
+    auto* pc = packer.context();
+    const uint8_t* end = text + length;
+    structural_index index (text, length);
+    std::vector<open_json_container> stack;
+    std::vector<uint8_t> scratch;
+    int rc = CWP_RC_OK;
+    unsigned long offset;
+
+    while ((offset = index.next()) < length)
+    {
+        const uint8_t* p = text + offset;
+        bool closing = false;
+        switch (expect)
+        {
+            case COLON:
+                if (*p != ':')
+                    goto malformed;
+                expect = VALUE;
+                continue;
+
+            case COMMA:
+                if (*p == ',')
+                {
+                    expect = stack.back().map ? KEY : VALUE;
+                    continue;
+                }
+                if (*p != (stack.back().map ? '}' : ']'))
+                    goto malformed;
+                closing = true;
+                break;
+
+            case FIRST_KEY:
+                if (*p == '}')
+                {
+                    closing = true;
+                    break;
+                }
+                [[fallthrough]];
+            case KEY:
+            {
+                const uint8_t* start;
+                unsigned long string_length;
+                if (*p != '"' || !parse_string (p + 1, end, scratch, &start, &string_length))
+                    goto malformed;
+                cw_pack_str (pc, (const char*)start, (uint32_t)string_length);
+                stack.back().count++;
+                expect = COLON;
+                continue;
+            }
+
+            case FIRST_VALUE:
+                if (*p == ']')
+                {
+                    closing = true;
+                    break;
+                }
+                [[fallthrough]];
+            case VALUE:
+                if (!stack.empty() && !stack.back().map)
+                    stack.back().count++;
+                switch (*p)
+                {
+                    case '{':
+                    case '[':
+                    {
+                        bool map = *p == '{';
+                        stack.push_back ({packer.begin (map), 0, map});
+                        expect = map ? FIRST_KEY : FIRST_VALUE;
+                        continue;
+                    }
+                    case '"':
+                    {
+                        const uint8_t* start;
+                        unsigned long string_length;
+                        if (!parse_string (p + 1, end, scratch, &start, &string_length))
+                            goto malformed;
+                        cw_pack_str (pc, (const char*)start, (uint32_t)string_length);
+                        break;
+                    }
+                    case 't':
+                    case 'f':
+                    case 'n':
+                    {
+                        const char* literal = *p == 't' ? "true" : *p == 'f' ? "false" : "null";
+                        unsigned long literal_length = strlen (literal);
+                        if ((unsigned long)(end - p) < literal_length || memcmp (p, literal, literal_length) ||
+                            (p + literal_length < end && !json_delimiters[p[literal_length]]))
+                            goto malformed;
+                        if (*p == 'n')
+                            cw_pack_nil (pc);
+                        else
+                            cw_pack_boolean (pc, *p == 't');
+                        break;
+                    }
+                    default:
+                    {
+                        bool integral, negative;
+                        uint64_t magnitude;
+                        double real;
+                        if (!parse_number (p, end, &integral, &negative, &magnitude, &real))
+                            goto malformed;
+                        if (!integral)
+                            cw_pack_double (pc, real);
+                        else if (!negative)
+                            cw_pack_unsigned (pc, magnitude);
+                        else
+                            cw_pack_signed (pc, (int64_t)(0 - magnitude));
+                    }
+                }
+                break;
+        }
+
+        if (closing)
+        {
+            packer.end (stack.back().slot, stack.back().count);
+            stack.pop_back();
+        }
+        expect = stack.empty() ? VALUE : COMMA;
+        if (pc->return_code)
+        {
+            rc = pc->return_code;
+            break;
+        }
+    }
+
+    if (rc == CWP_RC_OK && (!stack.empty() || expect != VALUE))
+    {
+        offset = length;
+        goto malformed;
+    }
+    if (position)
+        *position = rc ? offset : length;
+    return rc;
+
+malformed:
+    if (position)
+        *position = offset;
+    return CWP_RC_MALFORMED_INPUT;
+}
+
+}
+}
+
+
+template <class Sink>
+int cw_json_to_msgpack (const void* text, unsigned long length, cwpack::basic_context<Sink>* pack_context, unsigned long* position)
+{
+    return cwpack::json::parse ((const uint8_t*)text, length, cwpack::json::context_packer<Sink>{pack_context}, position);
+}
+
+#endif /* cwpack_json_h */
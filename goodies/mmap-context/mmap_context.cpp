@@ -0,0 +1,220 @@
+/*      CWPack/goodies - mmap_context.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mmap_context.h"
+
+
+
+/*****************************************  MMAP UNPACK CONTEXT  ********************************/
+
+
+void init_mmap_unpack_context (mmap_unpack_context* muc, const char* path, int hints)
+{
+    muc->mapping = NULL;
+    muc->mapping_length = 0;
+    cw_unpack_context_init (&muc->uc, NULL, 0);
+    if (muc->uc.return_code)
+        return;
+
+    int fileDescriptor = open (path, O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fileDescriptor < 0 || fstat (fileDescriptor, &status) < 0)
+    {
+        muc->uc.err_no = errno;
+        muc->uc.return_code = CWP_RC_ERROR_IN_HANDLER;
+        if (fileDescriptor >= 0)
+            close (fileDescriptor);
+        return;
+    }
+
+    /* an empty file can't be mapped, it is just an empty context */
+    if (status.st_size > 0)
+    {
+        int flags = MAP_PRIVATE;
+        if (hints & CW_MMAP_POPULATE)
+            flags |= MAP_POPULATE;
+        void* mapping = mmap (NULL, (size_t)status.st_size, PROT_READ, flags, fileDescriptor, 0);
+        if (mapping == MAP_FAILED)
+        {
+            muc->uc.err_no = errno;
+            muc->uc.return_code = CWP_RC_ERROR_IN_HANDLER;
+            close (fileDescriptor);
+            return;
+        }
+        muc->mapping = mapping;
+        muc->mapping_length = (unsigned long)status.st_size;
+
+        /* hints only, the context works without them */
+        if (hints & CW_MMAP_SEQUENTIAL)
+            madvise (mapping, muc->mapping_length, MADV_SEQUENTIAL);
+        if (hints & CW_MMAP_WILLNEED)
+            madvise (mapping, muc->mapping_length, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+        if (hints & CW_MMAP_HUGE_PAGES)
+            madvise (mapping, muc->mapping_length, MADV_HUGEPAGE);
+#endif
+    }
+    close (fileDescriptor);
+
+    cw_unpack_context_init (&muc->uc, muc->mapping, muc->mapping_length);
+}
+
+
+void terminate_mmap_unpack_context (mmap_unpack_context* muc)
+{
+    if (muc->mapping)
+        munmap (muc->mapping, muc->mapping_length);
+    muc->mapping = NULL;
+    muc->mapping_length = 0;
+    muc->uc.start = muc->uc.current = muc->uc.end = NULL;
+}
+
+
+
+/*****************************************  MMAP PACK CONTEXT  **********************************/
+
+
+/* Set the file length and reserve its blocks, so a full disk is an error here rather than a SIGBUS later */
+static int set_file_length (int fileDescriptor, unsigned long old_length, unsigned long new_length)
+{
+    if (ftruncate (fileDescriptor, (off_t)new_length) < 0)
+        return errno;
+#ifdef __linux__
+    if (new_length > old_length && fallocate (fileDescriptor, 0, (off_t)old_length, (off_t)(new_length - old_length)) < 0 && errno != EOPNOTSUPP)
+        return errno;
+#else
+    (void)old_length;
+#endif
+    return 0;
+}
+
+
+static int handle_mmap_pack_overflow (cw_pack_context* pc, unsigned long more)
+{
+    mmap_pack_context* mpc = (mmap_pack_context*)pc;
+    unsigned long used = (unsigned long)(pc->current - pc->start);
+    unsigned long old_length = (unsigned long)(pc->end - pc->start);
+    unsigned long new_length = old_length + mpc->extent;
+    if (new_length < used + more)
+        new_length = (used + more + mpc->extent - 1) / mpc->extent * mpc->extent;
+
+    int error = set_file_length (mpc->fileDescriptor, old_length, new_length);
+    if (error)
+    {
+        pc->err_no = error;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+
+    /* On failure the old mapping is still valid and keeps what is packed */
+#ifdef __linux__
+    void* mapping = mremap (pc->start, old_length, new_length, MREMAP_MAYMOVE);
+#else
+    void* mapping = mmap (NULL, new_length, PROT_READ | PROT_WRITE, MAP_SHARED, mpc->fileDescriptor, 0);
+#endif
+    if (mapping == MAP_FAILED)
+    {
+        pc->err_no = errno;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+#ifndef __linux__
+    munmap (pc->start, old_length);
+#endif
+
+    pc->start = (uint8_t*)mapping;
+    pc->current = pc->start + used;
+    pc->end = pc->start + new_length;
+    return CWP_RC_OK;
+}
+
+
+/* The packed bytes are in the page cache already */
+static int flush_mmap_pack_context (cw_pack_context*)
+{
+    return CWP_RC_OK;
+}
+
+
+void init_mmap_pack_context (mmap_pack_context* mpc, const char* path, unsigned long extent)
+{
+    long page_size = sysconf (_SC_PAGESIZE);
+    extent = extent > 0 ? extent : 64ul << 20;
+    extent = (extent + (unsigned long)page_size - 1) / (unsigned long)page_size * (unsigned long)page_size;
+    mpc->extent = extent;
+
+    cw_pack_context_init ((cw_pack_context*)mpc, NULL, 0, &handle_mmap_pack_overflow);
+    cw_pack_set_flush_handler ((cw_pack_context*)mpc, &flush_mmap_pack_context);
+
+    mpc->fileDescriptor = open (path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int error = mpc->fileDescriptor < 0 ? errno : set_file_length (mpc->fileDescriptor, 0, extent);
+    void* mapping = MAP_FAILED;
+    if (!error)
+    {
+        mapping = mmap (NULL, extent, PROT_READ | PROT_WRITE, MAP_SHARED, mpc->fileDescriptor, 0);
+        if (mapping == MAP_FAILED)
+            error = errno;
+    }
+    if (error)
+    {
+        if (mpc->fileDescriptor >= 0)
+            close (mpc->fileDescriptor);
+        mpc->fileDescriptor = -1;
+        mpc->pc.err_no = error;
+        mpc->pc.return_code = CWP_RC_ERROR_IN_HANDLER;
+        return;
+    }
+
+    mpc->pc.start = mpc->pc.current = (uint8_t*)mapping;
+    mpc->pc.end = mpc->pc.start + extent;
+}
+
+
+unsigned long mmap_pack_context_length (mmap_pack_context* mpc)
+{
+    return (unsigned long)(mpc->pc.current - mpc->pc.start);
+}
+
+
+void terminate_mmap_pack_context (mmap_pack_context* mpc)
+{
+    cw_pack_context* pc = (cw_pack_context*)mpc;
+    if (mpc->fileDescriptor < 0)
+        return;
+
+    unsigned long used = (unsigned long)(pc->current - pc->start);
+    if (pc->start)
+        munmap (pc->start, (size_t)(pc->end - pc->start));
+    if (ftruncate (mpc->fileDescriptor, (off_t)used) < 0 && pc->return_code == CWP_RC_OK)
+    {
+        pc->err_no = errno;
+        pc->return_code = CWP_RC_ERROR_IN_HANDLER;
+    }
+    close (mpc->fileDescriptor);
+    mpc->fileDescriptor = -1;
+    pc->start = pc->current = pc->end = NULL;
+}
@@ -0,0 +1,80 @@
+/*      CWPack/goodies - mmap_context.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef mmap_context_h
+#define mmap_context_h
+
+#include "cwpack.hpp"
+
+
+/*****************************************  MMAP UNPACK CONTEXT  ********************************/
+
+/*
+ * An unpack context over a memory mapped file. The whole file is mapped and the context is a
+ * static unpack context over the mapping, so the decoder never underflows and str, bin and
+ * ext items point straight into the page cache. The mapping is valid until terminate.
+ */
+
+#define CW_MMAP_SEQUENTIAL      1   /* madvise sequential access, more aggressive read-ahead */
+#define CW_MMAP_WILLNEED        2   /* madvise to start reading the whole file in now */
+#define CW_MMAP_HUGE_PAGES      4   /* madvise transparent huge pages, if the file system has them */
+#define CW_MMAP_POPULATE        8   /* fault in all pages at init */
+
+typedef struct
+{
+    cw_static_unpack_context    uc;
+    void                        *mapping;
+    unsigned long               mapping_length;
+} mmap_unpack_context;
+
+
+/* On failure return_code is CWP_RC_ERROR_IN_HANDLER with errno in err_no */
+void init_mmap_unpack_context (mmap_unpack_context* muc, const char* path, int hints);
+
+void terminate_mmap_unpack_context (mmap_unpack_context* muc);
+
+
+/*****************************************  MMAP PACK CONTEXT  **********************************/
+
+/*
+ * A pack context that packs straight into a shared mapping of the file. When the mapping is
+ * full the file is extended and remapped, so packing is plain stores into the page cache with
+ * no intermediate buffer and no write calls. Terminate trims the file to the packed length.
+ */
+
+typedef struct
+{
+    cw_pack_context             pc;
+    int                         fileDescriptor;
+    unsigned long               extent;     /* the file grows in steps of at least this */
+} mmap_pack_context;
+
+
+/* The file is created or truncated. On failure return_code is CWP_RC_ERROR_IN_HANDLER with errno in err_no */
+void init_mmap_pack_context (mmap_pack_context* mpc, const char* path, unsigned long extent);
+
+/* Number of bytes packed so far */
+unsigned long mmap_pack_context_length (mmap_pack_context* mpc);
+
+void terminate_mmap_pack_context (mmap_pack_context* mpc);
+
+#endif /* mmap_context_h */
@@ -0,0 +1,78 @@
+/*      CWPack/goodies - cwpack_parallel.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "cwpack_parallel.h"
+#include "frame_stream.h"
+
+
+
+/*****************************************  RECORD SPLITTER  ************************************/
+
+namespace cwpack {
+
+record_splitter::record_splitter (const void* data, unsigned long length, record_format format)
+    : current ((const uint8_t*)data), end ((const uint8_t*)data + length), framed (format == record_format::framed)
+{
+    if (format == record_format::automatic)
+        framed = length >= 17 && !memcmp (end - 8, CW_FRAME_INDEX_MAGIC, 8);
+}
+
+
+int record_splitter::next (record_span* record)
+{
+    if (current == end)
+        return CWP_RC_END_OF_INPUT;
+
+    if (framed)
+    {
+        uint64_t length;
+        int varint_length = cw_frame_decode_length (current, end, &length);
+        if (varint_length <= 0)
+            return varint_length ? CWP_RC_MALFORMED_INPUT : CWP_RC_BUFFER_UNDERFLOW;
+        if (!length)
+        {
+            current = end;              /* the frame index follows */
+            return CWP_RC_END_OF_INPUT;
+        }
+        if (length > (uint64_t)(end - current - varint_length))
+            return CWP_RC_BUFFER_UNDERFLOW;
+        record->start = current + varint_length;
+        record->length = (unsigned long)length;
+        current = record->start + length;
+        return CWP_RC_OK;
+    }
+
+    cw_static_unpack_context uc;
+    cw_unpack_context_init (&uc, current, (unsigned long)(end - current));
+    cw_skip_items (&uc, 1);
+    if (uc.return_code)
+        return uc.return_code;
+    record->start = current;
+    record->length = (unsigned long)(uc.current - current);
+    current = uc.current;
+    return CWP_RC_OK;
+}
+
+}
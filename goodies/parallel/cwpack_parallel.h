@@ -0,0 +1,366 @@
+/*      CWPack/goodies - cwpack_parallel.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef cwpack_parallel_h
+#define cwpack_parallel_h
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cwpack.hpp"
+#include "basic_contexts.h"
+#include "mmap_context.h"
+
+
+/*****************************************  RECORD SPLITTER  ************************************/
+
+namespace cwpack {
+
+enum class record_format {
+    automatic,          /* framed if the buffer ends with a frame index, otherwise concatenated */
+    concatenated,       /* top level items back to back */
+    framed              /* frame stream records, see goodies/frame-stream */
+};
+
+struct record_span {
+    const uint8_t*      start;
+    unsigned long       length;
+};
+
+/* Finds the records of a buffer one by one. Concatenated items are delimited with
+   cw_skip_items, framed records by their lengths without looking at the contents. */
+class record_splitter {
+public:
+    record_splitter (const void* data, unsigned long length, record_format format);
+
+    /* CWP_RC_OK, CWP_RC_END_OF_INPUT after the last record, or the error at the next record */
+    int next (record_span* record);
+
+private:
+    const uint8_t*      current;
+    const uint8_t*      end;
+    bool                framed;
+};
+
+
+
+/*****************************************  PARALLEL FOR EACH RECORD  ***************************/
+
+struct parallel_options {
+    unsigned int        threads = 0;            /* workers, 0 for one per hardware thread */
+    unsigned long       batch_records = 256;    /* records handed to a worker at a time */
+    bool                ordered = true;         /* deliver in record order */
+    record_format       format = record_format::automatic;
+};
+
+/*
+ * Decode the records of a buffer in parallel. The calling thread splits the buffer into
+ * batches of records, that worker threads decode with decode(cw_static_unpack_context*, index),
+ * each record in its own static unpack context. The results are handed back on the calling
+ * thread to deliver(index, result), in record order or as batches complete.
+ * Returns CWP_RC_OK, or the error found when splitting; records before it are all delivered.
+ */
+template <class Decode, class Deliver>
+requires std::is_invocable_v<Deliver&, unsigned long, std::invoke_result_t<Decode&, cw_static_unpack_context*, unsigned long>>
+int parallel_for_each_record (const void* data, unsigned long length, Decode decode, Deliver deliver, parallel_options options = {})
+{
+    using result_type = std::invoke_result_t<Decode&, cw_static_unpack_context*, unsigned long>;
+    struct batch {
+        unsigned long               first;
+        std::vector<record_span>    records;
+    };
+
+    unsigned int threads = options.threads ? options.threads : std::max (1u, std::thread::hardware_concurrency());
+    unsigned long batch_records = options.batch_records ? options.batch_records : 1;
+    unsigned long max_in_flight = 2 * threads;
+
+    std::mutex mutex;
+    std::condition_variable work_ready, batch_done;
+    std::deque<batch> work;
+    std::map<unsigned long, std::vector<result_type>> done;         /* by first record */
+    bool splitting = true;
+
+    auto worker = [&]
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        for (;;)
+        {
+            work_ready.wait (lock, [&]{ return !work.empty() || !splitting; });
+            if (work.empty())
+                return;
+            batch b = std::move (work.front());
+            work.pop_front();
+            lock.unlock();
+
+            std::vector<result_type> results;
+            results.reserve (b.records.size());
+            for (unsigned long i = 0; i < b.records.size(); i++)
+            {
+                cw_static_unpack_context uc;
+                cw_unpack_context_init (&uc, b.records[i].start, b.records[i].length);
+                results.push_back (decode (&uc, b.first + i));
+            }
+
+            lock.lock();
+            done.emplace (b.first, std::move (results));
+            batch_done.notify_one();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; i++)
+        workers.emplace_back (worker);
+
+    unsigned long issued = 0, delivered = 0;            /* records */
+    unsigned long batches_issued = 0, batches_delivered = 0;
+
+    /* Deliver what is ready, waiting for a batch if wait is set and nothing is */
+    auto deliver_ready = [&] (std::unique_lock<std::mutex>& lock, bool wait)
+    {
+        for (;;)
+        {
+            auto ready = done.begin();
+            if (ready != done.end() && (!options.ordered || ready->first == delivered))
+            {
+                unsigned long first = ready->first;
+                std::vector<result_type> results = std::move (ready->second);
+                done.erase (ready);
+                lock.unlock();
+                for (unsigned long i = 0; i < results.size(); i++)
+                    deliver (first + i, std::move (results[i]));
+                lock.lock();
+                delivered += results.size();
+                batches_delivered++;
+                wait = false;
+                continue;
+            }
+            if (!wait)
+                return;
+            batch_done.wait (lock);
+        }
+    };
+
+    record_splitter splitter (data, length, options.format);
+    int rc = CWP_RC_OK;
+    while (rc == CWP_RC_OK)
+    {
+        batch b = {issued, {}};
+        b.records.reserve (batch_records);
+        record_span record;
+        while (b.records.size() < batch_records && (rc = splitter.next (&record)) == CWP_RC_OK)
+            b.records.push_back (record);
+        if (b.records.empty())
+            break;
+
+        std::unique_lock<std::mutex> lock (mutex);
+        deliver_ready (lock, false);
+        while (batches_issued - batches_delivered >= max_in_flight)
+            deliver_ready (lock, true);
+        issued += b.records.size();
+        batches_issued++;
+        work.push_back (std::move (b));
+        work_ready.notify_one();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        splitting = false;
+        work_ready.notify_all();
+        while (batches_delivered < batches_issued)
+            deliver_ready (lock, true);
+    }
+    for (std::thread& t : workers)
+        t.join();
+
+    return rc == CWP_RC_END_OF_INPUT ? CWP_RC_OK : rc;
+}
+
+
+/* Without results, fn(cw_static_unpack_context*, index) is called on the worker threads */
+template <class Fn>
+requires std::is_invocable_v<Fn&, cw_static_unpack_context*, unsigned long>
+int parallel_for_each_record (const void* data, unsigned long length, Fn fn, parallel_options options = {})
+{
+    options.ordered = false;
+    return parallel_for_each_record (data, length,
+                                     [&fn] (cw_static_unpack_context* uc, unsigned long index) { fn (uc, index); return true; },
+                                     [] (unsigned long, bool) {},
+                                     options);
+}
+
+
+/* The file is memory mapped and its records decoded as above */
+template <class Decode, class Deliver>
+int parallel_for_each_record_in_file (const char* path, Decode decode, Deliver deliver, parallel_options options = {})
+{
+    mmap_unpack_context muc;
+    init_mmap_unpack_context (&muc, path, CW_MMAP_SEQUENTIAL | CW_MMAP_WILLNEED);
+    if (muc.uc.return_code)
+        return muc.uc.return_code;
+
+    int rc = parallel_for_each_record (muc.mapping, muc.mapping_length, decode, deliver, options);
+    terminate_mmap_unpack_context (&muc);
+    return rc;
+}
+
+
+
+/*****************************************  PARALLEL PACK  **************************************/
+
+/*
+ * An array packed in slices. Each slice is a dynamic memory pack context holding the elements
+ * of a range of indexes, packed by one worker. The array is the header followed by the
+ * slices in order, and can be copied into a context or written without copying as iovecs.
+ */
+struct packed_array {
+    uint8_t                                     header[5];
+    unsigned int                                header_length = 0;
+    std::vector<dynamic_memory_pack_context>    slices;
+    int                                         return_code = CWP_RC_OK;
+
+    packed_array () = default;
+    packed_array (const packed_array&) = delete;
+    packed_array& operator= (const packed_array&) = delete;
+    packed_array (packed_array&&) = default;
+    ~packed_array ()
+    {
+        for (dynamic_memory_pack_context& slice : slices)
+            free_dynamic_memory_pack_context (&slice);
+    }
+
+    unsigned long length () const
+    {
+        unsigned long length = header_length;
+        for (const dynamic_memory_pack_context& slice : slices)
+            length += (unsigned long)(slice.pc.current - slice.pc.start);
+        return length;
+    }
+
+    /* Header and slices, valid as long as the packed array */
+    std::vector<struct iovec> iov () const
+    {
+        std::vector<struct iovec> iov;
+        iov.reserve (slices.size() + 1);
+        iov.push_back ({(void*)header, header_length});
+        for (const dynamic_memory_pack_context& slice : slices)
+            if (slice.pc.current > slice.pc.start)
+                iov.push_back ({slice.pc.start, (size_t)(slice.pc.current - slice.pc.start)});
+        return iov;
+    }
+
+    /* Copy the array into a context, in pieces so a stream or file context needn't grow */
+    template <class Sink>
+    int insert_into (basic_context<Sink>* pc) const
+    {
+        if (return_code)
+            return return_code;
+
+        cw_pack_insert (pc, header, header_length);
+        for (const dynamic_memory_pack_context& slice : slices)
+        {
+            for (const uint8_t* p = slice.pc.start; p < slice.pc.current && !pc->return_code; )
+            {
+                uint32_t piece = (uint32_t)std::min<unsigned long> ((unsigned long)(slice.pc.current - p), 1ul << 20);
+                cw_pack_insert (pc, p, piece);
+                p += piece;
+            }
+        }
+        return pc->return_code;
+    }
+};
+
+
+/*
+ * Pack an array of count elements in parallel. pack(cw_pack_context*, index) packs element
+ * index, and is called on the worker threads with the context of the slice holding index.
+ * The index range is cut into a few slices per worker, that the workers take in turn, so a
+ * slow slice doesn't hold up the others.
+ */
+template <class Pack>
+requires std::is_invocable_v<Pack&, cw_pack_context*, unsigned long>
+packed_array parallel_pack_array (unsigned long count, Pack pack, parallel_options options = {})
+{
+    packed_array array;
+    if (count > 0xffffffffUL)
+    {
+        array.return_code = CWP_RC_VALUE_ERROR;
+        return array;
+    }
+    cw_static_pack_context header;
+    cw_pack_context_init (&header, array.header, sizeof(array.header));
+    cw_pack_array_size (&header, (uint32_t)count);
+    array.header_length = (unsigned int)(header.current - header.start);
+
+    unsigned int threads = options.threads ? options.threads : std::max (1u, std::thread::hardware_concurrency());
+    unsigned long slice_count = std::max (1ul, std::min (count, 4ul * threads));
+    unsigned long slice_elements = (count + slice_count - 1) / slice_count;
+    slice_count = count ? (count + slice_elements - 1) / slice_elements : 0;
+    array.slices.resize (slice_count);
+
+    std::atomic<unsigned long> next_slice {0};
+    auto worker = [&]
+    {
+        for (unsigned long s; (s = next_slice++) < slice_count; )
+        {
+            dynamic_memory_pack_context* slice = &array.slices[s];
+            init_dynamic_memory_pack_context (slice, 4096);
+            unsigned long end = std::min (count, (s + 1) * slice_elements);
+            for (unsigned long i = s * slice_elements; i < end && !slice->pc.return_code; i++)
+                pack (&slice->pc, i);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads && i < slice_count; i++)
+        workers.emplace_back (worker);
+    worker();
+    for (std::thread& t : workers)
+        t.join();
+
+    for (dynamic_memory_pack_context& slice : array.slices)
+        if (slice.pc.return_code && !array.return_code)
+            array.return_code = slice.pc.return_code;
+    return array;
+}
+
+
+/* Pack the array in parallel and insert it into pc */
+template <class Sink, class Pack>
+requires std::is_invocable_v<Pack&, cw_pack_context*, unsigned long>
+int parallel_pack_array (basic_context<Sink>* pc, unsigned long count, Pack pack, parallel_options options = {})
+{
+    packed_array array = parallel_pack_array (count, pack, options);
+    if (array.return_code)
+        return pc->return_code = array.return_code;
+    return array.insert_into (pc);
+}
+
+}
+
+#endif /* cwpack_parallel_h */
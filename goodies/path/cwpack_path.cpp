@@ -0,0 +1,89 @@
+/*      CWPack/goodies - cwpack_path.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "cwpack_path.h"
+
+namespace cwpack {
+
+
+int path::compile (std::string_view expression)
+{
+    steps.clear();
+    return_code = CWP_RC_OK;
+    if (expression.empty())
+        return return_code;
+
+    if (expression[0] != '/')
+        return return_code = CWP_RC_MALFORMED_INPUT;
+
+    size_t pos = 1;
+    for (;;)
+    {
+        size_t stop = expression.find('/', pos);
+        std::string_view token = expression.substr(pos, stop == std::string_view::npos ? std::string_view::npos : stop - pos);
+
+        step s;
+        s.wildcard = token == "*";
+        s.index = token.empty() || token.size() > 18 ? -1 : 0;
+        for (size_t i = 0; i < token.size(); i++)
+        {
+            char c = token[i];
+            if (c == '~')
+            {
+                if (i + 1 == token.size() || (token[i + 1] != '0' && token[i + 1] != '1'))
+                    return return_code = CWP_RC_MALFORMED_INPUT;
+                c = token[++i] == '0' ? '~' : '/';
+            }
+            s.key.push_back(c);
+            if (s.index >= 0)
+                s.index = c >= '0' && c <= '9' ? 10 * s.index + (c - '0') : -1;
+        }
+        if (token.size() > 1 && token[0] == '0')
+            s.index = -1;                       /* no leading zeros in an index */
+        steps.push_back(std::move(s));
+
+        if (stop == std::string_view::npos)
+            return return_code;
+        pos = stop + 1;
+    }
+}
+
+
+std::vector<std::span<const uint8_t>> path::select (const void* data, unsigned long length) const
+{
+    std::vector<std::span<const uint8_t>> matches;
+    cw_static_unpack_context uc;
+    cw_unpack_context_init (&uc, data, length);
+    evaluate (&uc, [&](const path_match& match)
+    {
+        cw_static_unpack_context item;
+        cw_unpack_context_init (&item, match.start, (unsigned long)(uc.end - match.start));
+        cw_skip_items (&item, 1);
+        if (item.return_code == CWP_RC_OK)
+            matches.emplace_back(match.start, item.current);
+        return true;
+    });
+    return matches;
+}
+
+}
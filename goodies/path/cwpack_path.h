@@ -0,0 +1,211 @@
+/*      CWPack/goodies - cwpack_path.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef cwpack_path_h
+#define cwpack_path_h
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cwpack.hpp"
+
+
+/*****************************************  PATH QUERY  *****************************************/
+
+/*
+ * A path selects items in a packed document, e.g. "/orders/3/price". It uses JSON
+ * Pointer syntax: each step starts with '/', "~1" stands for '/' and "~0" for '~'. A step of
+ * digits is an array index, or a key when the container is a map, and a step "*" takes every
+ * element of an array or every value of a map. The empty path selects the whole document.
+ *
+ * A path is compiled once and evaluated against any unpack context. Keys are looked up with
+ * cw_unpack_find_key and everything off the path is skipped with cw_skip_items.
+ */
+
+namespace cwpack {
+
+/* A selected item. Str, bin and ext refer to the context buffer, start is the item's lead byte. */
+struct path_match {
+    item_as             item;
+    const uint8_t*      start;
+};
+
+class path {
+public:
+    path () : return_code(CWP_RC_OK) {}
+    explicit path (std::string_view expression) { compile(expression); }
+
+    /* CWP_RC_OK, or CWP_RC_MALFORMED_INPUT for a path that doesn't start with '/' or has a bad '~' escape */
+    int compile (std::string_view expression);
+    int status () const { return return_code; }
+
+    /*
+     * Evaluate the path over the next item in the context, which is consumed. visit is called
+     * with each match as a path_match and returns false to stop (return code CWP_RC_STOPPED).
+     * The contents of a matched container are skipped after visit, unless visit consumes them.
+     */
+    template <class Source, class Visitor>
+    int evaluate (basic_unpack_context<Source>* unpack_context, Visitor&& visit) const;
+
+    /* The packed bytes of every match in a document held in memory */
+    std::vector<std::span<const uint8_t>> select (const void* data, unsigned long length) const;
+
+private:
+    struct step {
+        bool            wildcard;
+        std::string     key;
+        long            index;          /* -1 if the step isn't a number */
+    };
+
+    template <class Source, class Visitor>
+    bool evaluate_step (unsigned long n, basic_unpack_context<Source>* unpack_context, Visitor& visit) const;
+
+    std::vector<step>   steps;
+    int                 return_code;
+};
+
+
+/* Have at least length bytes from current in the buffer */
+template <class Source>
+inline bool buffer_bytes (basic_unpack_context<Source>* unpack_context, unsigned long length)
+{
+    if ((unsigned long)(unpack_context->end - unpack_context->current) >= length)
+        return true;
+    int rc = unpack_context->underflow (unpack_context, length);
+    if (rc != CWP_RC_OK)
+        unpack_context->return_code = rc == CWP_RC_END_OF_INPUT ? CWP_RC_BUFFER_UNDERFLOW : rc;
+    return rc == CWP_RC_OK;
+}
+
+
+template <class Source, class Visitor>
+bool path::evaluate_step (unsigned long n, basic_unpack_context<Source>* unpack_context, Visitor& visit) const
+{
+    if (n == steps.size())
+    {
+        /*
+         * A refill drops the bytes already consumed, so the whole item is buffered before it
+         * is decoded and start is then found back from where the item ends.
+         */
+        cw_look_ahead (unpack_context);
+        if (unpack_context->return_code)
+            return false;
+        const lead_byte_descriptor& d = lead_byte_table[*unpack_context->current];
+        unsigned long length = d.header_length + d.payload_length;
+        if (!buffer_bytes(unpack_context, length))
+            return false;
+        if (d.length_width && d.type != item_type::ARRAY && d.type != item_type::MAP)
+        {
+            unsigned long payload = 0;
+            for (unsigned i = 1; i <= d.length_width; i++)
+                payload = payload << 8 | unpack_context->current[i];
+            length += payload;
+            if (!buffer_bytes(unpack_context, length))
+                return false;
+        }
+        cw_unpack_next (unpack_context);
+        if (unpack_context->return_code)
+            return false;
+
+        path_match match;
+        match.item = unpack_context->item;
+        match.start = unpack_context->current - length;
+        uint8_t* after_header = unpack_context->current;
+        if (!visit(match))
+        {
+            unpack_context->return_code = CWP_RC_STOPPED;
+            return false;
+        }
+        if (unpack_context->current == after_header)
+        {
+            if (match.item.type == item_type::ARRAY)
+                cw_skip_items (unpack_context, (long)match.item.as.array.size);
+            else if (match.item.type == item_type::MAP)
+                cw_skip_items (unpack_context, 2 * (long)match.item.as.map.size);
+        }
+        return unpack_context->return_code == CWP_RC_OK;
+    }
+
+    item_type type = cw_look_ahead (unpack_context);
+    if (type != item_type::ARRAY && type != item_type::MAP)
+    {
+        cw_skip_items (unpack_context, 1);
+        return unpack_context->return_code == CWP_RC_OK;
+    }
+
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return false;
+
+    long size = (long)unpack_context->item.as.array.size;
+    const step& s = steps[n];
+    if (s.wildcard)
+    {
+        for (long i = 0; i < size; i++)
+        {
+            if (type == item_type::MAP)
+                cw_skip_items (unpack_context, 1);
+            if (!evaluate_step(n + 1, unpack_context, visit))
+                return false;
+        }
+        return true;
+    }
+
+    if (type == item_type::MAP)
+    {
+        long found = cw_unpack_find_key (unpack_context, (uint32_t)size, s.key.data(), (uint32_t)s.key.size());
+        if (found < 0)
+            return unpack_context->return_code == CWP_RC_OK;
+        if (!evaluate_step(n + 1, unpack_context, visit))
+            return false;
+        cw_skip_items (unpack_context, 2 * (size - found - 1));
+        return unpack_context->return_code == CWP_RC_OK;
+    }
+
+    if (s.index < 0 || s.index >= size)
+    {
+        cw_skip_items (unpack_context, size);
+        return unpack_context->return_code == CWP_RC_OK;
+    }
+    cw_skip_items (unpack_context, s.index);
+    if (!evaluate_step(n + 1, unpack_context, visit))
+        return false;
+    cw_skip_items (unpack_context, size - s.index - 1);
+    return unpack_context->return_code == CWP_RC_OK;
+}
+
+
+template <class Source, class Visitor>
+int path::evaluate (basic_unpack_context<Source>* unpack_context, Visitor&& visit) const
+{
+    if (return_code)
+        return return_code;
+
+    evaluate_step(0, unpack_context, visit);
+    return unpack_context->return_code;
+}
+
+}
+
+#endif /* cwpack_path_h */
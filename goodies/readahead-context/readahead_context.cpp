@@ -0,0 +1,345 @@
+/*      CWPack/goodies - readahead_context.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "readahead_context.h"
+
+
+
+/*****************************************  READER THREAD  **************************************/
+
+/* Room in front of every block for the leftover of an item that straddles into it */
+#define READAHEAD_HEADROOM  256
+
+struct readahead_block
+{
+    uint8_t         *data;
+    unsigned long   length;
+};
+
+struct readahead_state
+{
+    int                             fileDescriptor;
+    unsigned long                   block_length;
+    std::vector<uint8_t*>           blocks;         /* all allocated, for terminate */
+    uint8_t                         *held;          /* block the decoder is in, NULL for a grown buffer */
+
+    std::mutex                      mutex;
+    std::condition_variable         filled;
+    std::condition_variable         emptied;
+    std::deque<readahead_block>     ready;
+    std::vector<uint8_t*>           free;
+    bool                            end_of_input = false;
+    int                             error = 0;
+    bool                            stop = false;
+
+    readahead_stats                 stats = {0, 0, 0, 0};
+    std::thread                     reader;
+};
+
+
+static void read_ahead (readahead_state* state)
+{
+    for (;;)
+    {
+        uint8_t* block;
+        {
+            std::unique_lock<std::mutex> lock (state->mutex);
+            state->emptied.wait (lock, [state]{ return state->stop || !state->free.empty(); });
+            if (state->stop)
+                return;
+            block = state->free.back();
+            state->free.pop_back();
+        }
+
+        /* fill the whole block unless the input ends, pipes deliver in small pieces */
+        unsigned long length = 0;
+        int error = 0;
+        while (length < state->block_length)
+        {
+            long l = read (state->fileDescriptor, block + length, state->block_length - length);
+            if (l < 0 && errno == EINTR)
+                continue;
+            if (l < 0)
+                error = errno;
+            if (l <= 0)
+                break;
+            length += (unsigned long)l;
+        }
+
+        std::lock_guard<std::mutex> lock (state->mutex);
+        if (length)
+            state->ready.push_back ({block, length});
+        else
+            state->free.push_back (block);
+        bool done = length < state->block_length;
+        if (done)
+        {
+            state->error = error;
+            state->end_of_input = true;
+        }
+        state->filled.notify_one();
+        if (done)
+            return;
+    }
+}
+
+
+/* Next full block, CWP_RC_OK or the reason there is none */
+static int take_block (readahead_state* state, readahead_block* block)
+{
+    std::unique_lock<std::mutex> lock (state->mutex);
+    if (state->ready.empty() && !state->end_of_input)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        state->filled.wait (lock, [state]{ return !state->ready.empty() || state->end_of_input; });
+        state->stats.waits++;
+        state->stats.wait_nanoseconds += (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+    if (state->ready.empty())
+        return state->error ? CWP_RC_ERROR_IN_HANDLER : CWP_RC_END_OF_INPUT;
+
+    *block = state->ready.front();
+    state->ready.pop_front();
+    state->stats.blocks++;
+    return CWP_RC_OK;
+}
+
+
+static void give_back_block (readahead_state* state, uint8_t* block)
+{
+    std::lock_guard<std::mutex> lock (state->mutex);
+    state->free.push_back (block);
+    state->emptied.notify_one();
+}
+
+
+
+/*****************************************  READAHEAD FILE UNPACK CONTEXT  *********************/
+
+
+/* Let go of the decoder's buffer: a block goes back to the reader, a grown buffer is freed */
+static void release_buffer (readahead_file_unpack_context* rauc)
+{
+    readahead_state* state = rauc->state;
+    if (state->held)
+        give_back_block (state, state->held);
+    else
+        free (rauc->uc.start);
+    state->held = NULL;
+}
+
+
+static int handle_readahead_unpack_underflow (cw_unpack_context* uc, unsigned long more)
+{
+    readahead_file_unpack_context* rauc = (readahead_file_unpack_context*)uc;
+    readahead_state* state = rauc->state;
+    uint8_t *bStart = rauc->barrier ? rauc->barrier : uc->current;
+    unsigned long kept = (unsigned long)(uc->current - bStart);
+    unsigned long remains = (unsigned long)(uc->end - bStart);
+    readahead_block block;
+
+    /* a leftover that fits in the headroom goes in front of the next block, which is used as is */
+    if (remains <= READAHEAD_HEADROOM)
+    {
+        int rc = take_block (state, &block);
+        if (rc != CWP_RC_OK)
+        {
+            uc->err_no = state->error;
+            return rc;
+        }
+        memcpy (block.data - remains, bStart, remains);
+        release_buffer (rauc);
+        state->held = block.data;
+        rauc->buffer_length = state->block_length;
+        uc->start = block.data - remains;
+        uc->current = uc->start + kept;
+        uc->end = block.data + block.length;
+        if (rauc->barrier)
+            rauc->barrier = uc->start;
+        if ((unsigned long)(uc->end - uc->current) >= more)
+            return CWP_RC_OK;
+        bStart = uc->start;
+        remains = (unsigned long)(uc->end - bStart);
+    }
+
+    /* the rest is gathered in a grown buffer of our own */
+    if (state->held)
+    {
+        unsigned long buffer_length = 2 * state->block_length;
+        while (buffer_length < kept + more)
+            buffer_length = 2 * buffer_length;
+        uint8_t *new_buffer = (uint8_t*)malloc (buffer_length);
+        if (!new_buffer)
+            return CWP_RC_BUFFER_UNDERFLOW;
+        memcpy (new_buffer, bStart, remains);
+        release_buffer (rauc);
+        uc->start = new_buffer;
+        rauc->buffer_length = buffer_length;
+    }
+    else if (remains && bStart != uc->start)
+        memmove (uc->start, bStart, remains);
+    uc->current = uc->start + kept;
+    uc->end = uc->start + remains;
+    if (rauc->barrier)
+        rauc->barrier = uc->start;
+
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        int rc = take_block (state, &block);
+        if (rc != CWP_RC_OK)
+        {
+            uc->err_no = state->error;
+            return rc;
+        }
+        unsigned long used = (unsigned long)(uc->end - uc->start);
+        if (rauc->buffer_length < used + block.length)
+        {
+            unsigned long buffer_length = rauc->buffer_length;
+            while (buffer_length < used + block.length)
+                buffer_length = 2 * buffer_length;
+            uint8_t *new_buffer = (uint8_t*)realloc (uc->start, buffer_length);
+            if (!new_buffer)
+            {
+                give_back_block (state, block.data);
+                return CWP_RC_BUFFER_UNDERFLOW;
+            }
+            uc->current = new_buffer + (uc->current - uc->start);
+            uc->end = new_buffer + used;
+            uc->start = new_buffer;
+            if (rauc->barrier)
+                rauc->barrier = uc->start;
+            rauc->buffer_length = buffer_length;
+        }
+        memcpy (uc->end, block.data, block.length);
+        uc->end += block.length;
+        give_back_block (state, block.data);
+        std::lock_guard<std::mutex> lock (state->mutex);
+        state->stats.copies++;
+    }
+
+    return CWP_RC_OK;
+}
+
+
+void init_readahead_file_unpack_context (readahead_file_unpack_context* rauc, unsigned long block_length, unsigned int block_count, int fileDescriptor)
+{
+    block_length = block_length > 0 ? block_length : 65536;
+    block_count = block_count > 1 ? block_count : 2;
+
+    readahead_state* state = new (std::nothrow) readahead_state;
+    bool allocated = state != NULL;
+    for (unsigned int i = 0; allocated && i <= block_count; i++)
+    {
+        uint8_t* block = (uint8_t*)malloc (READAHEAD_HEADROOM + block_length);
+        allocated = block != NULL;
+        if (allocated)
+            state->blocks.push_back (block + READAHEAD_HEADROOM);
+    }
+    if (!allocated)
+    {
+        if (state)
+            for (uint8_t* block : state->blocks)
+                free (block - READAHEAD_HEADROOM);
+        delete state;
+        rauc->state = NULL;
+        rauc->uc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    /* the decoder starts out with the extra block, the thread gets the rest */
+    state->fileDescriptor = fileDescriptor;
+    state->block_length = block_length;
+    state->held = state->blocks[0];
+    state->free.assign (state->blocks.begin() + 1, state->blocks.end());
+    state->reader = std::thread (read_ahead, state);
+
+    rauc->buffer_length = block_length;
+    rauc->barrier = NULL;
+    rauc->state = state;
+    cw_unpack_context_init ((cw_unpack_context*)rauc, state->blocks[0], 0, &handle_readahead_unpack_underflow);
+}
+
+
+void readahead_file_unpack_context_set_barrier (readahead_file_unpack_context* rauc)
+{
+    rauc->barrier = rauc->uc.current;
+}
+
+
+void readahead_file_unpack_context_rescan_from_barrier (readahead_file_unpack_context* rauc)
+{
+    rauc->uc.current = rauc->barrier;
+}
+
+
+void readahead_file_unpack_context_release_barrier (readahead_file_unpack_context* rauc)
+{
+    rauc->barrier = NULL;
+}
+
+
+readahead_stats readahead_file_unpack_context_stats (readahead_file_unpack_context* rauc)
+{
+    readahead_stats stats = {0, 0, 0, 0};
+    if (rauc->state)
+    {
+        std::lock_guard<std::mutex> lock (rauc->state->mutex);
+        stats = rauc->state->stats;
+    }
+    return stats;
+}
+
+
+void terminate_readahead_file_unpack_context (readahead_file_unpack_context* rauc)
+{
+    readahead_state* state = rauc->state;
+    if (!state)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock (state->mutex);
+        state->stop = true;
+        state->emptied.notify_one();
+    }
+    state->reader.join();
+
+    if (!state->held)
+        free (rauc->uc.start);
+    for (uint8_t* block : state->blocks)
+        free (block - READAHEAD_HEADROOM);
+    delete state;
+    rauc->state = NULL;
+    rauc->uc.start = 0;
+}
@@ -0,0 +1,68 @@
+/*      CWPack/goodies - readahead_context.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef readahead_context_h
+#define readahead_context_h
+
+#include "cwpack.hpp"
+
+
+/*****************************************  READAHEAD FILE UNPACK CONTEXT  *********************/
+
+/*
+ * A file unpack context that reads ahead in a background thread. The thread fills a bounded
+ * queue of blocks while the decoder works, so decoding and I/O overlap. The decoder takes
+ * over a full block without copying whenever what is left of its buffer fits in front of it. The barrier and
+ * rescan work as in file_unpack_context.
+ */
+
+struct readahead_state;
+
+typedef struct
+{
+    cw_unpack_context       uc;
+    unsigned long           buffer_length;
+    uint8_t                 *barrier;
+    struct readahead_state  *state;
+} readahead_file_unpack_context;
+
+typedef struct
+{
+    unsigned long           blocks;             /* read by the thread and handed to the decoder */
+    unsigned long           waits;              /* times the decoder found the queue empty */
+    unsigned long long      wait_nanoseconds;   /* spent by the decoder waiting */
+    unsigned long           copies;             /* blocks copied to gather an item or barrier too long for the headroom */
+} readahead_stats;
+
+
+void init_readahead_file_unpack_context (readahead_file_unpack_context* rauc, unsigned long block_length, unsigned int block_count, int fileDescriptor);
+
+void readahead_file_unpack_context_set_barrier (readahead_file_unpack_context* rauc);
+void readahead_file_unpack_context_rescan_from_barrier (readahead_file_unpack_context* rauc);
+void readahead_file_unpack_context_release_barrier (readahead_file_unpack_context* rauc);
+
+readahead_stats readahead_file_unpack_context_stats (readahead_file_unpack_context* rauc);
+
+/* Stops the thread, after any read it is blocked in has returned */
+void terminate_readahead_file_unpack_context (readahead_file_unpack_context* rauc);
+
+#endif /* readahead_context_h */
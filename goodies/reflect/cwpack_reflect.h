@@ -0,0 +1,386 @@
+/*      CWPack/goodies - cwpack_reflect.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef cwpack_reflect_h
+#define cwpack_reflect_h
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cwpack.hpp"
+#include "cwpack_utils.h"
+
+
+/*****************************************  REFLECTION  *****************************************/
+
+/*
+ * CWPACK_DEFINE(Type, field1, field2, ...) placed after a struct, in the same namespace,
+ * makes the struct packable with cw_pack_struct and unpackable with cw_unpack_next_struct.
+ * The struct is packed as a map keyed by the field names. The map header and the packed
+ * keys are built at compile time, so packing a key is a memcpy of constant length.
+ * When unpacking, keys that come in declaration order are recognized by comparing their
+ * packed bytes in the buffer. Other keys are dispatched with a perfect hash found at compile
+ * time. Unknown keys are skipped and fields missing in the input keep their value.
+ *
+ * Fields can be bool, integers, enums, float, double, std::string, std::vector of those
+ * and other structs defined with CWPACK_DEFINE.
+ */
+
+#define CWPACK_DEFINE(Type, ...)                                                            \
+    [[maybe_unused]] inline constexpr auto cwpack_reflect_fields (const Type*)              \
+    {                                                                                       \
+        using cwpack_reflected_type = Type;                                                 \
+        return std::make_tuple(CWPACK_FOR_EACH(CWPACK_REFLECT_FIELD, __VA_ARGS__));         \
+    }
+
+#define CWPACK_REFLECT_FIELD(f) cwpack::make_field<cwpack::encode_key(#f)>(&cwpack_reflected_type::f)
+
+#define CWPACK_PARENS ()
+#define CWPACK_EXPAND(...)  CWPACK_EXPAND3(CWPACK_EXPAND3(CWPACK_EXPAND3(CWPACK_EXPAND3(__VA_ARGS__))))
+#define CWPACK_EXPAND3(...) CWPACK_EXPAND2(CWPACK_EXPAND2(CWPACK_EXPAND2(CWPACK_EXPAND2(__VA_ARGS__))))
+#define CWPACK_EXPAND2(...) CWPACK_EXPAND1(CWPACK_EXPAND1(CWPACK_EXPAND1(CWPACK_EXPAND1(__VA_ARGS__))))
+#define CWPACK_EXPAND1(...) __VA_ARGS__
+#define CWPACK_FOR_EACH(macro, ...) __VA_OPT__(CWPACK_EXPAND(CWPACK_FOR_EACH_NEXT(macro, __VA_ARGS__)))
+#define CWPACK_FOR_EACH_NEXT(macro, first, ...) macro(first) __VA_OPT__(, CWPACK_FOR_EACH_AGAIN CWPACK_PARENS (macro, __VA_ARGS__))
+#define CWPACK_FOR_EACH_AGAIN() CWPACK_FOR_EACH_NEXT
+
+
+namespace cwpack {
+
+/* Length of the str header of a key of length l, as packed by cw_pack_str */
+constexpr size_t key_header_length (size_t l)
+{
+    return l < 32 ? 1 : l < 256 ? 2 : 3;
+}
+
+template <size_t N>
+constexpr std::array<char, key_header_length(N - 1) + N - 1> encode_key (const char (&name)[N])
+{
+    constexpr size_t l = N - 1;
+    constexpr size_t h = key_header_length(l);
+    std::array<char, h + l> key{};
+    if (h == 1)
+        key[0] = (char)(0xa0 | l);
+    else if (h == 2)
+    {
+        key[0] = (char)0xd9;
+        key[1] = (char)l;
+    }
+    else
+    {
+        key[0] = (char)0xda;
+        key[1] = (char)(l >> 8);
+        key[2] = (char)(l & 0xff);
+    }
+    for (size_t i = 0; i < l; i++)
+        key[h + i] = name[i];
+    return key;
+}
+
+template <auto Key, class T, class M>
+struct field {
+    static constexpr auto key = Key;
+    static constexpr size_t header_length = Key[0] == (char)0xd9 ? 2 : Key[0] == (char)0xda ? 3 : 1;
+    static constexpr std::string_view name () { return std::string_view(key.data() + header_length, key.size() - header_length); }
+    M T::* member;
+};
+
+template <auto Key, class T, class M>
+constexpr field<Key, T, M> make_field (M T::* member) { return {member}; }
+
+
+template <class T>
+concept reflected = requires { cwpack_reflect_fields((const T*)nullptr); };
+
+template <class T>
+inline constexpr auto reflected_fields = cwpack_reflect_fields((const T*)nullptr);
+
+template <class T>
+inline constexpr size_t reflected_field_count = std::tuple_size_v<std::remove_cv_t<decltype(reflected_fields<T>)>>;
+
+template <size_t N>
+constexpr std::array<char, N < 16 ? 1 : 3> encode_map_header ()
+{
+    static_assert(N < 65536, "too many fields");
+    if constexpr (N < 16)
+        return {(char)(0x80 | N)};
+    else
+        return {(char)0xde, (char)(N >> 8), (char)(N & 0xff)};
+}
+
+
+/*
+ * Perfect hash of the field names, with a seed searched at compile time. It mixes the length
+ * and the first, middle and last bytes, which tells most field names apart at the cost of a
+ * couple of instructions. If no seed works, all bytes are hashed.
+ */
+
+constexpr uint32_t key_hash (const char* s, size_t l, uint32_t seed, bool all_bytes)
+{
+    uint32_t h = (uint32_t)l * 0x9e3779b1u ^ seed;
+    if (all_bytes)
+    {
+        for (size_t i = 0; i < l; i++)
+            h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    else if (l)
+    {
+        h ^= (uint32_t)(uint8_t)s[0] | (uint32_t)(uint8_t)s[l / 2] << 8 | (uint32_t)(uint8_t)s[l - 1] << 16;
+        h *= 0x85ebca6bu;
+    }
+    return h ^ (h >> 16);
+}
+
+constexpr size_t hash_slots (size_t n)
+{
+    size_t m = 2;
+    while (m < 2 * n)
+        m *= 2;
+    return m;
+}
+
+template <size_t N>
+struct perfect_hash {
+    uint32_t                                seed;
+    bool                                    all_bytes;
+    std::array<int16_t, hash_slots(N)>      slot;       /* field index or -1 */
+    std::array<std::string_view, N>         name;
+};
+
+template <class T>
+constexpr auto make_perfect_hash ()
+{
+    constexpr size_t n = reflected_field_count<T>;
+    perfect_hash<n> ph{};
+    ph.name = std::apply([](const auto&... f) { return std::array<std::string_view, n>{f.name()...}; }, reflected_fields<T>);
+
+    for (int all_bytes = 0; all_bytes < 2; all_bytes++)
+    {
+        ph.all_bytes = all_bytes;
+        for (uint32_t seed = 0; seed < 10000; seed++)
+        {
+            ph.seed = seed;
+            ph.slot.fill(-1);
+            bool collision = false;
+            for (size_t i = 0; i < n && !collision; i++)
+            {
+                size_t s = key_hash(ph.name[i].data(), ph.name[i].size(), seed, ph.all_bytes) & (ph.slot.size() - 1);
+                collision = ph.slot[s] >= 0;
+                ph.slot[s] = (int16_t)i;
+            }
+            if (!collision)
+                return ph;
+        }
+    }
+    throw "no perfect hash for the field names";
+}
+
+template <class T>
+inline constexpr auto reflected_hash = make_perfect_hash<T>();
+
+template <class T>
+inline int find_field (const char* s, uint32_t l)
+{
+    constexpr auto& ph = reflected_hash<T>;
+    int i = ph.slot[key_hash(s, l, ph.seed, ph.all_bytes) & (ph.slot.size() - 1)];
+    if (i < 0 || ph.name[i].size() != l || memcmp(ph.name[i].data(), s, l))
+        return -1;
+    return i;
+}
+
+
+
+/*****************************************  VALUES  *********************************************/
+
+/* A str 8 key is packed as str 16 in compatibility mode, as cw_pack_str does */
+template <class Sink, class F>
+inline void pack_key (basic_context<Sink>* pack_context, const F& f)
+{
+    if constexpr (F::header_length == 2)
+        if (pack_context->be_compatible)
+        {
+            cw_pack_str (pack_context, f.name().data(), (uint32_t)f.name().size());
+            return;
+        }
+    cw_pack_insert (pack_context, f.key.data(), (uint32_t)f.key.size());
+}
+
+template <class Sink, class T>
+inline void pack_value (basic_context<Sink>* pack_context, const T& v);
+
+template <class Source, class T>
+inline void unpack_value (basic_unpack_context<Source>* unpack_context, T& v);
+
+template <class T> struct is_vector : std::false_type {};
+template <class E, class A> struct is_vector<std::vector<E, A>> : std::true_type {};
+
+template <class T>
+struct dependent_false : std::false_type {};
+
+template <class Sink, class T>
+inline void pack_value (basic_context<Sink>* pack_context, const T& v)
+{
+    if constexpr (std::is_same_v<T, bool>)
+        cw_pack_boolean (pack_context, v);
+    else if constexpr (std::is_enum_v<T>)
+        pack_value (pack_context, (std::underlying_type_t<T>)v);
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        cw_pack_signed (pack_context, v);
+    else if constexpr (std::is_integral_v<T>)
+        cw_pack_unsigned (pack_context, v);
+    else if constexpr (std::is_same_v<T, float>)
+        cw_pack_float (pack_context, v);
+    else if constexpr (std::is_same_v<T, double>)
+        cw_pack_double (pack_context, v);
+    else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        cw_pack_str (pack_context, v.data(), (uint32_t)v.size());
+    else if constexpr (is_vector<T>::value)
+    {
+        cw_pack_array_size (pack_context, (uint32_t)v.size());
+        for (const auto& e : v)
+            pack_value (pack_context, e);
+    }
+    else if constexpr (reflected<T>)
+    {
+        constexpr auto header = encode_map_header<reflected_field_count<T>>();
+        cw_pack_insert (pack_context, header.data(), (uint32_t)header.size());
+        std::apply([&](const auto&... f) {
+            ((pack_key (pack_context, f), pack_value (pack_context, v.*(f.member))), ...);
+        }, reflected_fields<T>);
+    }
+    else
+        static_assert(dependent_false<T>::value, "type can't be packed");
+}
+
+template <class Source, class T>
+inline void unpack_value (basic_unpack_context<Source>* unpack_context, T& v)
+{
+    if constexpr (std::is_same_v<T, bool>)
+        v = cw_unpack_next_boolean (unpack_context);
+    else if constexpr (std::is_enum_v<T>)
+    {
+        std::underlying_type_t<T> u;
+        unpack_value (unpack_context, u);
+        v = (T)u;
+    }
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+    {
+        if constexpr (sizeof(T) == 1)       v = cw_unpack_next_signed8 (unpack_context);
+        else if constexpr (sizeof(T) == 2)  v = cw_unpack_next_signed16 (unpack_context);
+        else if constexpr (sizeof(T) == 4)  v = cw_unpack_next_signed32 (unpack_context);
+        else                                v = cw_unpack_next_signed64 (unpack_context);
+    }
+    else if constexpr (std::is_integral_v<T>)
+    {
+        if constexpr (sizeof(T) == 1)       v = cw_unpack_next_unsigned8 (unpack_context);
+        else if constexpr (sizeof(T) == 2)  v = cw_unpack_next_unsigned16 (unpack_context);
+        else if constexpr (sizeof(T) == 4)  v = cw_unpack_next_unsigned32 (unpack_context);
+        else                                v = cw_unpack_next_unsigned64 (unpack_context);
+    }
+    else if constexpr (std::is_same_v<T, float>)
+        v = cw_unpack_next_float (unpack_context);
+    else if constexpr (std::is_same_v<T, double>)
+        v = cw_unpack_next_double (unpack_context);
+    else if constexpr (std::is_same_v<T, std::string>)
+    {
+        cw_unpack_next (unpack_context);
+        if (unpack_context->return_code)
+            return;
+        if (unpack_context->item.type != item_type::STR)
+        {
+            unpack_context->return_code = CWP_RC_TYPE_ERROR;
+            return;
+        }
+        v.assign ((const char*)unpack_context->item.as.str.start, unpack_context->item.as.str.length);
+    }
+    else if constexpr (is_vector<T>::value)
+    {
+        unsigned int size = cw_unpack_next_array_size (unpack_context);
+        if (unpack_context->return_code)
+            return;
+        /* The size is untrusted input: grow as elements are decoded */
+        v.clear();
+        v.reserve (std::min<unsigned long>(size, (unsigned long)(unpack_context->end - unpack_context->current)));
+        for (unsigned int i = 0; i < size && unpack_context->return_code == CWP_RC_OK; i++)
+            unpack_value (unpack_context, v.emplace_back());
+    }
+    else if constexpr (reflected<T>)
+    {
+        unsigned int pairs = cw_unpack_next_map_size (unpack_context);
+
+        /* Fast path for fields in declaration order: compare the packed keys in the buffer */
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            ((pairs && unpack_context->return_code == CWP_RC_OK && [&] {
+                const auto& f = std::get<I>(reflected_fields<T>);
+                if ((size_t)(unpack_context->end - unpack_context->current) < f.key.size() ||
+                    memcmp(unpack_context->current, f.key.data(), f.key.size()))
+                    return false;
+                unpack_context->current += f.key.size();
+                pairs--;
+                unpack_value (unpack_context, v.*(f.member));
+                return true;
+            }()) && ...);
+        }(std::make_index_sequence<reflected_field_count<T>>{});
+
+        while (pairs-- && !unpack_context->return_code)
+        {
+            cw_unpack_next (unpack_context);
+            if (unpack_context->return_code)
+                return;
+            int i = unpack_context->item.type == item_type::STR ?
+                    find_field<T> ((const char*)unpack_context->item.as.str.start, unpack_context->item.as.str.length) : -1;
+            if (i < 0)
+            {
+                cw_skip_items (unpack_context, 1);
+                continue;
+            }
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                ((I == (size_t)i ? (unpack_value (unpack_context, v.*(std::get<I>(reflected_fields<T>).member)), true) : false) || ...);
+            }(std::make_index_sequence<reflected_field_count<T>>{});
+        }
+    }
+    else
+        static_assert(dependent_false<T>::value, "type can't be unpacked");
+}
+
+}
+
+
+template <class Sink, cwpack::reflected T>
+inline void cw_pack_struct (cwpack::basic_context<Sink>* pack_context, const T& v)
+{
+    cwpack::pack_value (pack_context, v);
+}
+
+template <class Source, cwpack::reflected T>
+inline void cw_unpack_next_struct (cwpack::basic_unpack_context<Source>* unpack_context, T& v)
+{
+    cwpack::unpack_value (unpack_context, v);
+}
+
+#endif /* cwpack_reflect_h */
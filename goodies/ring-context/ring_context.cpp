@@ -0,0 +1,174 @@
+/*      CWPack/goodies - ring_context.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ring_context.h"
+
+
+
+/*****************************************  MIRRORED RING  *************************************/
+
+
+/* Map length bytes of a memory file twice in a row, NULL on failure */
+static uint8_t* map_ring (unsigned long length)
+{
+    int memoryFile = memfd_create ("cwpack_ring", MFD_CLOEXEC);
+    if (memoryFile < 0)
+        return NULL;
+    if (ftruncate (memoryFile, (off_t)length) < 0)
+    {
+        close (memoryFile);
+        return NULL;
+    }
+
+    /* reserve the address range, then put the two mappings on top of it */
+    uint8_t* ring = (uint8_t*)mmap (NULL, 2 * length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED ||
+        mmap (ring, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memoryFile, 0) == MAP_FAILED ||
+        mmap (ring + length, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memoryFile, 0) == MAP_FAILED)
+    {
+        int error = errno;
+        if (ring != MAP_FAILED)
+            munmap (ring, 2 * length);
+        close (memoryFile);
+        errno = error;
+        return NULL;
+    }
+    close (memoryFile);
+    return ring;
+}
+
+
+static void unmap_ring (uint8_t* ring, unsigned long length)
+{
+    if (ring)
+        munmap (ring, 2 * length);
+}
+
+
+
+/*****************************************  RING FILE UNPACK CONTEXT  **************************/
+
+
+static int handle_ring_unpack_underflow (cw_unpack_context* uc, unsigned long more)
+{
+    ring_file_unpack_context* rfuc = (ring_file_unpack_context*)uc;
+    uint8_t *bStart = rfuc->barrier ? rfuc->barrier : uc->current;
+    unsigned long kept = (unsigned long)(uc->current - bStart);
+    unsigned long remains = (unsigned long)(uc->end - bStart);
+
+    if (kept + more > rfuc->ring_length)
+    {
+        unsigned long ring_length = rfuc->ring_length;
+        while (ring_length < kept + more)
+            ring_length = 2 * ring_length;
+        uint8_t* ring = map_ring (ring_length);
+        if (!ring)
+        {
+            uc->err_no = errno;
+            return CWP_RC_BUFFER_UNDERFLOW;
+        }
+        memcpy (ring, bStart, remains);
+        unmap_ring (rfuc->ring, rfuc->ring_length);
+        rfuc->ring = ring;
+        rfuc->ring_length = ring_length;
+        bStart = ring;
+    }
+    else if (bStart >= rfuc->ring + rfuc->ring_length)
+    {
+        /* the same bytes in the first mapping */
+        bStart -= rfuc->ring_length;
+    }
+
+    uc->start = rfuc->ring;
+    uc->current = bStart + kept;
+    uc->end = bStart + remains;
+    if (rfuc->barrier)
+        rfuc->barrier = bStart;
+
+    while ((unsigned long)(uc->end - uc->current) < more)
+    {
+        long l = read (rfuc->fileDescriptor, uc->end, rfuc->ring_length - (unsigned long)(uc->end - bStart));
+        if (l == 0)
+            return CWP_RC_END_OF_INPUT;
+        if (l < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            uc->err_no = errno;
+            return CWP_RC_ERROR_IN_HANDLER;
+        }
+        uc->end += l;
+    }
+
+    return CWP_RC_OK;
+}
+
+
+void init_ring_file_unpack_context (ring_file_unpack_context* rfuc, unsigned long ring_length, int fileDescriptor)
+{
+    unsigned long page_size = (unsigned long)sysconf (_SC_PAGESIZE);
+    ring_length = ring_length > 0 ? ring_length : 65536;
+    ring_length = (ring_length + page_size - 1) / page_size * page_size;
+
+    rfuc->fileDescriptor = fileDescriptor;
+    rfuc->barrier = NULL;
+    rfuc->ring_length = ring_length;
+    rfuc->ring = map_ring (ring_length);
+    cw_unpack_context_init ((cw_unpack_context*)rfuc, rfuc->ring, 0, &handle_ring_unpack_underflow);
+    if (!rfuc->ring)
+    {
+        rfuc->uc.err_no = errno;
+        rfuc->uc.return_code = CWP_RC_MALLOC_ERROR;
+    }
+}
+
+
+void ring_file_unpack_context_set_barrier (ring_file_unpack_context* rfuc)
+{
+    rfuc->barrier = rfuc->uc.current;
+}
+
+
+void ring_file_unpack_context_rescan_from_barrier (ring_file_unpack_context* rfuc)
+{
+    rfuc->uc.current = rfuc->barrier;
+}
+
+
+void ring_file_unpack_context_release_barrier (ring_file_unpack_context* rfuc)
+{
+    rfuc->barrier = NULL;
+}
+
+
+void terminate_ring_file_unpack_context (ring_file_unpack_context* rfuc)
+{
+    unmap_ring (rfuc->ring, rfuc->ring_length);
+    rfuc->ring = NULL;
+    rfuc->uc.start = rfuc->uc.current = rfuc->uc.end = NULL;
+}
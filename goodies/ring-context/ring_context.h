@@ -0,0 +1,58 @@
+/*      CWPack/goodies - ring_context.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ring_context_h
+#define ring_context_h
+
+#include "cwpack.hpp"
+
+
+/*****************************************  RING FILE UNPACK CONTEXT  **************************/
+
+/*
+ * A file unpack context over a ring buffer that is mapped twice, back to back, in virtual
+ * memory. Bytes past the end of the ring are the bytes at its start, so an item spanning the
+ * wrap point is contiguous. A refill never moves the unread bytes; it is one read into the
+ * free space after them. The barrier and rescan work as in file_unpack_context.
+ */
+
+typedef struct
+{
+    cw_unpack_context   uc;
+    int                 fileDescriptor;
+    uint8_t             *ring;              /* the first of the two mappings */
+    unsigned long       ring_length;        /* whole pages */
+    uint8_t             *barrier;
+} ring_file_unpack_context;
+
+
+/* The ring is doubled when an item (or the bytes kept by the barrier) doesn't fit.
+   If the ring can't be mapped, return_code is CWP_RC_MALLOC_ERROR with errno in err_no. */
+void init_ring_file_unpack_context (ring_file_unpack_context* rfuc, unsigned long ring_length, int fileDescriptor);
+
+void ring_file_unpack_context_set_barrier (ring_file_unpack_context* rfuc);
+void ring_file_unpack_context_rescan_from_barrier (ring_file_unpack_context* rfuc);
+void ring_file_unpack_context_release_barrier (ring_file_unpack_context* rfuc);
+
+void terminate_ring_file_unpack_context (ring_file_unpack_context* rfuc);
+
+#endif /* ring_context_h */
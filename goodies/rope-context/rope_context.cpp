@@ -0,0 +1,237 @@
+/*      CWPack/goodies - rope_context.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rope_context.h"
+
+
+
+/*****************************************  ROPE CHUNK POOL  ***********************************/
+
+
+void init_cw_rope_pool (cw_rope_pool* pool, unsigned long chunk_length)
+{
+    pool->chunk_length = chunk_length > 32 ? chunk_length : 4096;
+    pool->free_chunks = NULL;
+    pool->free_count = 0;
+}
+
+
+void free_cw_rope_pool (cw_rope_pool* pool)
+{
+    while (pool->free_chunks)
+    {
+        cwpack::rope_chunk* chunk = pool->free_chunks;
+        pool->free_chunks = chunk->next;
+        free (chunk);
+    }
+    pool->free_count = 0;
+}
+
+
+cwpack::rope_chunk* cw_rope_pool_get (cw_rope_pool* pool, unsigned long more)
+{
+    cwpack::rope_chunk* chunk;
+    if (more <= pool->chunk_length && pool->free_chunks)
+    {
+        chunk = pool->free_chunks;
+        pool->free_chunks = chunk->next;
+        pool->free_count--;
+    }
+    else
+    {
+        unsigned long capacity = more > pool->chunk_length ? more : pool->chunk_length;
+        chunk = (cwpack::rope_chunk*)malloc (sizeof(cwpack::rope_chunk) + capacity);
+        if (!chunk)
+            return NULL;
+        chunk->capacity = capacity;
+    }
+    chunk->next = NULL;
+    chunk->length = 0;
+    return chunk;
+}
+
+
+/* Oversized chunks are not kept */
+void cw_rope_pool_put (cw_rope_pool* pool, cwpack::rope_chunk* chunk)
+{
+    if (chunk->capacity != pool->chunk_length)
+    {
+        free (chunk);
+        return;
+    }
+    chunk->next = pool->free_chunks;
+    pool->free_chunks = chunk;
+    pool->free_count++;
+}
+
+
+
+/*****************************************  ROPE PACK CONTEXT  **********************************/
+
+
+void init_rope_pack_context (rope_pack_context* rpc, cw_rope_pool* pool)
+{
+    cwpack::rope_chunk* chunk = cw_rope_pool_get (pool, 0);
+    cw_pack_context_init (rpc, chunk ? chunk->data() : NULL, chunk ? chunk->capacity : 0, cwpack::rope_sink{pool, chunk, chunk});
+    if (!chunk)
+        rpc->return_code = CWP_RC_MALLOC_ERROR;
+}
+
+
+const cwpack::rope_chunk* rope_pack_context_chunks (rope_pack_context* rpc)
+{
+    rpc->flush (rpc);
+    return rpc->first;
+}
+
+
+unsigned long rope_pack_context_length (rope_pack_context* rpc)
+{
+    unsigned long length = 0;
+    for (const cwpack::rope_chunk* chunk = rope_pack_context_chunks (rpc); chunk; chunk = chunk->next)
+        length += chunk->length;
+    return length;
+}
+
+
+int rope_pack_context_iov (rope_pack_context* rpc, struct iovec* iov, int iov_count)
+{
+    int count = 0;
+    for (const cwpack::rope_chunk* chunk = rope_pack_context_chunks (rpc); chunk; chunk = chunk->next)
+    {
+        if (count < iov_count)
+            iov[count] = {(void*)chunk->data(), chunk->length};
+        count++;
+    }
+    return count;
+}
+
+
+int rope_pack_context_writev (rope_pack_context* rpc, int fileDescriptor)
+{
+    if (rpc->return_code)
+        return rpc->return_code;
+
+    struct iovec iov[64];
+    const cwpack::rope_chunk* chunk = rope_pack_context_chunks (rpc);
+    unsigned long offset = 0;       /* written of the first chunk in iov */
+    while (chunk)
+    {
+        int count = 0;
+        for (const cwpack::rope_chunk* c = chunk; c && count < 64; c = c->next, count++)
+            iov[count] = {(void*)c->data(), c->length};
+        iov[0].iov_base = (uint8_t*)iov[0].iov_base + offset;
+        iov[0].iov_len -= offset;
+
+        long written = writev (fileDescriptor, iov, count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            rpc->err_no = errno;
+            return rpc->return_code = CWP_RC_ERROR_IN_HANDLER;
+        }
+        written += (long)offset;
+        while (chunk && (unsigned long)written >= chunk->length)
+        {
+            written -= (long)chunk->length;
+            chunk = chunk->next;
+        }
+        offset = (unsigned long)written;
+    }
+    return CWP_RC_OK;
+}
+
+
+const uint8_t* rope_pack_context_flatten (rope_pack_context* rpc)
+{
+    if (rpc->first == rpc->last)
+        return rpc->start;
+
+    unsigned long length = rope_pack_context_length (rpc);
+    cwpack::rope_chunk* flat = (cwpack::rope_chunk*)malloc (sizeof(cwpack::rope_chunk) + length);
+    if (!flat)
+    {
+        rpc->return_code = CWP_RC_MALLOC_ERROR;
+        return NULL;
+    }
+    flat->next = NULL;
+    flat->capacity = flat->length = length;
+
+    uint8_t* p = flat->data();
+    cwpack::rope_chunk* chunk = rpc->first;
+    while (chunk)
+    {
+        memcpy (p, chunk->data(), chunk->length);
+        p += chunk->length;
+        cwpack::rope_chunk* next = chunk->next;
+        cw_rope_pool_put (rpc->pool, chunk);
+        chunk = next;
+    }
+
+    /* the flat chunk is full, packing goes on in a new chunk */
+    rpc->first = rpc->last = flat;
+    rpc->start = flat->data();
+    rpc->current = rpc->end = rpc->start + length;
+    return rpc->start;
+}
+
+
+void reset_rope_pack_context (rope_pack_context* rpc)
+{
+    if (!rpc->first)
+        return;
+
+    cwpack::rope_chunk* chunk = rpc->first->next;
+    while (chunk)
+    {
+        cwpack::rope_chunk* next = chunk->next;
+        cw_rope_pool_put (rpc->pool, chunk);
+        chunk = next;
+    }
+    rpc->first->next = NULL;
+    rpc->first->length = 0;
+    rpc->last = rpc->first;
+    rpc->start = rpc->current = rpc->first->data();
+    rpc->end = rpc->start + rpc->first->capacity;
+    rpc->return_code = CWP_RC_OK;
+}
+
+
+void terminate_rope_pack_context (rope_pack_context* rpc)
+{
+    cwpack::rope_chunk* chunk = rpc->first;
+    while (chunk)
+    {
+        cwpack::rope_chunk* next = chunk->next;
+        cw_rope_pool_put (rpc->pool, chunk);
+        chunk = next;
+    }
+    rpc->first = rpc->last = NULL;
+    rpc->start = rpc->current = rpc->end = NULL;
+}
@@ -0,0 +1,142 @@
+/*      CWPack/goodies - rope_context.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef rope_context_h
+#define rope_context_h
+
+#include <stdlib.h>
+#include <sys/uio.h>
+
+#include "cwpack.hpp"
+
+
+/*****************************************  ROPE CHUNK POOL  ***********************************/
+
+namespace cwpack {
+
+struct rope_chunk {
+    rope_chunk*         next;
+    unsigned long       capacity;
+    unsigned long       length;         /* packed bytes in the chunk */
+
+    uint8_t* data() { return (uint8_t*)(this + 1); }
+    const uint8_t* data() const { return (const uint8_t*)(this + 1); }
+};
+
+}
+
+/*
+ * A free list of equally sized chunks. A pool can be shared by several rope contexts in the
+ * same thread, and keeps the chunks of terminated contexts for reuse.
+ */
+
+typedef struct
+{
+    unsigned long       chunk_length;
+    cwpack::rope_chunk  *free_chunks;
+    unsigned long       free_count;
+} cw_rope_pool;
+
+
+void init_cw_rope_pool (cw_rope_pool* pool, unsigned long chunk_length);
+void free_cw_rope_pool (cw_rope_pool* pool);
+
+cwpack::rope_chunk* cw_rope_pool_get (cw_rope_pool* pool, unsigned long more);
+void cw_rope_pool_put (cw_rope_pool* pool, cwpack::rope_chunk* chunk);
+
+
+
+/*****************************************  ROPE PACK CONTEXT  **********************************/
+
+/*
+ * A dynamic pack context made of a linked list of chunks. When a chunk is full the next item
+ * goes into a new chunk, so packed bytes are never moved or copied. The memory used is the
+ * message plus the unused tails of the chunks. Items larger than a chunk get a chunk of their own.
+ * A full chunk is never moved, so deferred container headers (cw_pack_array_begin) must be
+ * ended before the chunk is full.
+ */
+
+namespace cwpack {
+
+struct rope_sink {
+    template <class Context>
+    int overflow (Context* pc, unsigned long more)
+    {
+        rope_chunk* chunk = cw_rope_pool_get (pool, more);
+        if (!chunk)
+            return CWP_RC_BUFFER_OVERFLOW;
+
+        if (last)
+        {
+            last->length = (unsigned long)(pc->current - pc->start);
+            last->next = chunk;
+        }
+        else
+            first = chunk;
+        last = chunk;
+        pc->start = pc->current = chunk->data();
+        pc->end = pc->start + chunk->capacity;
+        return CWP_RC_OK;
+    }
+
+    template <class Context>
+    int flush (Context* pc)
+    {
+        if (last)
+            last->length = (unsigned long)(pc->current - pc->start);
+        return CWP_RC_OK;
+    }
+
+    cw_rope_pool*   pool;
+    rope_chunk*     first;
+    rope_chunk*     last;           /* the chunk packed to */
+};
+
+}
+
+typedef cwpack::basic_context<cwpack::rope_sink> rope_pack_context;
+
+
+/* The pool must outlive the context */
+void init_rope_pack_context (rope_pack_context* rpc, cw_rope_pool* pool);
+
+/* The chunks in order, follow next until NULL. Valid until the context is packed to, reset or terminated. */
+const cwpack::rope_chunk* rope_pack_context_chunks (rope_pack_context* rpc);
+
+unsigned long rope_pack_context_length (rope_pack_context* rpc);
+
+/* Fill in at most iov_count iovecs, returns the number of chunks */
+int rope_pack_context_iov (rope_pack_context* rpc, struct iovec* iov, int iov_count);
+
+/* Write the message with writev, as many calls as needed for IOV_MAX and partial writes */
+int rope_pack_context_writev (rope_pack_context* rpc, int fileDescriptor);
+
+/* Copy the message into one chunk, that replaces the others. Returns the contiguous message,
+   valid until the context is packed to, reset or terminated. */
+const uint8_t* rope_pack_context_flatten (rope_pack_context* rpc);
+
+/* Start a new message, giving all chunks back to the pool */
+void reset_rope_pack_context (rope_pack_context* rpc);
+
+void terminate_rope_pack_context (rope_pack_context* rpc);
+
+#endif /* rope_context_h */
@@ -0,0 +1,180 @@
+/*      CWPack/goodies - cwpack_tape.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cwpack_tape.h"
+
+
+
+static bool reserve_entries (cw_tape* tape, unsigned long needed)
+{
+    if (needed <= tape->capacity)
+        return true;
+
+    unsigned long capacity = tape->capacity ? tape->capacity : 64;
+    while (capacity < needed)
+        capacity = 2 * capacity;
+    void *new_entries = realloc (tape->entries, capacity * sizeof(cw_tape_entry));
+    if (!new_entries)
+        return false;
+
+    tape->entries = (cw_tape_entry*)new_entries;
+    tape->capacity = capacity;
+    return true;
+}
+
+
+static bool push_frame (cw_tape* tape, unsigned long depth, unsigned long index, unsigned long remaining)
+{
+    if (depth == tape->stack_capacity)
+    {
+        unsigned long capacity = tape->stack_capacity ? 2 * tape->stack_capacity : 16;
+        void *new_stack = realloc (tape->stack, capacity * sizeof(cw_tape_frame));
+        if (!new_stack)
+            return false;
+
+        tape->stack = (cw_tape_frame*)new_stack;
+        tape->stack_capacity = capacity;
+    }
+    tape->stack[depth].index = index;
+    tape->stack[depth].remaining = remaining;
+    return true;
+}
+
+
+void init_cw_tape (cw_tape* tape, unsigned long initial_capacity)
+{
+    memset (tape, 0, sizeof(cw_tape));
+    if (!reserve_entries (tape, initial_capacity > 0 ? initial_capacity : 1024))
+        tape->return_code = CWP_RC_MALLOC_ERROR;
+}
+
+
+#define TAPE_ERROR(error_code)                  \
+{                                               \
+    tape->return_code = error_code;             \
+    unpack_context->return_code = error_code;   \
+    return error_code;                          \
+}
+
+int build_cw_tape (cw_tape* tape, cw_static_unpack_context* unpack_context)
+{
+    if (tape->return_code == CWP_RC_MALLOC_ERROR)
+        return CWP_RC_MALLOC_ERROR;
+    if (unpack_context->return_code)
+        return tape->return_code = unpack_context->return_code;
+
+    const uint8_t* base = unpack_context->current;
+    const uint8_t* p = base;
+    const uint8_t* end = unpack_context->end;
+    if ((unsigned long)(end - base) > 0xffffffffUL)
+        TAPE_ERROR(CWP_RC_VALUE_ERROR)
+
+    tape->buffer = base;
+    tape->count = 0;
+    tape->return_code = CWP_RC_OK;
+
+    uint32_t        tmpu32;
+    uint16_t        tmpu16;
+    unsigned long   depth = 0;
+
+    while (p < end)
+    {
+        if (!reserve_entries (tape, tape->count + 2))
+            TAPE_ERROR(CWP_RC_MALLOC_ERROR)
+
+        uint8_t c = *p;
+        const cwpack::lead_byte_descriptor& d = cwpack::lead_byte_table[c];
+        if (d.kind == cwpack::lead_kind::ILLEGAL)
+            TAPE_ERROR(CWP_RC_MALFORMED_INPUT)
+        if ((unsigned long)(end - p) < d.header_length)
+            TAPE_ERROR(CWP_RC_BUFFER_UNDERFLOW)
+
+        unsigned long field = 0;
+        const uint8_t* q = p + 1;
+        switch (d.length_width)
+        {
+            case 1:     field = *q;                         break;
+            case 2:     cw_load16(q); field = tmpu16;       break;
+            case 4:     cw_load32(q); field = tmpu32;       break;
+            default:                                        break;
+        }
+
+        unsigned long length = d.payload_length;
+        unsigned long size = 0;
+        switch (d.kind)
+        {
+            case cwpack::lead_kind::BLOB8:
+            case cwpack::lead_kind::BLOB16:
+            case cwpack::lead_kind::BLOB32:
+            case cwpack::lead_kind::EXT8:
+            case cwpack::lead_kind::EXT16:
+            case cwpack::lead_kind::EXT32:          length = field;                                         break;
+            case cwpack::lead_kind::FIXCONTAINER:   size = d.container_multiplier * (unsigned long)d.immediate;  break;
+            case cwpack::lead_kind::CONTAINER16:
+            case cwpack::lead_kind::CONTAINER32:    size = d.container_multiplier * field;                  break;
+            default:                                                                                        break;
+        }
+        if ((unsigned long)(end - p) - d.header_length < length)
+            TAPE_ERROR(CWP_RC_BUFFER_UNDERFLOW)
+
+        cw_tape_entry* entry = tape->entries + tape->count;
+        entry->offset = (uint32_t)(p - base);
+        entry->type = d.type == cwpack::item_type::EXT ? (cwpack_item_types)(int8_t)p[d.header_length - 1] : d.type;
+        p += d.header_length + length;
+        tape->count++;
+
+        if (size)
+        {
+            if (!push_frame (tape, depth++, tape->count - 1, size))
+                TAPE_ERROR(CWP_RC_MALLOC_ERROR)
+            continue;
+        }
+
+        entry->next = (uint32_t)tape->count;
+        while (depth && --tape->stack[depth - 1].remaining == 0)
+        {
+            tape->entries[tape->stack[--depth].index].next = (uint32_t)tape->count;
+        }
+    }
+
+    if (depth)
+        TAPE_ERROR(CWP_RC_BUFFER_UNDERFLOW)
+
+    cw_tape_entry* sentinel = tape->entries + tape->count;
+    sentinel->offset = (uint32_t)(p - base);
+    sentinel->next = (uint32_t)tape->count + 1;
+    sentinel->type = cwpack::item_type::NOT_AN_ITEM;
+    unpack_context->current = (uint8_t*)p;
+    return CWP_RC_OK;
+}
+
+
+void free_cw_tape (cw_tape* tape)
+{
+    free (tape->entries);
+    free (tape->stack);
+    memset (tape, 0, sizeof(cw_tape));
+}
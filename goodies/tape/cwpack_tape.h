@@ -0,0 +1,120 @@
+/*      CWPack/goodies - cwpack_tape.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef cwpack_tape_h
+#define cwpack_tape_h
+
+#include "cwpack.hpp"
+
+
+/*****************************************  TAPE  ***********************************************/
+
+/*
+ * A tape is a structural index of a packed buffer. It holds one entry per item in document
+ * order, so the children of a container follow their container directly. Each entry knows
+ * where its subtree ends on the tape, which makes the jump to the next sibling O(1).
+ * The entry after the last item is a sentinel whose offset is the end of the indexed bytes.
+ */
+
+typedef struct
+{
+    uint32_t            offset;         /* of the lead byte, from the start of the indexed bytes */
+    uint32_t            next;           /* tape index of the next sibling, one past the subtree */
+    cwpack_item_types   type;           /* ext items have their ext type */
+} cw_tape_entry;
+
+typedef struct
+{
+    unsigned long       index;          /* tape index of the container */
+    unsigned long       remaining;      /* items left to index in the container */
+} cw_tape_frame;
+
+typedef struct
+{
+    cw_tape_entry*      entries;
+    unsigned long       count;          /* items on the tape, not counting the sentinel */
+    unsigned long       capacity;
+    const uint8_t*      buffer;         /* the indexed bytes */
+    cw_tape_frame*      stack;          /* open containers while building */
+    unsigned long       stack_capacity;
+    int                 return_code;
+} cw_tape;
+
+
+void init_cw_tape (cw_tape* tape, unsigned long initial_capacity);
+
+/*
+ * Index all items from current to end of the static unpack context. On success the context
+ * is positioned at end. The tape refers to the buffer, which must outlive it.
+ * Buffers larger than 4 GiB are rejected with CWP_RC_VALUE_ERROR.
+ */
+int build_cw_tape (cw_tape* tape, cw_static_unpack_context* unpack_context);
+
+void free_cw_tape (cw_tape* tape);
+
+
+
+/*****************************************  NAVIGATION  *****************************************/
+
+inline cwpack_item_types cw_tape_type (const cw_tape* tape, unsigned long index)
+{
+    return tape->entries[index].type;
+}
+
+inline unsigned long cw_tape_next_sibling (const cw_tape* tape, unsigned long index)
+{
+    return tape->entries[index].next;
+}
+
+/* Tape index of child n of a container, counting keys and values separately in a map.
+   Returns the next sibling of the container if there is no such child. */
+inline unsigned long cw_tape_child (const cw_tape* tape, unsigned long index, unsigned long n)
+{
+    unsigned long end = tape->entries[index].next;
+    unsigned long child = index + 1;
+    while (n-- && child < end)
+        child = tape->entries[child].next;
+    return child < end ? child : end;
+}
+
+inline const uint8_t* cw_tape_item_start (const cw_tape* tape, unsigned long index)
+{
+    return tape->buffer + tape->entries[index].offset;
+}
+
+/* Length in bytes of the item including all its children */
+inline unsigned long cw_tape_item_length (const cw_tape* tape, unsigned long index)
+{
+    return tape->entries[tape->entries[index].next].offset - tape->entries[index].offset;
+}
+
+/* Decode the item at index. The context is left at the item's first child or next sibling
+   and can be used to go on decoding from there. */
+inline int cw_tape_unpack (const cw_tape* tape, unsigned long index, cw_static_unpack_context* unpack_context)
+{
+    const uint8_t* start = cw_tape_item_start (tape, index);
+    cw_unpack_context_init (unpack_context, start, tape->entries[tape->count].offset - tape->entries[index].offset);
+    cw_unpack_next (unpack_context);
+    return unpack_context->return_code;
+}
+
+#endif /* cwpack_tape_h */
@@ -0,0 +1,453 @@
+/*      CWPack/goodies - uring_context.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "uring_context.h"
+
+
+
+/*****************************************  RING  ***********************************************/
+
+struct uring_buffer
+{
+    uint8_t         *data;
+    unsigned long   length;
+    bool            in_flight;
+    bool            short_write;
+    const uint8_t   *pending;           /* not yet written */
+    unsigned long   pending_length;
+    long long       offset;             /* in file of pending, -1 if the file isn't seekable */
+};
+
+struct uring_pack_state
+{
+    int                     ring;       /* -1 when writing synchronously */
+    bool                    no_write_op;    /* the kernel rejected IORING_OP_WRITE */
+    unsigned                *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe     *sqes;
+    unsigned                *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe     *cqes;
+    void                    *sq_ring, *cq_ring;
+    size_t                  sq_ring_length, cq_ring_length, sqes_length;
+
+    uring_buffer            *buffers;
+    unsigned int            buffer_count;
+    unsigned int            current;
+    unsigned int            in_flight;
+    long long               file_offset;    /* -1 if writes must be kept in order */
+    unsigned long           waits;
+    int                     error;          /* errno of a failed write */
+};
+
+
+static bool setup_ring (uring_pack_state* state, unsigned int entries)
+{
+    struct io_uring_params params;
+    memset (&params, 0, sizeof(params));
+    int ring = (int)syscall (__NR_io_uring_setup, entries, &params);
+    if (ring < 0)
+        return false;
+
+    state->sq_ring_length = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    state->cq_ring_length = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        if (state->cq_ring_length > state->sq_ring_length)
+            state->sq_ring_length = state->cq_ring_length;
+        state->cq_ring_length = state->sq_ring_length;
+    }
+    state->sqes_length = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    state->sq_ring = mmap (NULL, state->sq_ring_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    state->cq_ring = single_mmap ? state->sq_ring :
+                     mmap (NULL, state->cq_ring_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    state->sqes = (struct io_uring_sqe*)mmap (NULL, state->sqes_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (state->sq_ring == MAP_FAILED || state->cq_ring == MAP_FAILED || state->sqes == MAP_FAILED)
+    {
+        if (state->sq_ring != MAP_FAILED)
+            munmap (state->sq_ring, state->sq_ring_length);
+        if (!single_mmap && state->cq_ring != MAP_FAILED)
+            munmap (state->cq_ring, state->cq_ring_length);
+        if (state->sqes != MAP_FAILED)
+            munmap (state->sqes, state->sqes_length);
+        close (ring);
+        return false;
+    }
+
+    uint8_t* sq = (uint8_t*)state->sq_ring;
+    uint8_t* cq = (uint8_t*)state->cq_ring;
+    state->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    state->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    state->sq_array = (unsigned*)(sq + params.sq_off.array);
+    state->cq_head = (unsigned*)(cq + params.cq_off.head);
+    state->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    state->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    state->ring = ring;
+    return true;
+}
+
+
+static void close_ring (uring_pack_state* state)
+{
+    if (state->ring < 0)
+        return;
+
+    munmap (state->sqes, state->sqes_length);
+    if (state->cq_ring != state->sq_ring)
+        munmap (state->cq_ring, state->cq_ring_length);
+    munmap (state->sq_ring, state->sq_ring_length);
+    close (state->ring);
+    state->ring = -1;
+}
+
+
+static int enter_ring (uring_pack_state* state, unsigned int submit, unsigned int wait)
+{
+    for (;;)
+    {
+        int rc = (int)syscall (__NR_io_uring_enter, state->ring, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc >= 0 || errno != EINTR)
+            return rc;
+    }
+}
+
+
+static void write_synchronously (uring_pack_state* state, uring_buffer* b, int fileDescriptor)
+{
+    while (b->pending_length)
+    {
+        long l = b->offset < 0 ? write (fileDescriptor, b->pending, b->pending_length) :
+                                 pwrite (fileDescriptor, b->pending, b->pending_length, b->offset);
+        if (l < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            state->error = errno;
+            return;
+        }
+        b->pending += l;
+        b->pending_length -= (unsigned long)l;
+        if (b->offset >= 0)
+            b->offset += l;
+    }
+}
+
+
+static void wait_for_all_writes (uring_pack_state* state, int fileDescriptor);
+
+
+static void submit_write (uring_pack_state* state, unsigned int index, int fileDescriptor)
+{
+    uring_buffer* b = state->buffers + index;
+    if (state->ring < 0 || state->no_write_op)
+    {
+        write_synchronously (state, b, fileDescriptor);
+        return;
+    }
+
+    unsigned tail = *state->sq_tail;
+    unsigned slot = tail & *state->sq_mask;
+    struct io_uring_sqe* sqe = state->sqes + slot;
+    memset (sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fileDescriptor;
+    sqe->addr = (unsigned long long)(uintptr_t)b->pending;
+    sqe->len = (unsigned)b->pending_length;
+    sqe->off = b->offset < 0 ? (unsigned long long)-1 : (unsigned long long)b->offset;
+    sqe->user_data = index;
+    state->sq_array[slot] = slot;
+    __atomic_store_n (state->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    if (enter_ring (state, 1, 0) < 1)
+    {
+        /* Nothing was submitted: take the entry back and write here, after the writes in flight */
+        __atomic_store_n (state->sq_tail, tail, __ATOMIC_RELEASE);
+        wait_for_all_writes (state, fileDescriptor);
+        write_synchronously (state, b, fileDescriptor);
+        return;
+    }
+    b->in_flight = true;
+    state->in_flight++;
+}
+
+
+/* Take care of completed writes, resubmitting the rest of short ones */
+static void reap_writes (uring_pack_state* state, bool wait, int fileDescriptor)
+{
+    if (state->ring < 0 || !state->in_flight)
+        return;
+
+    if (wait)
+    {
+        state->waits++;
+        if (enter_ring (state, 0, 1) < 0)
+        {
+            state->error = errno;
+            return;
+        }
+    }
+
+    unsigned head = *state->cq_head;
+    unsigned tail = __atomic_load_n (state->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+        struct io_uring_cqe* cqe = state->cqes + (head & *state->cq_mask);
+        uring_buffer* b = state->buffers + cqe->user_data;
+        b->in_flight = false;
+        state->in_flight--;
+        if (cqe->res < 0)
+        {
+            if (cqe->res == -EINTR || cqe->res == -EAGAIN)
+                b->short_write = true;
+            else if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+            {
+                /* Older kernels have no IORING_OP_WRITE: nothing was written, go on synchronously */
+                state->no_write_op = true;
+                b->short_write = true;
+            }
+            else
+                state->error = -cqe->res;
+            continue;
+        }
+        b->pending += cqe->res;
+        b->pending_length -= (unsigned long)cqe->res;
+        if (b->offset >= 0)
+            b->offset += cqe->res;
+        b->short_write = b->pending_length > 0;
+    }
+    __atomic_store_n (state->cq_head, head, __ATOMIC_RELEASE);
+    if (state->no_write_op && !state->in_flight)
+        close_ring (state);
+
+    for (unsigned int i = 0; i < state->buffer_count; i++)
+    {
+        if (state->buffers[i].short_write)
+        {
+            state->buffers[i].short_write = false;
+            submit_write (state, i, fileDescriptor);
+        }
+    }
+}
+
+
+static void wait_for_all_writes (uring_pack_state* state, int fileDescriptor)
+{
+    while (state->in_flight && state->ring >= 0)
+    {
+        unsigned int before = state->in_flight;
+        reap_writes (state, true, fileDescriptor);
+        if (state->in_flight == before && state->error)
+            return;
+    }
+}
+
+
+
+/*****************************************  URING FILE PACK CONTEXT  ****************************/
+
+
+/* Submit the contents before the barrier and go on in a free buffer with room for more */
+static int switch_buffer (uring_file_pack_context* upc, unsigned long more)
+{
+    cw_pack_context* pc = &upc->pc;
+    uring_pack_state* state = upc->state;
+    uint8_t *bStart = upc->barrier ? upc->barrier : pc->current;
+    unsigned long kept = (unsigned long)(pc->current - bStart);
+    unsigned int next = state->current;
+
+    if (bStart > pc->start)
+    {
+        if (state->file_offset < 0)
+            wait_for_all_writes (state, upc->fileDescriptor);
+
+        uring_buffer* b = state->buffers + state->current;
+        b->pending = pc->start;
+        b->pending_length = (unsigned long)(bStart - pc->start);
+        b->offset = state->file_offset;
+        if (state->file_offset >= 0)
+            state->file_offset += (long long)b->pending_length;
+        submit_write (state, state->current, upc->fileDescriptor);
+
+        reap_writes (state, false, upc->fileDescriptor);
+        for (;;)
+        {
+            for (next = 0; next < state->buffer_count; next++)
+                if (next != state->current && !state->buffers[next].in_flight)
+                    break;
+            if (next < state->buffer_count || state->error)
+                break;
+            reap_writes (state, true, upc->fileDescriptor);
+        }
+    }
+    if (state->error)
+    {
+        pc->err_no = state->error;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+
+    uring_buffer* nb = state->buffers + next;
+    if (nb->length < kept + more)
+    {
+        unsigned long length = nb->length;
+        while (length < kept + more)
+            length = 2 * length;
+        uint8_t* data = (uint8_t*)realloc (nb->data, length);
+        if (!data)
+            return CWP_RC_BUFFER_OVERFLOW;
+        if (next == state->current)
+            bStart = data + (bStart - nb->data);
+        nb->data = data;
+        nb->length = length;
+    }
+    if (kept && nb->data != bStart)
+        memcpy (nb->data, bStart, kept);
+
+    state->current = next;
+    pc->start = nb->data;
+    pc->current = pc->start + kept;
+    pc->end = pc->start + nb->length;
+    if (upc->barrier)
+        upc->barrier = pc->start;
+    return CWP_RC_OK;
+}
+
+
+static int handle_uring_pack_overflow (cw_pack_context* pc, unsigned long more)
+{
+    return switch_buffer ((uring_file_pack_context*)pc, more);
+}
+
+
+static int flush_uring_pack_context (cw_pack_context* pc)
+{
+    uring_file_pack_context* upc = (uring_file_pack_context*)pc;
+    int rc = switch_buffer (upc, 0);
+    if (rc != CWP_RC_OK)
+        return rc;
+
+    wait_for_all_writes (upc->state, upc->fileDescriptor);
+    if (upc->state->error)
+    {
+        pc->err_no = upc->state->error;
+        return CWP_RC_ERROR_IN_HANDLER;
+    }
+    return CWP_RC_OK;
+}
+
+
+void init_uring_file_pack_context (uring_file_pack_context* upc, unsigned long buffer_length, unsigned int buffer_count, int fileDescriptor)
+{
+    buffer_length = buffer_length > 32 ? buffer_length : 65536;
+    buffer_count = buffer_count > 2 ? buffer_count : 2;
+
+    uring_pack_state* state = (uring_pack_state*)calloc (1, sizeof(uring_pack_state));
+    uring_buffer* buffers = (uring_buffer*)calloc (buffer_count, sizeof(uring_buffer));
+    bool allocated = state && buffers;
+    for (unsigned int i = 0; allocated && i < buffer_count; i++)
+    {
+        buffers[i].data = (uint8_t*)malloc (buffer_length);
+        buffers[i].length = buffer_length;
+        allocated = buffers[i].data != NULL;
+    }
+    if (!allocated)
+    {
+        for (unsigned int i = 0; buffers && i < buffer_count; i++)
+            free (buffers[i].data);
+        free (buffers);
+        free (state);
+        upc->state = NULL;
+        upc->pc.return_code = CWP_RC_MALLOC_ERROR;
+        return;
+    }
+
+    state->buffers = buffers;
+    state->buffer_count = buffer_count;
+    state->ring = -1;
+    setup_ring (state, buffer_count);
+
+    int flags = fcntl (fileDescriptor, F_GETFL);
+    state->file_offset = flags < 0 || (flags & O_APPEND) ? -1 : lseek (fileDescriptor, 0, SEEK_CUR);
+
+    upc->fileDescriptor = fileDescriptor;
+    upc->barrier = NULL;
+    upc->state = state;
+
+    cw_pack_context_init ((cw_pack_context*)upc, buffers[0].data, buffer_length, &handle_uring_pack_overflow);
+    cw_pack_set_flush_handler ((cw_pack_context*)upc, &flush_uring_pack_context);
+}
+
+
+void uring_file_pack_context_set_barrier (uring_file_pack_context* upc)
+{
+    upc->barrier = upc->pc.current;
+}
+
+
+void uring_file_pack_context_release_barrier (uring_file_pack_context* upc)
+{
+    upc->barrier = NULL;
+}
+
+
+bool uring_file_pack_context_is_async (uring_file_pack_context* upc)
+{
+    return upc->state && upc->state->ring >= 0;
+}
+
+
+unsigned long uring_file_pack_context_waits (uring_file_pack_context* upc)
+{
+    return upc->state ? upc->state->waits : 0;
+}
+
+
+void terminate_uring_file_pack_context (uring_file_pack_context* upc)
+{
+    cw_pack_context* pc = (cw_pack_context*)upc;
+    uring_pack_state* state = upc->state;
+    if (!state)
+        return;
+
+    upc->barrier = NULL;
+    cw_pack_flush (pc);
+    wait_for_all_writes (state, upc->fileDescriptor);
+    if (state->file_offset >= 0)
+        lseek (upc->fileDescriptor, state->file_offset, SEEK_SET);
+
+    close_ring (state);
+    for (unsigned int i = 0; i < state->buffer_count; i++)
+        free (state->buffers[i].data);
+    free (state->buffers);
+    free (state);
+    upc->state = NULL;
+}
@@ -0,0 +1,65 @@
+/*      CWPack/goodies - uring_context.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef uring_context_h
+#define uring_context_h
+
+#include "cwpack.hpp"
+
+
+/*****************************************  URING FILE PACK CONTEXT  ****************************/
+
+/*
+ * A file pack context that writes asynchronously with io_uring. When a buffer is full it is
+ * submitted for writing and packing goes on in the next free buffer, so the packer waits
+ * only when all buffers are in flight. The barrier works as in file_pack_context: from the
+ * barrier on, the contents are kept in the buffer and carried over to the next one.
+ * Where io_uring isn't available, a submission fails, or the kernel rejects IORING_OP_WRITE,
+ * buffers are written synchronously at their own file offset.
+ */
+
+struct uring_pack_state;
+
+typedef struct
+{
+    cw_pack_context         pc;
+    int                     fileDescriptor;
+    uint8_t                 *barrier;
+    struct uring_pack_state *state;
+} uring_file_pack_context;
+
+
+void init_uring_file_pack_context (uring_file_pack_context* upc, unsigned long buffer_length, unsigned int buffer_count, int fileDescriptor);
+
+void uring_file_pack_context_set_barrier (uring_file_pack_context* upc);
+void uring_file_pack_context_release_barrier (uring_file_pack_context* upc);
+
+/* True if the context writes with io_uring, false if it fell back to write() */
+bool uring_file_pack_context_is_async (uring_file_pack_context* upc);
+
+/* Number of times the packer had to wait for a buffer to be written */
+unsigned long uring_file_pack_context_waits (uring_file_pack_context* upc);
+
+/* Write everything before the barrier and wait until it is written */
+void terminate_uring_file_pack_context (uring_file_pack_context* upc);
+
+#endif /* uring_context_h */
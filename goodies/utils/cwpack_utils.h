@@ -24,45 +24,400 @@
 #define CWPack_utils_H__
 
 
+#include <cmath>
+
 #include "cwpack.hpp"
 
 /*******************************   P A C K   **********************************/
 
-#define cw_pack_cstr(context,string) cw_pack_str (context, string, (uint32)strlen(string))
+#define cw_pack_cstr(context,string) cw_pack_str (context, string, (uint32_t)strlen(string))
+
+/* Pack as signed if precision isn't destroyed */
+template <class Sink>
+inline void cw_pack_float_opt (cwpack::basic_context<Sink>* pack_context, float f)
+{
+    int i = (int)f;
+    if ((i == f) && (i >= INT16_MIN) && (i <= UINT16_MAX))
+        cw_pack_signed(pack_context, i);
+    else
+        cw_pack_float (pack_context, f);
+}
 
-void cw_pack_float_opt (cw_pack_context* pack_context, float f);    /* Pack as signed if precision isn't destroyed */
-void cw_pack_double_opt (cw_pack_context* pack_context, double d);  /* Pack as signed or float if precision isn't destroyed */
+/* Pack as signed or float if precision isn't destroyed */
+template <class Sink>
+inline void cw_pack_double_opt (cwpack::basic_context<Sink>* pack_context, double d)
+{
+    int i = (int)d;
+    if ((i == d) && (i >= INT32_MIN) && (i <= UINT32_MAX))
+        cw_pack_signed(pack_context, i);
+    else
+    {
+        float f = (float)d;
+        if (f == d)
+            cw_pack_float (pack_context, f);
+        else
+            cw_pack_double (pack_context, d);
+    }
+}
 #define  cw_pack_real cw_pack_double_opt                            /* Backward compatibility */
 
 #define cw_pack_timespec (pack_contextptr, timespecptr) cw_pack_time ((pack_contextptr), (int64_t)((timespecptr)->tv_sec), (uint32_t)((timespecptr)->tv_nsec))
 
-void cw_pack_time_interval (cw_pack_context* pack_context, double ti); /* ti is seconds relative epoch */
+/* ti is seconds relative epoch */
+template <class Sink>
+inline void cw_pack_time_interval (cwpack::basic_context<Sink>* pack_context, double ti)
+{
+    int64_t  sec = std::floor(ti);
+    uint32_t nsec = (uint32_t)((ti - (double)sec) * 1000000000.0);
+    cw_pack_time(pack_context, sec, nsec);
+}
 
 /*****************************   U N P A C K   ********************************/
 
-void cw_unpack_next_nil (cw_unpack_context* unpack_context);
-bool cw_unpack_next_boolean (cw_unpack_context* unpack_context);
+template <class Source>
+inline float cw_unpack_next_float (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)        return 0;
 
-int64_t cw_unpack_next_signed64 (cw_unpack_context* unpack_context);
-int32_t cw_unpack_next_signed32 (cw_unpack_context* unpack_context);
-int16_t cw_unpack_next_signed16 (cw_unpack_context* unpack_context);
-int8_t cw_unpack_next_signed8 (cw_unpack_context* unpack_context);
+    switch (unpack_context->item.type) {
+        case cwpack::item_type::POSITIVE_INTEGER:     return unpack_context->item.as.u64;
+        case cwpack::item_type::NEGATIVE_INTEGER:     return unpack_context->item.as.i64;
+        case cwpack::item_type::FLOAT:                return unpack_context->item.as.real;
+        case cwpack::item_type::DOUBLE:               return (float)unpack_context->item.as.long_real;
+        default:                            unpack_context->return_code = CWP_RC_TYPE_ERROR;
+                                            return 0;
+    }
+}
 
-uint64_t cw_unpack_next_unsigned64 (cw_unpack_context* unpack_context);
-uint32_t cw_unpack_next_unsigned32 (cw_unpack_context* unpack_context);
-uint16_t cw_unpack_next_unsigned16 (cw_unpack_context* unpack_context);
-uint8_t cw_unpack_next_unsigned8 (cw_unpack_context* unpack_context);
+template <class Source>
+inline double cw_unpack_next_double (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)        return 0;
 
-float cw_unpack_next_float (cw_unpack_context* unpack_context);
-double cw_unpack_next_double (cw_unpack_context* unpack_context);
-double cw_unpack_next_time_interval (cw_unpack_context* unpack_context);
-#define cw_unpack_next_real cw_unpack_next_double                           /* Backward compatibility */
+    switch (unpack_context->item.type) {
+        case cwpack::item_type::POSITIVE_INTEGER:     return unpack_context->item.as.u64;
+        case cwpack::item_type::NEGATIVE_INTEGER:     return unpack_context->item.as.i64;
+        case cwpack::item_type::FLOAT:                return unpack_context->item.as.real;
+        case cwpack::item_type::DOUBLE:               return unpack_context->item.as.long_real;
+        default:                            unpack_context->return_code = CWP_RC_TYPE_ERROR;
+                                            return 0;
+    }
+}
+
+template <class Source>
+inline void cw_unpack_next_nil (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return;
+    if (unpack_context->item.type == cwpack::item_type::NIL)
+        return;
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return;
+}
+
+
+
+template <class Source>
+inline bool cw_unpack_next_boolean (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return false;
+
+    if (unpack_context->item.type == cwpack::item_type::BOOLEAN)
+        return unpack_context->item.as.boolean;
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return false;
+}
+
+
+template <class Source>
+inline int64_t cw_unpack_next_signed64 (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::POSITIVE_INTEGER)
+    {
+        if (unpack_context->item.as.u64 <= INT64_MAX)
+            return unpack_context->item.as.i64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+
+    if (unpack_context->item.type == cwpack::item_type::NEGATIVE_INTEGER)
+        return unpack_context->item.as.i64;
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+template <class Source>
+inline int32_t cw_unpack_next_signed32 (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::POSITIVE_INTEGER)
+    {
+        if (unpack_context->item.as.u64 <= INT32_MAX)
+            return (int)unpack_context->item.as.i64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+    if (unpack_context->item.type == cwpack::item_type::NEGATIVE_INTEGER)
+    {
+        if (unpack_context->item.as.i64 >= INT32_MIN)
+            return (int)unpack_context->item.as.i64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+template <class Source>
+inline int16_t cw_unpack_next_signed16 (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::POSITIVE_INTEGER)
+    {
+        if (unpack_context->item.as.u64 <= INT16_MAX)
+            return (int16_t)unpack_context->item.as.i64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+    if (unpack_context->item.type == cwpack::item_type::NEGATIVE_INTEGER)
+    {
+        if (unpack_context->item.as.i64 >= INT16_MIN)
+            return (int16_t)unpack_context->item.as.i64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+template <class Source>
+inline int8_t cw_unpack_next_signed8 (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::POSITIVE_INTEGER)
+    {
+        if (unpack_context->item.as.u64 <= INT8_MAX)
+            return (int8_t)unpack_context->item.as.i64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+    if (unpack_context->item.type == cwpack::item_type::NEGATIVE_INTEGER)
+    {
+        if (unpack_context->item.as.i64 >= INT8_MIN)
+            return (int8_t)unpack_context->item.as.i64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+
+template <class Source>
+inline uint64_t cw_unpack_next_unsigned64 (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::POSITIVE_INTEGER)
+    {
+        return unpack_context->item.as.u64;
+    }
 
-unsigned int cw_unpack_next_str_lengh (cw_unpack_context* unpack_context);
-unsigned int cw_unpack_next_bin_lengh (cw_unpack_context* unpack_context);
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
 
-unsigned int cw_unpack_next_array_size(cw_unpack_context* unpack_context);
-unsigned int cw_unpack_next_map_size(cw_unpack_context* unpack_context);
+
+template <class Source>
+inline uint32_t cw_unpack_next_unsigned32 (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::POSITIVE_INTEGER)
+    {
+        if (unpack_context->item.as.u64 <= UINT32_MAX)
+            return (uint32_t)unpack_context->item.as.u64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+template <class Source>
+inline uint16_t cw_unpack_next_unsigned16 (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::POSITIVE_INTEGER)
+    {
+        if (unpack_context->item.as.u64 <= UINT16_MAX)
+            return (uint16_t)unpack_context->item.as.u64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+template <class Source>
+inline uint8_t cw_unpack_next_unsigned8 (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)
+        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::POSITIVE_INTEGER)
+    {
+        if (unpack_context->item.as.u64 <= UINT8_MAX)
+            return (uint8_t)unpack_context->item.as.u64;
+        else
+        {
+            unpack_context->return_code = CWP_RC_VALUE_ERROR;
+            return 0;
+        }
+    }
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+template <class Source>
+inline double cw_unpack_next_time_interval (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::TIMESTAMP)
+    {
+        return (double)unpack_context->item.as.time.tv_sec + (double)unpack_context->item.as.time.tv_nsec/1000000000;
+    }
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+template <class Source>
+inline unsigned int cw_unpack_next_str_lengh (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::STR)
+        return unpack_context->item.as.str.length;
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+template <class Source>
+inline unsigned int cw_unpack_next_bin_lengh (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::BIN)
+        return unpack_context->item.as.bin.length;
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+
+template <class Source>
+inline unsigned int cw_unpack_next_array_size (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::ARRAY)
+        return unpack_context->item.as.array.size;
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+template <class Source>
+inline unsigned int cw_unpack_next_map_size (cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    cw_unpack_next (unpack_context);
+    if (unpack_context->return_code)        return 0;
+
+    if (unpack_context->item.type == cwpack::item_type::MAP)
+        return unpack_context->item.as.map.size;
+
+    unpack_context->return_code = CWP_RC_TYPE_ERROR;
+    return 0;
+}
+
+#define cw_unpack_next_real cw_unpack_next_double                           /* Backward compatibility */
 
 #endif  /* CWPack_utils_H__ */
 
@@ -0,0 +1,280 @@
+/*      CWPack/goodies - cwpack_view.cpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "cwpack_view.h"
+
+namespace cwpack {
+
+
+/*****************************************  DOCUMENT  *******************************************/
+
+document::children* document::container (unsigned long offset) const
+{
+    auto found = cache.find(offset);
+    if (found != cache.end())
+        return &found->second;
+
+    const lead_byte_descriptor& d = lead_byte_table[buffer[offset]];
+    if (d.type != item_type::ARRAY && d.type != item_type::MAP)
+        return nullptr;
+
+    cw_static_unpack_context uc{};
+    cw_unpack_context_init (&uc, buffer + offset, length - offset);
+    cw_unpack_next (&uc);
+    if (uc.return_code)
+        return nullptr;
+
+    children& c = cache[offset];
+    c.count = d.container_multiplier * (unsigned long)uc.item.as.array.size;
+    if (c.count)
+        c.offsets.push_back((unsigned long)(uc.current - buffer));
+    return &c;
+}
+
+
+/* Find the offsets up to child n. A malformed container is cut at the last good child. */
+bool document::reach (children* c, unsigned long n) const
+{
+    if (n >= c->count)
+        return false;
+
+    while (c->offsets.size() <= n)
+    {
+        unsigned long last = c->offsets.back();
+        cw_static_unpack_context uc{};
+        cw_unpack_context_init (&uc, buffer + last, length - last);
+        cw_skip_items (&uc, 1);
+        if (uc.return_code || uc.current == uc.end)
+        {
+            c->count = c->offsets.size();
+            return false;
+        }
+        c->offsets.push_back((unsigned long)(uc.current - buffer));
+    }
+    return true;
+}
+
+
+
+/*****************************************  VIEW  ***********************************************/
+
+bool view::decode (cw_static_unpack_context* unpack_context) const
+{
+    if (!doc)
+        return false;
+
+    cw_unpack_context_init (unpack_context, doc->buffer + offset, doc->length - offset);
+    cw_unpack_next (unpack_context);
+    return unpack_context->return_code == CWP_RC_OK;
+}
+
+
+view view::child (unsigned long n) const
+{
+    if (!doc)
+        return view();
+
+    document::children* c = doc->container(offset);
+    if (!c || !doc->reach(c, n))
+        return view();
+
+    return view(doc, c->offsets[n]);
+}
+
+
+item_type view::type () const
+{
+    if (!doc)
+        return item_type::NOT_AN_ITEM;
+
+    const lead_byte_descriptor& d = lead_byte_table[doc->buffer[offset]];
+    if (d.type != item_type::EXT)
+        return d.type;
+
+    cw_static_unpack_context uc{};
+    return decode(&uc) ? uc.item.type : item_type::NOT_AN_ITEM;
+}
+
+
+unsigned long view::size () const
+{
+    cw_static_unpack_context uc{};
+    if (!decode(&uc))
+        return 0;
+
+    switch (uc.item.type)
+    {
+        case item_type::ARRAY:
+        case item_type::MAP:                return uc.item.as.array.size;
+        case item_type::STR:
+        case item_type::BIN:                return uc.item.as.str.length;
+        case item_type::TIMESTAMP:          /* decoded to time, so the length is taken from the lead byte */
+        {
+            const lead_byte_descriptor& d = lead_byte_table[doc->buffer[offset]];
+            return d.length_width ? 12 : d.payload_length;
+        }
+        default:
+            if (uc.item.type <= item_type::MAX_USER_EXT)
+                return uc.item.as.ext.length;
+            return 0;
+    }
+}
+
+
+view view::operator[] (std::string_view key) const
+{
+    if (type() != item_type::MAP)
+        return view();
+
+    document::children* c = doc->container(offset);
+    for (unsigned long n = 0; c && doc->reach(c, n + 1); n += 2)
+    {
+        cw_static_unpack_context uc{};
+        unsigned long key_offset = c->offsets[n];
+        cw_unpack_context_init (&uc, doc->buffer + key_offset, doc->length - key_offset);
+        cw_unpack_next (&uc);
+        if (uc.return_code == CWP_RC_OK && uc.item.type == item_type::STR &&
+            uc.item.as.str.length == key.size() && !memcmp(uc.item.as.str.start, key.data(), key.size()))
+        {
+            return view(doc, c->offsets[n + 1]);
+        }
+    }
+    return view();
+}
+
+
+view view::operator[] (size_t index) const
+{
+    if (type() != item_type::ARRAY)
+        return view();
+
+    return child(index);
+}
+
+
+view view::key (size_t index) const
+{
+    if (type() != item_type::MAP)
+        return view();
+
+    return child(2 * index);
+}
+
+
+view view::value (size_t index) const
+{
+    if (type() != item_type::MAP)
+        return view();
+
+    return child(2 * index + 1);
+}
+
+
+bool view::as_boolean (bool otherwise) const
+{
+    cw_static_unpack_context uc{};
+    if (!decode(&uc) || uc.item.type != item_type::BOOLEAN)
+        return otherwise;
+
+    return uc.item.as.boolean;
+}
+
+
+int64_t view::as_int64 (int64_t otherwise) const
+{
+    cw_static_unpack_context uc{};
+    if (!decode(&uc))
+        return otherwise;
+
+    if (uc.item.type == item_type::NEGATIVE_INTEGER)
+        return uc.item.as.i64;
+    if (uc.item.type == item_type::POSITIVE_INTEGER && uc.item.as.u64 <= INT64_MAX)
+        return uc.item.as.i64;
+    return otherwise;
+}
+
+
+uint64_t view::as_uint64 (uint64_t otherwise) const
+{
+    cw_static_unpack_context uc{};
+    if (!decode(&uc) || uc.item.type != item_type::POSITIVE_INTEGER)
+        return otherwise;
+
+    return uc.item.as.u64;
+}
+
+
+double view::as_double (double otherwise) const
+{
+    cw_static_unpack_context uc{};
+    if (!decode(&uc))
+        return otherwise;
+
+    switch (uc.item.type)
+    {
+        case item_type::DOUBLE:             return uc.item.as.long_real;
+        case item_type::FLOAT:              return uc.item.as.real;
+        case item_type::POSITIVE_INTEGER:   return (double)uc.item.as.u64;
+        case item_type::NEGATIVE_INTEGER:   return (double)uc.item.as.i64;
+        default:                            return otherwise;
+    }
+}
+
+
+std::string_view view::as_string () const
+{
+    cw_static_unpack_context uc{};
+    if (!decode(&uc) || uc.item.type != item_type::STR)
+        return std::string_view();
+
+    return std::string_view((const char*)uc.item.as.str.start, uc.item.as.str.length);
+}
+
+
+std::span<const uint8_t> view::as_binary () const
+{
+    cw_static_unpack_context uc{};
+    if (!decode(&uc) || uc.item.type != item_type::BIN)
+        return std::span<const uint8_t>();
+
+    return std::span<const uint8_t>((const uint8_t*)uc.item.as.bin.start, uc.item.as.bin.length);
+}
+
+
+std::span<const uint8_t> view::raw () const
+{
+    if (!doc)
+        return std::span<const uint8_t>();
+
+    cw_static_unpack_context uc{};
+    cw_unpack_context_init (&uc, doc->buffer + offset, doc->length - offset);
+    cw_skip_items (&uc, 1);
+    if (uc.return_code)
+        return std::span<const uint8_t>();
+
+    return std::span<const uint8_t>(uc.start, uc.current);
+}
+
+}
@@ -0,0 +1,122 @@
+/*      CWPack/goodies - cwpack_view.h   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef cwpack_view_h
+#define cwpack_view_h
+
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "cwpack.hpp"
+
+
+/*****************************************  DOCUMENT VIEW  **************************************/
+
+/*
+ * A read only view of a packed buffer. Nothing is decoded until it is asked for, and strings
+ * and binaries are returned as string_view/span into the buffer. The offsets of the children
+ * of a container are found with cw_skip_items as far as a lookup needs them, and kept by the
+ * document, so the next lookup in the same container starts where the last one stopped.
+ *
+ * A missing item (wrong key, index out of range, wrong type of container) gives a view that
+ * doesn't exist. Indexing it gives more views that don't exist, and its getters return their
+ * default value. A document and its views are not thread safe.
+ */
+
+namespace cwpack {
+
+class view;
+
+class document {
+public:
+    document (const void* data, unsigned long length) : buffer((const uint8_t*)data), length(length) {}
+    document (const document&) = delete;
+    document& operator= (const document&) = delete;
+
+    view root () const;
+
+    const uint8_t* data () const { return buffer; }
+    unsigned long size () const { return length; }
+
+private:
+    friend class view;
+
+    struct children {
+        std::vector<unsigned long>  offsets;        /* of the children found so far */
+        unsigned long               count;          /* children in the container, keys and values counted separately */
+    };
+
+    children* container (unsigned long offset) const;
+    bool reach (children* c, unsigned long n) const;
+
+    const uint8_t*                                          buffer;
+    unsigned long                                           length;
+    mutable std::unordered_map<unsigned long, children>     cache;
+};
+
+
+class view {
+public:
+    view () : doc(nullptr), offset(0) {}
+
+    bool exists () const { return doc != nullptr; }
+    item_type type () const;
+    bool is_nil () const { return type() == item_type::NIL; }
+
+    /* Elements of an array, pairs of a map, bytes of a str, bin or ext */
+    unsigned long size () const;
+
+    view operator[] (std::string_view key) const;
+    view operator[] (size_t index) const;
+    view key (size_t index) const;
+    view value (size_t index) const;
+
+    bool as_boolean (bool otherwise = false) const;
+    int64_t as_int64 (int64_t otherwise = 0) const;
+    uint64_t as_uint64 (uint64_t otherwise = 0) const;
+    double as_double (double otherwise = 0.0) const;
+    std::string_view as_string () const;
+    std::span<const uint8_t> as_binary () const;
+
+    /* The packed bytes of the item and all its children */
+    std::span<const uint8_t> raw () const;
+
+private:
+    friend class document;
+    view (const document* doc, unsigned long offset) : doc(doc), offset(offset) {}
+    bool decode (cw_static_unpack_context* unpack_context) const;
+    view child (unsigned long n) const;
+
+    const document*     doc;
+    unsigned long       offset;
+};
+
+inline view document::root () const
+{
+    return length ? view(this, 0) : view();
+}
+
+}
+
+#endif /* cwpack_view_h */
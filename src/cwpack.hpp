@@ -26,9 +26,13 @@
 #include <ctime>
 #include <cstring>
 
+#include <array>
 #include <functional>
+#include <new>
+#include <utility>
 
 #include "cwpack_internals.hpp"
+#include "cwpack_simd.hpp"
 
 /*******************************   Return Codes   *****************************/
 
@@ -46,6 +50,7 @@ enum CWP_RC {
     CWP_RC_TYPE_ERROR              = -10,
     CWP_RC_VALUE_ERROR             = -11,
     CWP_RC_WRONG_TIMESTAMP_LENGTH  = -12,
+    CWP_RC_CHECKSUM_ERROR          = -13,
 };
 
 namespace cwpack {
@@ -67,24 +72,28 @@ static int test_byte_order(void)
     return CWP_RC_OK;
 }
 
-struct context {
-public:
-    using overflow_handler = std::function<int (context*, unsigned long)>;
-    using flush_handler = std::function<int (context*)>;
+/*
+ * A pack context is a basic_context templated over a sink. The sink is the compile time
+ * policy that decides what happens when the buffer is full (overflow) and when a flush
+ * is requested. Both members are called with the context as argument and are inlined
+ * into the pack routines, so a sink without state adds nothing to the context.
+ */
 
-    context() = default;
-    context(uint8_t* data, unsigned long length, overflow_handler overflow_handler)
+template <class Sink>
+struct basic_context : public Sink {
+public:
+    basic_context() = default;
+    basic_context(uint8_t* data, unsigned long length, Sink sink = Sink{})
         :
+            Sink{std::move(sink)},
             current{data},
             start{data},
             end{data + length},
             be_compatible{false},
             return_code{test_byte_order()},
-            err_no{},
-            handle_pack_overflow{overflow_handler},
-            handle_flush{}
+            err_no{}
     {}
-    ~context() = default;
+    ~basic_context() = default;
 
     uint8_t*                current;
     uint8_t*                start;
@@ -92,22 +101,59 @@ public:
     bool                    be_compatible;
     int                     return_code;
     int                     err_no;          /* handlers can save error here */
-    std::function<int (context*, unsigned long)> handle_pack_overflow;
-    std::function<int (context*)> handle_flush;
+};
+
+/* Sink for a fixed memory buffer. Overflow is an error and there is nothing to flush. */
+struct static_buffer_sink {
+    template <class Context>
+    int overflow (Context*, unsigned long) { return CWP_RC_BUFFER_OVERFLOW; }
+    template <class Context>
+    int flush (Context*) { return CWP_RC_ILLEGAL_CALL; }
+};
+
+struct function_sink;
+using context = basic_context<function_sink>;
+using static_context = basic_context<static_buffer_sink>;
+
+/* Sink calling handlers given at runtime. This is the sink of the classic cw_pack_context. */
+struct function_sink {
+    using overflow_handler = std::function<int (context*, unsigned long)>;
+    using flush_handler = std::function<int (context*)>;
+
+    int overflow (context* pc, unsigned long more)
+    {
+        return handle_pack_overflow ? handle_pack_overflow(pc, more) : CWP_RC_BUFFER_OVERFLOW;
+    }
+    int flush (context* pc)
+    {
+        return handle_flush ? handle_flush(pc) : CWP_RC_ILLEGAL_CALL;
+    }
+
+    overflow_handler        handle_pack_overflow;
+    flush_handler           handle_flush;
 };
 
 }
 
 using cw_pack_context = cwpack::context;
+using cw_static_pack_context = cwpack::static_context;
 typedef int (*pack_flush_handler)(cw_pack_context*);
 
 inline static int cw_pack_context_init (cw_pack_context* pack_context, void* data, unsigned long length, cwpack::context::overflow_handler hpo) {
-    new (pack_context) cw_pack_context{reinterpret_cast<uint8_t*>(data), length, hpo};
+    new (pack_context) cw_pack_context{reinterpret_cast<uint8_t*>(data), length, cwpack::function_sink{hpo, {}}};
 
     return pack_context->err_no;
 }
 
-inline static void cw_pack_set_compatibility (cw_pack_context* pack_context, bool be_compatible) {
+template <class Sink>
+inline static int cw_pack_context_init (cwpack::basic_context<Sink>* pack_context, void* data, unsigned long length, Sink sink = Sink{}) {
+    new (pack_context) cwpack::basic_context<Sink>{reinterpret_cast<uint8_t*>(data), length, std::move(sink)};
+
+    return pack_context->err_no;
+}
+
+template <class Sink>
+inline static void cw_pack_set_compatibility (cwpack::basic_context<Sink>* pack_context, bool be_compatible) {
     pack_context->be_compatible = be_compatible;
 }
 
@@ -115,23 +161,23 @@ inline static void cw_pack_set_flush_handler (cw_pack_context* pack_context, pac
     pack_context->handle_flush = handle_flush;
 }
 
-inline static void cw_pack_flush (cw_pack_context* pack_context)
+template <class Sink>
+inline static void cw_pack_flush (cwpack::basic_context<Sink>* pack_context)
 {
     if (pack_context->return_code == CWP_RC_OK)
-        pack_context->return_code =
-            pack_context->handle_flush ?
-                pack_context->handle_flush(pack_context) :
-                CWP_RC_ILLEGAL_CALL;
+        pack_context->return_code = pack_context->flush(pack_context);
 }
 
-inline static void cw_pack_nil(cw_pack_context* pack_context)
+template <class Sink>
+inline static void cw_pack_nil(cwpack::basic_context<Sink>* pack_context)
 {
     if (pack_context->return_code)
         return;
 
     tryMove0(0xc0);
 }
-inline static void cw_pack_true (cw_pack_context* pack_context)
+template <class Sink>
+inline static void cw_pack_true (cwpack::basic_context<Sink>* pack_context)
 {
     if (pack_context->return_code)
         return;
@@ -140,14 +186,16 @@ inline static void cw_pack_true (cw_pack_context* pack_context)
 }
 
 
-inline void cw_pack_false (cw_pack_context* pack_context)
+template <class Sink>
+inline void cw_pack_false (cwpack::basic_context<Sink>* pack_context)
 {
     if (pack_context->return_code)
         return;
 
     tryMove0(0xc2);
 }
-inline void cw_pack_boolean(cw_pack_context* pack_context, bool b)
+template <class Sink>
+inline void cw_pack_boolean(cwpack::basic_context<Sink>* pack_context, bool b)
 {
     if (pack_context->return_code)
         return;
@@ -156,7 +204,8 @@ inline void cw_pack_boolean(cw_pack_context* pack_context, bool b)
 }
 
 
-inline static void cw_pack_signed(cw_pack_context* pack_context, int64_t i)
+template <class Sink>
+inline static void cw_pack_signed(cwpack::basic_context<Sink>* pack_context, int64_t i)
 {
     if (pack_context->return_code)
         return;
@@ -189,7 +238,8 @@ inline static void cw_pack_signed(cw_pack_context* pack_context, int64_t i)
 
     tryMove8(0xd3,i);
 }
-inline static void cw_pack_unsigned(cw_pack_context* pack_context, uint64_t i)
+template <class Sink>
+inline static void cw_pack_unsigned(cwpack::basic_context<Sink>* pack_context, uint64_t i)
 {
     if (pack_context->return_code)
         return;
@@ -210,7 +260,8 @@ inline static void cw_pack_unsigned(cw_pack_context* pack_context, uint64_t i)
     tryMove8(0xcf,i);
 }
 
-inline static void cw_pack_float(cw_pack_context* pack_context, float f)
+template <class Sink>
+inline static void cw_pack_float(cwpack::basic_context<Sink>* pack_context, float f)
 {
     if (pack_context->return_code)
         return;
@@ -219,7 +270,8 @@ inline static void cw_pack_float(cw_pack_context* pack_context, float f)
     tryMove4(0xca,tmp);
 }
 
-inline static void cw_pack_double(cw_pack_context* pack_context, double d)
+template <class Sink>
+inline static void cw_pack_double(cwpack::basic_context<Sink>* pack_context, double d)
 {
     if (pack_context->return_code)
         return;
@@ -229,7 +281,8 @@ inline static void cw_pack_double(cw_pack_context* pack_context, double d)
 }
 /* void cw_pack_real (cw_pack_context* pack_context, double d);   moved to cwpack_utils */
 
-inline static void cw_pack_array_size(cw_pack_context* pack_context, uint32_t n)
+template <class Sink>
+inline static void cw_pack_array_size(cwpack::basic_context<Sink>* pack_context, uint32_t n)
 {
     if (pack_context->return_code)
         return;
@@ -243,7 +296,8 @@ inline static void cw_pack_array_size(cw_pack_context* pack_context, uint32_t n)
     tryMove4(0xdd, n);
 }
 
-inline static void cw_pack_map_size(cw_pack_context* pack_context, uint32_t n)
+template <class Sink>
+inline static void cw_pack_map_size(cwpack::basic_context<Sink>* pack_context, uint32_t n)
 {
     if (pack_context->return_code)
         return;
@@ -257,11 +311,196 @@ inline static void cw_pack_map_size(cw_pack_context* pack_context, uint32_t n)
     tryMove4(0xdf, n);
 }
 
-inline static void cw_pack_str(cw_pack_context* pack_context, const char* v, uint32_t l)
+/*
+ * Containers with deferred size. Begin reserves a 5 byte header that end patches with the
+ * size (elements of an array, pairs of a map). The slot is kept as an offset from start, so
+ * it survives a buffer that is reallocated, but everything from the slot on must stay in
+ * the buffer until end (see the barrier of file_pack_context in goodies/basic-contexts).
+ * With compact, end moves the contents back to give the container its smallest header.
+ * A sink that hands out the packed bytes in segments (a member segment_start, as the iovec
+ * sink in goodies) can't have them moved once a segment is closed after the slot, and compact
+ * end then fails with CWP_RC_ILLEGAL_CALL. Containers nested inside must be ended first.
+ */
+
+namespace cwpack {
+struct container_slot {
+    unsigned long   offset;         /* of the header from start */
+    uint8_t         lead;           /* 0xdd for array, 0xdf for map */
+};
+
+template <class Sink>
+concept segmented_sink = requires (Sink& sink) { sink.segment_start; };
+}
+
+template <class Sink>
+inline static cwpack::container_slot cw_pack_container_begin (cwpack::basic_context<Sink>* pack_context, uint8_t lead)
+{
+    cwpack::container_slot slot = {0, lead};
+    if (pack_context->return_code)
+        return slot;
+
+    uint8_t *p = pack_context->current;
+    if (p + 5 > pack_context->end)
+    {
+        int rc = pack_context->overflow (pack_context, 5);
+        if (rc)
+        {
+            pack_context->return_code = rc;
+            return slot;
+        }
+        p = pack_context->current;
+    }
+    pack_context->current = p + 5;
+    *p = lead;
+    slot.offset = (unsigned long)(p - pack_context->start);
+    return slot;
+}
+
+template <class Sink>
+inline static cwpack::container_slot cw_pack_array_begin (cwpack::basic_context<Sink>* pack_context)
+{
+    return cw_pack_container_begin (pack_context, 0xdd);
+}
+
+template <class Sink>
+inline static cwpack::container_slot cw_pack_map_begin (cwpack::basic_context<Sink>* pack_context)
+{
+    return cw_pack_container_begin (pack_context, 0xdf);
+}
+
+template <class Sink>
+inline static void cw_pack_container_end (cwpack::basic_context<Sink>* pack_context, cwpack::container_slot slot, uint32_t n, bool compact)
+{
+    if (pack_context->return_code)
+        return;
+
+    uint8_t *p = pack_context->start + slot.offset;
+    if (p + 5 > pack_context->current || *p != slot.lead)
+        PACK_ERROR(CWP_RC_ILLEGAL_CALL)
+
+    if (!compact || n >= 65536)
+    {
+        p++;
+        cw_store32(n);
+        return;
+    }
+
+    if constexpr (cwpack::segmented_sink<Sink>)
+        if (pack_context->segment_start > p)
+            PACK_ERROR(CWP_RC_ILLEGAL_CALL)
+
+    unsigned long header = n < 16 ? 1 : 3;
+    memmove (p + header, p + 5, (unsigned long)(pack_context->current - (p + 5)));
+    pack_context->current -= 5 - header;
+    if (n < 16)
+    {
+        *p = (uint8_t)((slot.lead == 0xdd ? 0x90 : 0x80) | n);
+        return;
+    }
+    *p++ = slot.lead - 1;
+    cw_store16(n);
+}
+
+template <class Sink>
+inline static void cw_pack_array_end (cwpack::basic_context<Sink>* pack_context, cwpack::container_slot slot, uint32_t n, bool compact = false)
+{
+    cw_pack_container_end (pack_context, slot, n, compact);
+}
+
+template <class Sink>
+inline static void cw_pack_map_end (cwpack::basic_context<Sink>* pack_context, cwpack::container_slot slot, uint32_t n, bool compact = false)
+{
+    cw_pack_container_end (pack_context, slot, n, compact);
+}
+
+/*
+ * A sink can take large payloads by reference instead of having them copied into the
+ * buffer. It then has a member reference_threshold and a member reference(context, v, l).
+ * cw_pack_str, cw_pack_bin and cw_pack_ext pack only the header of a payload of at least
+ * reference_threshold bytes and hand the payload to the sink.
+ */
+
+namespace cwpack {
+
+template <class Sink>
+concept payload_reference_sink = requires (Sink& sink) { sink.reference_threshold; };
+
+inline unsigned long put_length_field (uint8_t* h, uint32_t l, unsigned long width)
+{
+    for (unsigned long i = 0; i < width; i++)
+        h[i] = (uint8_t)(l >> (8 * (width - 1 - i)));
+    return width;
+}
+
+inline unsigned long str_header (uint8_t* h, uint32_t l, bool be_compatible)
+{
+    if (l < 32)
+    {
+        h[0] = (uint8_t)(0xa0 + l);
+        return 1;
+    }
+    if (l < 256 && !be_compatible)
+    {
+        h[0] = 0xd9;
+        return 1 + put_length_field(h + 1, l, 1);
+    }
+    h[0] = l < 65536 ? 0xda : 0xdb;
+    return 1 + put_length_field(h + 1, l, l < 65536 ? 2 : 4);
+}
+
+inline unsigned long bin_header (uint8_t* h, uint32_t l)
+{
+    h[0] = l < 256 ? 0xc4 : l < 65536 ? 0xc5 : 0xc6;
+    return 1 + put_length_field(h + 1, l, l < 256 ? 1 : l < 65536 ? 2 : 4);
+}
+
+inline unsigned long ext_header (uint8_t* h, int8_t type, uint32_t l)
+{
+    unsigned long length;
+    switch (l)
+    {
+        case 1:     h[0] = 0xd4;    length = 1;     break;
+        case 2:     h[0] = 0xd5;    length = 1;     break;
+        case 4:     h[0] = 0xd6;    length = 1;     break;
+        case 8:     h[0] = 0xd7;    length = 1;     break;
+        case 16:    h[0] = 0xd8;    length = 1;     break;
+        default:    h[0] = l < 256 ? 0xc7 : l < 65536 ? 0xc8 : 0xc9;
+                    length = 1 + put_length_field(h + 1, l, l < 256 ? 1 : l < 65536 ? 2 : 4);
+    }
+    h[length] = (uint8_t)type;
+    return length + 1;
+}
+
+}
+
+template <class Sink>
+inline static void cw_pack_payload_reference (cwpack::basic_context<Sink>* pack_context, const uint8_t* header, unsigned long header_length, const void* v, uint32_t l)
+{
+    uint8_t *p;
+    cw_pack_reserve_space(header_length);
+    memcpy(p,header,header_length);
+    int rc = pack_context->reference (pack_context, v, l);
+    if (rc)
+        PACK_ERROR(rc)
+}
+
+template <class Sink>
+inline static void cw_pack_str(cwpack::basic_context<Sink>* pack_context, const char* v, uint32_t l)
 {
     if (pack_context->return_code)
         return;
 
+    if constexpr (cwpack::payload_reference_sink<Sink>)
+    {
+        if (l >= pack_context->reference_threshold)
+        {
+            uint8_t header[5];
+            unsigned long header_length = cwpack::str_header (header, l, pack_context->be_compatible);
+            cw_pack_payload_reference (pack_context, header, header_length, v, l);
+            return;
+        }
+    }
+
     uint8_t *p;
 
     if (l < 32)             // Fixstr
@@ -295,7 +534,8 @@ inline static void cw_pack_str(cw_pack_context* pack_context, const char* v, uin
     return;
 }
 
-inline static void cw_pack_bin(cw_pack_context* pack_context, const void* v, uint32_t l)
+template <class Sink>
+inline static void cw_pack_bin(cwpack::basic_context<Sink>* pack_context, const void* v, uint32_t l)
 {
     if (pack_context->return_code)
         return;
@@ -306,6 +546,17 @@ inline static void cw_pack_bin(cw_pack_context* pack_context, const void* v, uin
         return;
     }
 
+    if constexpr (cwpack::payload_reference_sink<Sink>)
+    {
+        if (l >= pack_context->reference_threshold)
+        {
+            uint8_t header[5];
+            unsigned long header_length = cwpack::bin_header (header, l);
+            cw_pack_payload_reference (pack_context, header, header_length, v, l);
+            return;
+        }
+    }
+
     uint8_t *p;
 
     if (l < 256)            // Bin 8
@@ -332,7 +583,8 @@ inline static void cw_pack_bin(cw_pack_context* pack_context, const void* v, uin
     return;
 }
 
-inline static void cw_pack_ext (cw_pack_context* pack_context, int8_t type, const void* v, uint32_t l)
+template <class Sink>
+inline static void cw_pack_ext (cwpack::basic_context<Sink>* pack_context, int8_t type, const void* v, uint32_t l)
 {
     if (pack_context->return_code)
         return;
@@ -340,6 +592,17 @@ inline static void cw_pack_ext (cw_pack_context* pack_context, int8_t type, cons
     if (pack_context->be_compatible)
         PACK_ERROR(CWP_RC_ILLEGAL_CALL);
 
+    if constexpr (cwpack::payload_reference_sink<Sink>)
+    {
+        if (l >= pack_context->reference_threshold)
+        {
+            uint8_t header[6];
+            unsigned long header_length = cwpack::ext_header (header, type, l);
+            cw_pack_payload_reference (pack_context, header, header_length, v, l);
+            return;
+        }
+    }
+
     uint8_t *p;
 
     switch (l)
@@ -392,7 +655,8 @@ inline static void cw_pack_ext (cw_pack_context* pack_context, int8_t type, cons
     memcpy(p,v,l);
 }
 
-inline static void cw_pack_time (cw_pack_context* pack_context, int64_t sec, uint32_t nsec)
+template <class Sink>
+inline static void cw_pack_time (cwpack::basic_context<Sink>* pack_context, int64_t sec, uint32_t nsec)
 {
     if (pack_context->return_code)
         return;
@@ -437,7 +701,8 @@ inline static void cw_pack_time (cw_pack_context* pack_context, int64_t sec, uin
     }
 }
 
-inline static void cw_pack_insert (cw_pack_context* pack_context, const void* v, uint32_t l)
+template <class Sink>
+inline static void cw_pack_insert (cwpack::basic_context<Sink>* pack_context, const void* v, uint32_t l)
 {
     uint8_t *p;
     cw_pack_reserve_space(l);
@@ -634,19 +899,150 @@ struct item_as {
 };
 
 
-struct unpack_context {
-public:
-    using underflow_handler = std::function<int (unpack_context*, unsigned long)>;
+/*
+ * Lead byte table. Every lead byte is described once, and cw_unpack_next, cw_skip_items
+ * and cw_look_ahead are all driven by this table instead of each having its own switch.
+ */
 
-    item_as                     item;
-    uint8_t*                    start;
+enum class lead_kind : uint8_t
+{
+    FIXINT,             /* value in immediate */
+    NIL,
+    BOOLEAN,            /* value in immediate */
+    UINT8,
+    UINT16,
+    UINT32,
+    UINT64,
+    INT8,
+    INT16,
+    INT32,
+    INT64,
+    FLOAT,
+    DOUBLE,
+    FIXBLOB,            /* length in payload_length */
+    BLOB8,
+    BLOB16,
+    BLOB32,
+    FIXCONTAINER,       /* size in immediate */
+    CONTAINER16,
+    CONTAINER32,
+    EXT8,
+    EXT16,
+    EXT32,
+    FIXEXT,             /* length in payload_length */
+    ILLEGAL
+};
+
+struct lead_byte_descriptor {
+    item_type   type;                   /* EXT for all ext types, NOT_AN_ITEM if illegal */
+    lead_kind   kind;
+    uint8_t     header_length;          /* lead byte + length field + ext type byte */
+    uint8_t     length_width;           /* width of length or size field, 0 if none */
+    uint8_t     payload_length;         /* payload bytes when not given by a length field */
+    int8_t      immediate;              /* value or container size held in the lead byte */
+    uint8_t     container_multiplier;   /* items per element, 1 for array, 2 for map */
+};
+
+constexpr lead_byte_descriptor describe_lead_byte (uint8_t c)
+{
+    using t = item_type;
+    using k = lead_kind;
+    if (c <= 0x7f)  return {t::POSITIVE_INTEGER, k::FIXINT, 1, 0, 0, (int8_t)c, 0};        // positive fixnum
+    if (c <= 0x8f)  return {t::MAP, k::FIXCONTAINER, 1, 0, 0, (int8_t)(c & 0x0f), 2};     // fixmap
+    if (c <= 0x9f)  return {t::ARRAY, k::FIXCONTAINER, 1, 0, 0, (int8_t)(c & 0x0f), 1};   // fixarray
+    if (c <= 0xbf)  return {t::STR, k::FIXBLOB, 1, 0, (uint8_t)(c & 0x1f), 0, 0};         // fixstr
+    if (c >= 0xe0)  return {t::NEGATIVE_INTEGER, k::FIXINT, 1, 0, 0, (int8_t)c, 0};       // negative fixnum
+    switch (c)
+    {
+        case 0xc0:  return {t::NIL, k::NIL, 1, 0, 0, 0, 0};                                // nil
+        case 0xc2:  return {t::BOOLEAN, k::BOOLEAN, 1, 0, 0, 0, 0};                        // false
+        case 0xc3:  return {t::BOOLEAN, k::BOOLEAN, 1, 0, 0, 1, 0};                        // true
+        case 0xc4:  return {t::BIN, k::BLOB8, 2, 1, 0, 0, 0};                              // bin 8
+        case 0xc5:  return {t::BIN, k::BLOB16, 3, 2, 0, 0, 0};                             // bin 16
+        case 0xc6:  return {t::BIN, k::BLOB32, 5, 4, 0, 0, 0};                             // bin 32
+        case 0xc7:  return {t::EXT, k::EXT8, 3, 1, 0, 0, 0};                               // ext 8
+        case 0xc8:  return {t::EXT, k::EXT16, 4, 2, 0, 0, 0};                              // ext 16
+        case 0xc9:  return {t::EXT, k::EXT32, 6, 4, 0, 0, 0};                              // ext 32
+        case 0xca:  return {t::FLOAT, k::FLOAT, 1, 0, 4, 0, 0};                            // float
+        case 0xcb:  return {t::DOUBLE, k::DOUBLE, 1, 0, 8, 0, 0};                          // double
+        case 0xcc:  return {t::POSITIVE_INTEGER, k::UINT8, 1, 0, 1, 0, 0};                 // unsigned int  8
+        case 0xcd:  return {t::POSITIVE_INTEGER, k::UINT16, 1, 0, 2, 0, 0};                // unsigned int 16
+        case 0xce:  return {t::POSITIVE_INTEGER, k::UINT32, 1, 0, 4, 0, 0};                // unsigned int 32
+        case 0xcf:  return {t::POSITIVE_INTEGER, k::UINT64, 1, 0, 8, 0, 0};                // unsigned int 64
+        case 0xd0:  return {t::NEGATIVE_INTEGER, k::INT8, 1, 0, 1, 0, 0};                  // signed int  8
+        case 0xd1:  return {t::NEGATIVE_INTEGER, k::INT16, 1, 0, 2, 0, 0};                 // signed int 16
+        case 0xd2:  return {t::NEGATIVE_INTEGER, k::INT32, 1, 0, 4, 0, 0};                 // signed int 32
+        case 0xd3:  return {t::NEGATIVE_INTEGER, k::INT64, 1, 0, 8, 0, 0};                 // signed int 64
+        case 0xd4:  return {t::EXT, k::FIXEXT, 2, 0, 1, 0, 0};                             // fixext 1
+        case 0xd5:  return {t::EXT, k::FIXEXT, 2, 0, 2, 0, 0};                             // fixext 2
+        case 0xd6:  return {t::EXT, k::FIXEXT, 2, 0, 4, 0, 0};                             // fixext 4
+        case 0xd7:  return {t::EXT, k::FIXEXT, 2, 0, 8, 0, 0};                             // fixext 8
+        case 0xd8:  return {t::EXT, k::FIXEXT, 2, 0, 16, 0, 0};                            // fixext 16
+        case 0xd9:  return {t::STR, k::BLOB8, 2, 1, 0, 0, 0};                              // str 8
+        case 0xda:  return {t::STR, k::BLOB16, 3, 2, 0, 0, 0};                             // str 16
+        case 0xdb:  return {t::STR, k::BLOB32, 5, 4, 0, 0, 0};                             // str 32
+        case 0xdc:  return {t::ARRAY, k::CONTAINER16, 3, 2, 0, 0, 1};                      // array 16
+        case 0xdd:  return {t::ARRAY, k::CONTAINER32, 5, 4, 0, 0, 1};                      // array 32
+        case 0xde:  return {t::MAP, k::CONTAINER16, 3, 2, 0, 0, 2};                        // map 16
+        case 0xdf:  return {t::MAP, k::CONTAINER32, 5, 4, 0, 0, 2};                        // map 32
+        default:    return {t::NOT_AN_ITEM, k::ILLEGAL, 1, 0, 0, 0, 0};                    // never used
+    }
+}
+
+constexpr std::array<lead_byte_descriptor, 256> make_lead_byte_table ()
+{
+    std::array<lead_byte_descriptor, 256> table{};
+    for (int c = 0; c < 256; c++)
+        table[c] = describe_lead_byte((uint8_t)c);
+    return table;
+}
+
+inline constexpr std::array<lead_byte_descriptor, 256> lead_byte_table = make_lead_byte_table();
+
+static_assert(sizeof(lead_byte_descriptor) == 8, "lead byte descriptor should be 8 bytes");
+
+
+/*
+ * An unpack context is a basic_unpack_context templated over a source. The source is the
+ * compile time policy that refills the buffer (underflow). The members the decoder touches
+ * on every item come first; with a stateless source the context fits in one cache line.
+ */
+
+template <class Source>
+struct basic_unpack_context : public Source {
+public:
     uint8_t*                    current;
     uint8_t*                    end;             /* logical end of buffer */
+    item_as                     item;
+    uint8_t*                    start;
     int                         return_code;
     int                         err_no;          /* handlers can save error here */
-    underflow_handler    handle_unpack_underflow;
 };
 
+/* Source for a memory buffer that is complete from the start. There is nothing to refill. */
+struct static_buffer_source {
+    template <class Context>
+    int underflow (Context*, unsigned long) { return CWP_RC_END_OF_INPUT; }
+};
+
+struct function_source;
+using unpack_context = basic_unpack_context<function_source>;
+using static_unpack_context = basic_unpack_context<static_buffer_source>;
+
+/* Source calling a handler given at runtime. This is the source of the classic cw_unpack_context. */
+struct function_source {
+    using underflow_handler = std::function<int (unpack_context*, unsigned long)>;
+
+    int underflow (unpack_context* uc, unsigned long more)
+    {
+        return handle_unpack_underflow ? handle_unpack_underflow(uc, more) : CWP_RC_END_OF_INPUT;
+    }
+
+    underflow_handler           handle_unpack_underflow;
+};
+
+static_assert(sizeof(static_unpack_context) <= 64, "static unpack context should fit in a cache line");
+
 }
 
 using cwpack_item_types = cwpack::item_type;
@@ -661,6 +1057,7 @@ using cwpack_timespec = cwpack::timespec;
 using cwpack_item = cwpack::item_as;
 
 using cw_unpack_context = cwpack::unpack_context;
+using cw_static_unpack_context = cwpack::static_unpack_context;
 
 inline static int cw_unpack_context_init (cw_unpack_context* unpack_context, const void* data, unsigned long length, cwpack::unpack_context::underflow_handler huu)
 {
@@ -672,7 +1069,19 @@ inline static int cw_unpack_context_init (cw_unpack_context* unpack_context, con
     return unpack_context->return_code;
 }
 
-inline static void cw_unpack_next(cw_unpack_context* unpack_context)
+template <class Source>
+inline static int cw_unpack_context_init (cwpack::basic_unpack_context<Source>* unpack_context, const void* data, unsigned long length, Source source = Source{})
+{
+    static_cast<Source&>(*unpack_context) = std::move(source);
+    unpack_context->start = unpack_context->current = (uint8_t*)data;
+    unpack_context->end = unpack_context->start + length;
+    unpack_context->return_code = cwpack::test_byte_order();
+    unpack_context->err_no = 0;
+    return unpack_context->return_code;
+}
+
+template <class Source>
+inline static void cw_unpack_next(cwpack::basic_unpack_context<Source>* unpack_context)
 {
     if (unpack_context->return_code)
         return;
@@ -687,128 +1096,81 @@ inline static void cw_unpack_next(cw_unpack_context* unpack_context)
         cw_unpack_assert_space(1);
     }
     uint8_t c = *p;
+    const cwpack::lead_byte_descriptor& d = cwpack::lead_byte_table[c];
     constexpr auto buffer_end_return_code = CWP_RC_BUFFER_UNDERFLOW;
-    switch (c)
-    {
-        case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
-        case 0x08: case 0x09: case 0x0a: case 0x0b: case 0x0c: case 0x0d: case 0x0e: case 0x0f:
-        case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17:
-        case 0x18: case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e: case 0x1f:
-        case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27:
-        case 0x28: case 0x29: case 0x2a: case 0x2b: case 0x2c: case 0x2d: case 0x2e: case 0x2f:
-        case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
-        case 0x38: case 0x39: case 0x3a: case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f:
-        case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47:
-        case 0x48: case 0x49: case 0x4a: case 0x4b: case 0x4c: case 0x4d: case 0x4e: case 0x4f:
-        case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x56: case 0x57:
-        case 0x58: case 0x59: case 0x5a: case 0x5b: case 0x5c: case 0x5d: case 0x5e: case 0x5f:
-        case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x66: case 0x67:
-        case 0x68: case 0x69: case 0x6a: case 0x6b: case 0x6c: case 0x6d: case 0x6e: case 0x6f:
-        case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
-        case 0x78: case 0x79: case 0x7a: case 0x7b: case 0x7c: case 0x7d: case 0x7e: case 0x7f:
-                    getDDItem(cwpack::item_type::POSITIVE_INTEGER, i64, c);       return;  // positive fixnum
-        case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x86: case 0x87:
-        case 0x88: case 0x89: case 0x8a: case 0x8b: case 0x8c: case 0x8d: case 0x8e: case 0x8f:
-                    getDDItem(cwpack::item_type::MAP, map.size, c & 0x0f);        return;  // fixmap
-        case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x96: case 0x97:
-        case 0x98: case 0x99: case 0x9a: case 0x9b: case 0x9c: case 0x9d: case 0x9e: case 0x9f:
-                    getDDItem(cwpack::item_type::ARRAY, array.size, c & 0x0f);    return;  // fixarray
-        case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6: case 0xa7:
-        case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf:
-        case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7:
-        case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
-                    getDDItem(cwpack::item_type::STR, str.length, c & 0x1f);              // fixraw
-                    cw_unpack_assert_blob(str);
-        case 0xc0:  unpack_context->item.type = cwpack::item_type::NIL;           return;  // nil
-        case 0xc2:  getDDItem(cwpack::item_type::BOOLEAN, boolean, false);        return;  // false
-        case 0xc3:  getDDItem(cwpack::item_type::BOOLEAN, boolean, true);         return;  // true
-        case 0xc4:  getDDItem1(cwpack::item_type::BIN, bin.length, uint8_t);              // bin 8
-                    cw_unpack_assert_blob(bin);
-        case 0xc5:  getDDItem2(cwpack::item_type::BIN, bin.length, uint16_t);             // bin 16
-                    cw_unpack_assert_blob(bin);
-        case 0xc6:  getDDItem4(cwpack::item_type::BIN, bin.length, uint32_t);             // bin 32
-                    cw_unpack_assert_blob(bin);
-        case 0xc7:  getDDItem1(cwpack::item_type::EXT, ext.length, uint8_t);              // ext 8
-                    cw_unpack_assert_space(1);
-                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
-                    if (unpack_context->item.type == cwpack::item_type::TIMESTAMP)
-                    {
-                        if (unpack_context->item.as.ext.length == 12)
-                        {
-                            cw_unpack_assert_space(4);
-                            cw_load32(p);
-                            unpack_context->item.as.time.tv_nsec = tmpu32;
-                            cw_unpack_assert_space(8);
-                            cw_load64(p,tmpu64);
-                            unpack_context->item.as.time.tv_sec = (int64_t)tmpu64;
-                            return;
-                        }
-                        UNPACK_ERROR(CWP_RC_WRONG_TIMESTAMP_LENGTH)
-                    }
-                    cw_unpack_assert_blob(ext);
-        case 0xc8:  getDDItem2(cwpack::item_type::EXT, ext.length, uint16_t);             // ext 16
-                    cw_unpack_assert_space(1);
-                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
-                    cw_unpack_assert_blob(ext);
-        case 0xc9:  getDDItem4(cwpack::item_type::EXT, ext.length, uint32_t);             // ext 32
-                    cw_unpack_assert_space(1);
-                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
-                    cw_unpack_assert_blob(ext);
-        case 0xca:  unpack_context->item.type = cwpack::item_type::FLOAT;                 // float
-                    cw_unpack_assert_space(4);
-                    cw_load32(p);
-                    unpack_context->item.as.real = *(float*)&tmpu32;     return;
-        case 0xcb:  getDDItem8(cwpack::item_type::DOUBLE);                         return;  // double
-        case 0xcc:  getDDItem1(cwpack::item_type::POSITIVE_INTEGER, u64, uint8_t); return;  // unsigned int  8
-        case 0xcd:  getDDItem2(cwpack::item_type::POSITIVE_INTEGER, u64, uint16_t); return; // unsigned int 16
-        case 0xce:  getDDItem4(cwpack::item_type::POSITIVE_INTEGER, u64, uint32_t); return; // unsigned int 32
-        case 0xcf:  getDDItem8(cwpack::item_type::POSITIVE_INTEGER);               return;  // unsigned int 64
-        case 0xd0:  getDDItem1(cwpack::item_type::NEGATIVE_INTEGER, i64, int8_t);          // signed int  8
-                    if (unpack_context->item.as.i64 >= 0)
-                        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
-                    return;
-        case 0xd1:  getDDItem2(cwpack::item_type::NEGATIVE_INTEGER, i64, int16_t);        // signed int 16
-                    if (unpack_context->item.as.i64 >= 0)
-                        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
-                    return;
-        case 0xd2:  getDDItem4(cwpack::item_type::NEGATIVE_INTEGER, i64, int32_t);        // signed int 32
-                    if (unpack_context->item.as.i64 >= 0)
-                        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
-                    return;
-        case 0xd3:  getDDItem8(cwpack::item_type::NEGATIVE_INTEGER);                      // signed int 64
-                    if (unpack_context->item.as.i64 >= 0)
-                        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
-                    return;
-        case 0xd4:  getDDItemFix(1);                                            // fixext 1
-        case 0xd5:  getDDItemFix(2);                                            // fixext 2
-        case 0xd6:  getDDItemFix(4);                                            // fixext 4
-        case 0xd7:  getDDItemFix(8);                                            // fixext 8
-        case 0xd8:  getDDItemFix(16);                                           // fixext 16
-        case 0xd9:  getDDItem1(cwpack::item_type::STR, str.length, uint8_t);              // str 8
-                    cw_unpack_assert_blob(str);
-        case 0xda:  getDDItem2(cwpack::item_type::STR, str.length, uint16_t);             // str 16
-                    cw_unpack_assert_blob(str);
-        case 0xdb:  getDDItem4(cwpack::item_type::STR, str.length, uint32_t);             // str 32
-                    cw_unpack_assert_blob(str);
-        case 0xdc:  getDDItem2(cwpack::item_type::ARRAY, array.size, uint16_t);   return;  // array 16
-        case 0xdd:  getDDItem4(cwpack::item_type::ARRAY, array.size, uint32_t);   return;  // array 32
-        case 0xde:  getDDItem2(cwpack::item_type::MAP, map.size, uint16_t);       return;  // map 16
-        case 0xdf:  getDDItem4(cwpack::item_type::MAP, map.size, uint32_t);       return;  // map 32
-        case 0xe0: case 0xe1: case 0xe2: case 0xe3: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
-        case 0xe8: case 0xe9: case 0xea: case 0xeb: case 0xec: case 0xed: case 0xee: case 0xef:
-        case 0xf0: case 0xf1: case 0xf2: case 0xf3: case 0xf4: case 0xf5: case 0xf6: case 0xf7:
-        case 0xf8: case 0xf9: case 0xfa: case 0xfb: case 0xfc: case 0xfd: case 0xfe: case 0xff:
-                    getDDItem(cwpack::item_type::NEGATIVE_INTEGER, i64, (int8_t)c); return;    // negative fixnum
-        default:
-                    UNPACK_ERROR(CWP_RC_MALFORMED_INPUT)
-    }
+    unpack_context->item.type = d.type;
+    cw_dispatch_begin(d.kind)
+        cw_dispatch_case(FIXINT)        unpack_context->item.as.i64 = (int8_t)c;                return;
+        cw_dispatch_case(NIL)                                                                   return;
+        cw_dispatch_case(BOOLEAN)       unpack_context->item.as.boolean = c & 1;                return;
+        cw_dispatch_case(UINT8)         getDDItem1(d.type, u64, uint8_t);                       return;
+        cw_dispatch_case(UINT16)        getDDItem2(d.type, u64, uint16_t);                      return;
+        cw_dispatch_case(UINT32)        getDDItem4(d.type, u64, uint32_t);                      return;
+        cw_dispatch_case(UINT64)        getDDItem8(d.type);                                     return;
+        cw_dispatch_case(INT8)          getDDItem1(d.type, i64, int8_t);                        goto check_sign;
+        cw_dispatch_case(INT16)         getDDItem2(d.type, i64, int16_t);                       goto check_sign;
+        cw_dispatch_case(INT32)         getDDItem4(d.type, i64, int32_t);                       goto check_sign;
+        cw_dispatch_case(INT64)         getDDItem8(d.type);                                     goto check_sign;
+        cw_dispatch_case(FLOAT)         cw_unpack_assert_space(4);
+                                        cw_load32(p);
+                                        unpack_context->item.as.real = *(float*)&tmpu32;        return;
+        cw_dispatch_case(DOUBLE)        getDDItem8(d.type);                                     return;
+        cw_dispatch_case(FIXBLOB)       unpack_context->item.as.str.length = c & 0x1f;
+                                        cw_unpack_assert_blob(str);
+        cw_dispatch_case(BLOB8)         getDDItem1(d.type, str.length, uint8_t);
+                                        cw_unpack_assert_blob(str);
+        cw_dispatch_case(BLOB16)        getDDItem2(d.type, str.length, uint16_t);
+                                        cw_unpack_assert_blob(str);
+        cw_dispatch_case(BLOB32)        getDDItem4(d.type, str.length, uint32_t);
+                                        cw_unpack_assert_blob(str);
+        cw_dispatch_case(FIXCONTAINER)  unpack_context->item.as.array.size = c & 0x0f;          return;
+        cw_dispatch_case(CONTAINER16)   getDDItem2(d.type, array.size, uint16_t);               return;
+        cw_dispatch_case(CONTAINER32)   getDDItem4(d.type, array.size, uint32_t);               return;
+        cw_dispatch_case(EXT8)          getDDItem1(d.type, ext.length, uint8_t);
+                                        cw_unpack_assert_space(1);
+                                        unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
+                                        if (unpack_context->item.type == cwpack::item_type::TIMESTAMP)
+                                        {
+                                            if (unpack_context->item.as.ext.length == 12)
+                                            {
+                                                cw_unpack_assert_space(4);
+                                                cw_load32(p);
+                                                unpack_context->item.as.time.tv_nsec = tmpu32;
+                                                cw_unpack_assert_space(8);
+                                                cw_load64(p,tmpu64);
+                                                unpack_context->item.as.time.tv_sec = (int64_t)tmpu64;
+                                                return;
+                                            }
+                                            UNPACK_ERROR(CWP_RC_WRONG_TIMESTAMP_LENGTH)
+                                        }
+                                        cw_unpack_assert_blob(ext);
+        cw_dispatch_case(EXT16)         getDDItem2(d.type, ext.length, uint16_t);
+                                        cw_unpack_assert_space(1);
+                                        unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
+                                        cw_unpack_assert_blob(ext);
+        cw_dispatch_case(EXT32)         getDDItem4(d.type, ext.length, uint32_t);
+                                        cw_unpack_assert_space(1);
+                                        unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
+                                        cw_unpack_assert_blob(ext);
+        cw_dispatch_case(FIXEXT)        switch (d.payload_length)
+                                        {
+                                            case 1:     getDDItemFix(1);
+                                            case 2:     getDDItemFix(2);
+                                            case 4:     getDDItemFix(4);
+                                            case 8:     getDDItemFix(8);
+                                            default:    getDDItemFix(16);
+                                        }
+        cw_dispatch_case(ILLEGAL)       UNPACK_ERROR(CWP_RC_MALFORMED_INPUT)
+    cw_dispatch_end
+
+check_sign:
+    if (unpack_context->item.as.i64 >= 0)
+        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
 }
 
-#define cw_skip_bytes(n)                                \
-    cw_unpack_assert_space((n));                          \
-    break;
 
-inline static void cw_skip_items (cw_unpack_context* unpack_context, long item_count)
+template <class Source>
+inline static void cw_skip_items (cwpack::basic_unpack_context<Source>* unpack_context, long item_count)
 {
     if (unpack_context->return_code)
         return;
@@ -824,130 +1186,84 @@ inline static void cw_skip_items (cw_unpack_context* unpack_context, long item_c
             cw_unpack_assert_space(1);
         }
         uint8_t c = *p;
+        const cwpack::lead_byte_descriptor& d = cwpack::lead_byte_table[c];
 
         constexpr auto buffer_end_return_code = CWP_RC_BUFFER_UNDERFLOW;
-        switch (c)
-        {
-            case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
-            case 0x08: case 0x09: case 0x0a: case 0x0b: case 0x0c: case 0x0d: case 0x0e: case 0x0f:
-            case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17:
-            case 0x18: case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e: case 0x1f:
-            case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27:
-            case 0x28: case 0x29: case 0x2a: case 0x2b: case 0x2c: case 0x2d: case 0x2e: case 0x2f:
-            case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
-            case 0x38: case 0x39: case 0x3a: case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f:
-            case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47:
-            case 0x48: case 0x49: case 0x4a: case 0x4b: case 0x4c: case 0x4d: case 0x4e: case 0x4f:
-            case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x56: case 0x57:
-            case 0x58: case 0x59: case 0x5a: case 0x5b: case 0x5c: case 0x5d: case 0x5e: case 0x5f:
-            case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x66: case 0x67:
-            case 0x68: case 0x69: case 0x6a: case 0x6b: case 0x6c: case 0x6d: case 0x6e: case 0x6f:
-            case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
-            case 0x78: case 0x79: case 0x7a: case 0x7b: case 0x7c: case 0x7d: case 0x7e: case 0x7f:
-                                                                // unsigned fixint
-            case 0xe0: case 0xe1: case 0xe2: case 0xe3: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
-            case 0xe8: case 0xe9: case 0xea: case 0xeb: case 0xec: case 0xed: case 0xee: case 0xef:
-            case 0xf0: case 0xf1: case 0xf2: case 0xf3: case 0xf4: case 0xf5: case 0xf6: case 0xf7:
-            case 0xf8: case 0xf9: case 0xfa: case 0xfb: case 0xfc: case 0xfd: case 0xfe: case 0xff:
-                                                                // signed fixint
-            case 0xc0:                                          // nil
-            case 0xc2:                                          // false
-            case 0xc3:  break;                                  // true
-            case 0xcc:                                          // unsigned int  8
-            case 0xd0:	cw_skip_bytes(1);                       // signed int  8
-            case 0xcd:                                          // unsigned int 16
-            case 0xd1:                                          // signed int 16
-            case 0xd4:  cw_skip_bytes(2);                       // fixext 1
-            case 0xd5:  cw_skip_bytes(3);                       // fixext 2
-            case 0xca:                                          // float
-            case 0xce:                                          // unsigned int 32
-            case 0xd2:  cw_skip_bytes(4);                       // signed int 32
-            case 0xd6:  cw_skip_bytes(5);                       // fixext 4
-            case 0xcb:                                          // double
-            case 0xcf:                                          // unsigned int 64
-            case 0xd3:  cw_skip_bytes(8);                       // signed int 64
-            case 0xd7:  cw_skip_bytes(9);                       // fixext 8
-            case 0xd8:  cw_skip_bytes(17);                      // fixext 16
-            case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6: case 0xa7:
-            case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf:
-            case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7:
-            case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
-                cw_skip_bytes(c & 0x1f);                        // fixstr
-            case 0xd9:                                          // str 8
-            case 0xc4:                                          // bin 8
-                cw_unpack_assert_space(1);
-                tmpu32 = *p;
-                cw_skip_bytes(tmpu32);
-
-            case 0xda:                                          // str 16
-            case 0xc5:                                          // bin 16
-                cw_unpack_assert_space(2);
-                cw_load16(p);
-                cw_skip_bytes(tmpu16);
-
-            case 0xdb:                                          // str 32
-            case 0xc6:                                          // bin 32
-                cw_unpack_assert_space(4);
-                cw_load32(p);
-                cw_skip_bytes(tmpu32);
-
-            case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x86: case 0x87:
-            case 0x88: case 0x89: case 0x8a: case 0x8b: case 0x8c: case 0x8d: case 0x8e: case 0x8f:
-                item_count += 2*(c & 15);                       // FixMap
-                break;
-
-            case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x96: case 0x97:
-            case 0x98: case 0x99: case 0x9a: case 0x9b: case 0x9c: case 0x9d: case 0x9e: case 0x9f:
-                item_count += c & 15;                           // FixArray
-                break;
-
-            case 0xdc:                                          // array 16
-                cw_unpack_assert_space(2);
-                cw_load16(p);
-                item_count += tmpu16;
-                break;
-
-            case 0xde:                                          // map 16
-                cw_unpack_assert_space(2);
-                cw_load16(p);
-                item_count += 2*tmpu16;
-                break;
-
-            case 0xdd:                                          // array 32
-                cw_unpack_assert_space(4);
-                cw_load32(p);
-                item_count += tmpu32;
-                break;
-
-            case 0xdf:                                          // map 32
-                cw_unpack_assert_space(4);
-                cw_load32(p);
-                item_count += 2*tmpu32;
-                break;
-
-            case 0xc7:                                          // ext 8
-                cw_unpack_assert_space(1);
-                tmpu32 = *p;
-                cw_skip_bytes(tmpu32 +1);
-
-            case 0xc8:                                          // ext 16
-                cw_unpack_assert_space(2);
-                cw_load16(p);
-                cw_skip_bytes(tmpu16 +1);
-
-            case 0xc9:                                          // ext 32
-                cw_unpack_assert_space(4);
-                cw_load32(p);
-                cw_skip_bytes(tmpu32 +1);
-
-            default:                                            // illegal
-                UNPACK_ERROR(CWP_RC_MALFORMED_INPUT)
-        }
+        cw_dispatch_begin(d.kind)
+            cw_dispatch_case(FIXINT)
+            cw_dispatch_case(NIL)
+            cw_dispatch_case(BOOLEAN)       if (item_count >= CWPACK_SKIP_RUN_MIN_ITEMS &&
+                                                unpack_context->current < unpack_context->end &&
+                                                cwpack::simd::single_byte_items[*unpack_context->current])
+                                            {
+                                                unsigned long run = cwpack::simd::single_byte_run(unpack_context->current,
+                                                                                                  unpack_context->end,
+                                                                                                  (unsigned long)item_count);
+                                                unpack_context->current += run;
+                                                item_count -= (long)run;
+                                            }
+                                            continue;
+            cw_dispatch_case(UINT8)
+            cw_dispatch_case(INT8)          cw_unpack_assert_space(1);          continue;
+            cw_dispatch_case(UINT16)
+            cw_dispatch_case(INT16)         cw_unpack_assert_space(2);          continue;
+            cw_dispatch_case(UINT32)
+            cw_dispatch_case(INT32)
+            cw_dispatch_case(FLOAT)         cw_unpack_assert_space(4);          continue;
+            cw_dispatch_case(UINT64)
+            cw_dispatch_case(INT64)
+            cw_dispatch_case(DOUBLE)        cw_unpack_assert_space(8);          continue;
+            cw_dispatch_case(FIXBLOB)       cw_unpack_assert_space(c & 0x1f);   continue;
+            cw_dispatch_case(BLOB8)         cw_unpack_assert_space(1);
+                                            tmpu32 = *p;
+                                            cw_unpack_assert_space(tmpu32);
+                                            continue;
+            cw_dispatch_case(BLOB16)        cw_unpack_assert_space(2);
+                                            cw_load16(p);
+                                            cw_unpack_assert_space(tmpu16);
+                                            continue;
+            cw_dispatch_case(BLOB32)        cw_unpack_assert_space(4);
+                                            cw_load32(p);
+                                            cw_unpack_assert_space(tmpu32);
+                                            continue;
+            cw_dispatch_case(FIXCONTAINER)  item_count += d.container_multiplier * (c & 0x0f);
+                                            continue;
+            cw_dispatch_case(CONTAINER16)   cw_unpack_assert_space(2);
+                                            cw_load16(p);
+                                            item_count += d.container_multiplier * (long)tmpu16;
+                                            continue;
+            cw_dispatch_case(CONTAINER32)   cw_unpack_assert_space(4);
+                                            cw_load32(p);
+                                            item_count += d.container_multiplier * (long)tmpu32;
+                                            continue;
+            cw_dispatch_case(EXT8)          cw_unpack_assert_space(1);
+                                            tmpu32 = *p;
+                                            cw_unpack_assert_space(tmpu32 + 1);
+                                            continue;
+            cw_dispatch_case(EXT16)         cw_unpack_assert_space(2);
+                                            cw_load16(p);
+                                            cw_unpack_assert_space(tmpu16 + 1UL);
+                                            continue;
+            cw_dispatch_case(EXT32)         cw_unpack_assert_space(4);
+                                            cw_load32(p);
+                                            cw_unpack_assert_space(tmpu32 + 1UL);
+                                            continue;
+            cw_dispatch_case(FIXEXT)        switch (d.payload_length)
+                                            {
+                                                case 1:     cw_unpack_assert_space(2);      continue;
+                                                case 2:     cw_unpack_assert_space(3);      continue;
+                                                case 4:     cw_unpack_assert_space(5);      continue;
+                                                case 8:     cw_unpack_assert_space(9);      continue;
+                                                default:    cw_unpack_assert_space(17);     continue;
+                                            }
+            cw_dispatch_case(ILLEGAL)       UNPACK_ERROR(CWP_RC_MALFORMED_INPUT)
+        cw_dispatch_end
     }
 }
 
 /* Check next item type without consuming input */
-inline static cwpack_item_types cw_look_ahead (cw_unpack_context* unpack_context)
+template <class Source>
+inline static cwpack_item_types cw_look_ahead (cwpack::basic_unpack_context<Source>* unpack_context)
 {
     if (unpack_context->return_code)
         return cwpack::item_type::NOT_AN_ITEM;
@@ -958,69 +1274,126 @@ inline static cwpack_item_types cw_look_ahead (cw_unpack_context* unpack_context
         cw_unpack_assert_space_sub(1,cwpack::item_type::NOT_AN_ITEM);
     }
     unpack_context->current -= 1;    //step back
-    uint8_t c = *p;
+    const cwpack::lead_byte_descriptor& d = cwpack::lead_byte_table[*p];
+    if (d.type != cwpack::item_type::EXT)
+        return d.type;
+
     constexpr auto buffer_end_return_code = CWP_RC_BUFFER_UNDERFLOW;
-    switch (c)
+    cw_unpack_assert_space_sub(d.header_length,cwpack::item_type::NOT_AN_ITEM);
+    unpack_context->current -= d.header_length;
+    return (cwpack_item_types)*(int8_t*)(p + d.header_length - 1);
+}
+
+
+/*
+ * Map key lookup. Call after the map header, with the number of pairs left in the map.
+ * The str keys are compared in the buffer: a key whose header gives another length is
+ * rejected without touching its bytes, the others are compared a word at a time. Values of
+ * keys that don't match are skipped without being decoded.
+ * On a match the context is positioned at the value and the index of the pair is returned,
+ * so the pairs left after the value are map_size - index - 1. Otherwise -1 is returned
+ * and the map is consumed (or return_code is set).
+ */
+
+namespace cwpack {
+
+struct map_key {
+    const void*     start;
+    uint32_t        length;
+};
+
+inline bool equal_key_bytes (const uint8_t* a, const uint8_t* b, uint32_t length)
+{
+    uint64_t wa, wb;
+    for (; length >= 8; length -= 8, a += 8, b += 8)
     {
-        case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
-        case 0x08: case 0x09: case 0x0a: case 0x0b: case 0x0c: case 0x0d: case 0x0e: case 0x0f:
-        case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17:
-        case 0x18: case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e: case 0x1f:
-        case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27:
-        case 0x28: case 0x29: case 0x2a: case 0x2b: case 0x2c: case 0x2d: case 0x2e: case 0x2f:
-        case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
-        case 0x38: case 0x39: case 0x3a: case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f:
-        case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47:
-        case 0x48: case 0x49: case 0x4a: case 0x4b: case 0x4c: case 0x4d: case 0x4e: case 0x4f:
-        case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x56: case 0x57:
-        case 0x58: case 0x59: case 0x5a: case 0x5b: case 0x5c: case 0x5d: case 0x5e: case 0x5f:
-        case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x66: case 0x67:
-        case 0x68: case 0x69: case 0x6a: case 0x6b: case 0x6c: case 0x6d: case 0x6e: case 0x6f:
-        case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
-        case 0x78: case 0x79: case 0x7a: case 0x7b: case 0x7c: case 0x7d: case 0x7e: case 0x7f:
-                                                                                        return cwpack::item_type::POSITIVE_INTEGER;
-        case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x86: case 0x87:
-        case 0x88: case 0x89: case 0x8a: case 0x8b: case 0x8c: case 0x8d: case 0x8e: case 0x8f:
-                                                                                        return cwpack::item_type::MAP;
-        case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x96: case 0x97:
-        case 0x98: case 0x99: case 0x9a: case 0x9b: case 0x9c: case 0x9d: case 0x9e: case 0x9f:
-                                                                                        return cwpack::item_type::ARRAY;
-        case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6: case 0xa7:
-        case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf:
-        case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7:
-        case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
-                                                                                        return cwpack::item_type::STR;
-        case 0xc0:                                                                      return cwpack::item_type::NIL;
-        case 0xc2: case 0xc3:                                                           return cwpack::item_type::BOOLEAN;
-        case 0xc4: case 0xc5: case 0xc6:                                                return cwpack::item_type::BIN;
-        case 0xc7:
-            cw_unpack_assert_space_sub(3,cwpack::item_type::NOT_AN_ITEM);
-            unpack_context->current -= 3;
-            if ((cwpack_item_types)*(p+2) == cwpack::item_type::TIMESTAMP)                        return cwpack::item_type::TIMESTAMP;
-            else                                                                        return (cwpack_item_types)*(int8_t*)(p+2);
-        case 0xc8:
-            cw_unpack_assert_space_sub(4,cwpack::item_type::NOT_AN_ITEM);
-            unpack_context->current -= 4;                                               return (cwpack_item_types)*(int8_t*)(p+3);
-        case 0xc9:
-            cw_unpack_assert_space_sub(6,cwpack::item_type::NOT_AN_ITEM);
-            unpack_context->current -= 6;                                               return (cwpack_item_types)*(int8_t*)(p+5);
-        case 0xca:                                                                      return cwpack::item_type::FLOAT;
-        case 0xcb:                                                                      return cwpack::item_type::DOUBLE;
-        case 0xcc: case 0xcd: case 0xce: case 0xcf:                                     return cwpack::item_type::POSITIVE_INTEGER;
-        case 0xd0: case 0xd1: case 0xd2: case 0xd3:                                     return cwpack::item_type::NEGATIVE_INTEGER;
-        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
-            cw_unpack_assert_space_sub(2,cwpack::item_type::NOT_AN_ITEM);
-            unpack_context->current -= 2;                                               return (cwpack_item_types)*(int8_t*)(p+1);
-        case 0xd9: case 0xda: case 0xdb:                                                return cwpack::item_type::STR;
-        case 0xdc: case 0xdd:                                                           return cwpack::item_type::ARRAY;
-        case 0xde: case 0xdf:                                                           return cwpack::item_type::MAP;
-        case 0xe0: case 0xe1: case 0xe2: case 0xe3: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
-        case 0xe8: case 0xe9: case 0xea: case 0xeb: case 0xec: case 0xed: case 0xee: case 0xef:
-        case 0xf0: case 0xf1: case 0xf2: case 0xf3: case 0xf4: case 0xf5: case 0xf6: case 0xf7:
-        case 0xf8: case 0xf9: case 0xfa: case 0xfb: case 0xfc: case 0xfd: case 0xfe: case 0xff:
-                                                                                        return cwpack::item_type::NEGATIVE_INTEGER;
-        default:
-            return cwpack::item_type::NOT_AN_ITEM;
+        memcpy(&wa, a, 8);
+        memcpy(&wb, b, 8);
+        if (wa != wb)
+            return false;
     }
+    if (length >= 4)
+    {
+        uint32_t ha, hb;
+        memcpy(&ha, a, 4);
+        memcpy(&hb, b, 4);
+        if (ha != hb)
+            return false;
+        memcpy(&ha, a + length - 4, 4);
+        memcpy(&hb, b + length - 4, 4);
+        return ha == hb;
+    }
+    for (; length; length--)
+        if (*a++ != *b++)
+            return false;
+    return true;
+}
+
+}
+
+/* Find the first pair whose key is any of keys. *key_index is set to the index of the matching key. */
+template <class Source>
+inline static long cw_unpack_find_keys (cwpack::basic_unpack_context<Source>* unpack_context, uint32_t map_size,
+                                        const cwpack::map_key* keys, int key_count, int* key_index)
+{
+    if (unpack_context->return_code)
+        return -1;
+
+    uint32_t    tmpu32;
+    uint16_t    tmpu16;
+    uint8_t*    p;
+    constexpr auto buffer_end_return_code = CWP_RC_BUFFER_UNDERFLOW;
+
+    for (uint32_t pair = 0; pair < map_size; pair++)
+    {
+        cw_unpack_assert_space_sub(1,-1);
+        uint8_t c = *p;
+        const cwpack::lead_byte_descriptor& d = cwpack::lead_byte_table[c];
+        if (d.type == cwpack::item_type::STR)
+        {
+            uint32_t length;
+            switch (d.kind)
+            {
+                case cwpack::lead_kind::FIXBLOB:    length = c & 0x1f;
+                                                    break;
+                case cwpack::lead_kind::BLOB8:      cw_unpack_assert_space_sub(1,-1);
+                                                    length = *p;
+                                                    break;
+                case cwpack::lead_kind::BLOB16:     cw_unpack_assert_space_sub(2,-1);
+                                                    cw_load16(p);
+                                                    length = tmpu16;
+                                                    break;
+                default:                            cw_unpack_assert_space_sub(4,-1);
+                                                    cw_load32(p);
+                                                    length = tmpu32;
+                                                    break;
+            }
+            cw_unpack_assert_space_sub(length,-1);
+            for (int k = 0; k < key_count; k++)
+            {
+                if (keys[k].length == length && cwpack::equal_key_bytes(p, (const uint8_t*)keys[k].start, length))
+                {
+                    if (key_index)
+                        *key_index = k;
+                    return (long)pair;
+                }
+            }
+        }
+        else
+        {
+            unpack_context->current -= 1;
+            cw_skip_items (unpack_context, 1);
+        }
+        cw_skip_items (unpack_context, 1);
+        if (unpack_context->return_code)
+            return -1;
+    }
+    return -1;
 }
 
+template <class Source>
+inline static long cw_unpack_find_key (cwpack::basic_unpack_context<Source>* unpack_context, uint32_t map_size, const char* key, uint32_t len)
+{
+    cwpack::map_key k = {key, len};
+    return cw_unpack_find_keys (unpack_context, map_size, &k, 1, nullptr);
+}
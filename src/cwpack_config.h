@@ -55,6 +55,34 @@
 
 
 
+/*************************   D I S P A T C H   ******************************/
+
+/*
+ * cw_unpack_next dispatches on the kind found in the lead byte table with a switch.
+ * With GCC or Clang you can define CWPACK_COMPUTED_GOTO to use a computed goto instead.
+ */
+
+/* #define CWPACK_COMPUTED_GOTO */
+
+
+
+/*************************   S I M D   **************************************/
+
+/*
+ * cw_skip_items jumps over runs of single byte items (fixint, nil, booleans and the
+ * empty str, array and map) with a vectorized scanner, chosen at runtime on x86-64. Define CWPACK_NO_SIMD to always use
+ * the scalar scanner. The scanner is tried when at least CWPACK_SKIP_RUN_MIN_ITEMS items
+ * remain to be skipped and the next item also is a single byte item.
+ */
+
+/* #define CWPACK_NO_SIMD */
+
+#ifndef CWPACK_SKIP_RUN_MIN_ITEMS
+#define CWPACK_SKIP_RUN_MIN_ITEMS 4
+#endif
+
+
+
 /*************************   B Y T E   O R D E R   ****************************/
 
 /*
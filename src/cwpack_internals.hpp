@@ -29,7 +29,7 @@
 #if defined(__GNUC__) || defined(__clang__)
 #define MOST_LIKELY(a,b) __builtin_expect((a),(b))
 #else
-#define MOST_LIKELY(a,b) ((a) == (b))
+#define MOST_LIKELY(a,b) (a)
 #endif
 #endif
 
@@ -122,9 +122,7 @@
 
 #define cw_pack_new_buffer(more)                                                        \
 {                                                                                       \
-    if (!pack_context->handle_pack_overflow)                                            \
-        PACK_ERROR(CWP_RC_BUFFER_OVERFLOW)                                              \
-    int rc = pack_context->handle_pack_overflow (pack_context, (unsigned long)(more));  \
+    int rc = pack_context->overflow (pack_context, (unsigned long)(more));              \
     if (rc)                                                                             \
         PACK_ERROR(rc)                                                                  \
 }
@@ -133,12 +131,12 @@
 #define cw_pack_reserve_space(more)                                                         \
 {                                                                                           \
     p = pack_context->current;                                                              \
-    uint8_t* nyp = p + more;                                                                \
+    uint8_t* nyp = p + (more);                                                              \
     if (nyp > pack_context->end)                                                            \
     {                                                                                       \
         cw_pack_new_buffer(more)                                                            \
         p = pack_context->current;                                                          \
-        nyp = p + more;                                                                     \
+        nyp = p + (more);                                                                   \
     }                                                                                       \
     pack_context->current = nyp;                                                            \
 }
@@ -282,12 +280,10 @@
 #define cw_unpack_assert_space_sub(more,abortValue)                                                 \
 {                                                                                                   \
     p = unpack_context->current;                                                                    \
-    uint8_t* nyp = p + more;                                                                        \
-    if (nyp > unpack_context->end)                                                                  \
+    uint8_t* nyp = p + (more);                                                                      \
+    if (MOST_LIKELY(nyp > unpack_context->end, 0))                                                  \
     {                                                                                               \
-        if (!unpack_context->handle_unpack_underflow)                                               \
-            UNPACK_ERROR_SUB(buffer_end_return_code,abortValue)                                     \
-        int rc = unpack_context->handle_unpack_underflow (unpack_context, (unsigned long)(more));   \
+        int rc = unpack_context->underflow (unpack_context, (unsigned long)(more));                 \
         if (rc != CWP_RC_OK)                                                                        \
         {                                                                                           \
             if (rc != CWP_RC_END_OF_INPUT)                                                          \
@@ -296,7 +292,7 @@
                 UNPACK_ERROR_SUB(buffer_end_return_code,abortValue)                                 \
         }                                                                                           \
         p = unpack_context->current;                                                                \
-        nyp = p + more;                                                                             \
+        nyp = p + (more);                                                                           \
     }                                                                                               \
     unpack_context->current = nyp;                                                                  \
 }
@@ -364,3 +360,38 @@
     unpack_context->item.as.ext.start = p;                                  \
     return;
 
+
+
+/*
+ * Dispatch on the lead byte kind in cw_unpack_next. With CWPACK_COMPUTED_GOTO it is a
+ * jump through a table of label addresses, otherwise a switch.
+ */
+
+#if defined(CWPACK_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+
+#define cw_dispatch_begin(kind)                                             \
+{                                                                           \
+    static const void* const dispatch_table[] = {                           \
+        &&kind_FIXINT, &&kind_NIL, &&kind_BOOLEAN,                          \
+        &&kind_UINT8, &&kind_UINT16, &&kind_UINT32, &&kind_UINT64,          \
+        &&kind_INT8, &&kind_INT16, &&kind_INT32, &&kind_INT64,              \
+        &&kind_FLOAT, &&kind_DOUBLE,                                        \
+        &&kind_FIXBLOB, &&kind_BLOB8, &&kind_BLOB16, &&kind_BLOB32,         \
+        &&kind_FIXCONTAINER, &&kind_CONTAINER16, &&kind_CONTAINER32,        \
+        &&kind_EXT8, &&kind_EXT16, &&kind_EXT32, &&kind_FIXEXT,             \
+        &&kind_ILLEGAL };                                                   \
+    goto *dispatch_table[(int)(kind)];
+
+#define cw_dispatch_case(k)     kind_##k:
+
+#define cw_dispatch_end         }
+
+#else
+
+#define cw_dispatch_begin(kind)     switch (kind) {
+
+#define cw_dispatch_case(k)         case cwpack::lead_kind::k:
+
+#define cw_dispatch_end             }
+
+#endif
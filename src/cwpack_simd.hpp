@@ -0,0 +1,147 @@
+/*      CWPack - cwpack_simd.hpp   */
+/*
+ The MIT License (MIT)
+
+ Copyright (c) 2017 Claes Wihlborg
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ software and associated documentation files (the "Software"), to deal in the Software
+ without restriction, including without limitation the rights to use, copy, modify,
+ merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+ persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or
+ substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+ BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "cwpack_config.h"
+
+#if !defined(CWPACK_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CWPACK_SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Scanner for runs of single byte items (fixint, nil, booleans, empty str/array/map),
+ * used by cw_skip_items to jump over them in bulk. The lead bytes are classified 32 at a
+ * time with AVX2 or 16 at a time with SSE2, chosen at runtime, with a scalar fallback.
+ */
+
+namespace cwpack {
+namespace simd {
+
+constexpr bool is_single_byte_item (uint8_t c)
+{
+    return c <= 0x7f || c >= 0xe0 || c == 0xc0 || c == 0xc2 || c == 0xc3 ||
+           c == 0x80 || c == 0x90 || c == 0xa0;
+}
+
+constexpr std::array<bool, 256> make_single_byte_items ()
+{
+    std::array<bool, 256> table{};
+    for (int c = 0; c < 256; c++)
+        table[c] = is_single_byte_item((uint8_t)c);
+    return table;
+}
+
+inline constexpr std::array<bool, 256> single_byte_items = make_single_byte_items();
+
+/* Number of single byte items starting at p, not beyond end and at most max */
+inline unsigned long scalar_single_byte_run (const uint8_t* p, const uint8_t* end, unsigned long max)
+{
+    const uint8_t* start = p;
+    if ((unsigned long)(end - p) > max)
+        end = p + max;
+    while (p < end && single_byte_items[*p])
+        p++;
+    return (unsigned long)(p - start);
+}
+
+#ifdef CWPACK_SIMD_X86
+
+inline unsigned long sse2_single_byte_run (const uint8_t* p, const uint8_t* end, unsigned long max)
+{
+    const uint8_t* start = p;
+    if ((unsigned long)(end - p) > max)
+        end = p + max;
+    const __m128i fixint_min = _mm_set1_epi8(-33);
+    const __m128i bool_mask = _mm_set1_epi8((char)0xfe);
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i single = _mm_cmpgt_epi8(v, fixint_min);                                   /* fixint */
+        single = _mm_or_si128(single, _mm_cmpeq_epi8(v, _mm_set1_epi8((char)0xc0)));      /* nil */
+        single = _mm_or_si128(single, _mm_cmpeq_epi8(_mm_and_si128(v, bool_mask), _mm_set1_epi8((char)0xc2)));
+        single = _mm_or_si128(single, _mm_cmpeq_epi8(v, _mm_set1_epi8((char)0x80)));      /* empty map */
+        single = _mm_or_si128(single, _mm_cmpeq_epi8(v, _mm_set1_epi8((char)0x90)));      /* empty array */
+        single = _mm_or_si128(single, _mm_cmpeq_epi8(v, _mm_set1_epi8((char)0xa0)));      /* empty str */
+        unsigned int others = ~(unsigned int)_mm_movemask_epi8(single) & 0xffff;
+        if (others)
+            return (unsigned long)(p - start) + (unsigned long)__builtin_ctz(others);
+        p += 16;
+    }
+    return (unsigned long)(p - start) + scalar_single_byte_run(p, end, max);
+}
+
+__attribute__((target("avx2")))
+inline unsigned long avx2_single_byte_run (const uint8_t* p, const uint8_t* end, unsigned long max)
+{
+    const uint8_t* start = p;
+    if ((unsigned long)(end - p) > max)
+        end = p + max;
+    const __m256i fixint_min = _mm256_set1_epi8(-33);
+    const __m256i bool_mask = _mm256_set1_epi8((char)0xfe);
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i single = _mm256_cmpgt_epi8(v, fixint_min);
+        single = _mm256_or_si256(single, _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)0xc0)));
+        single = _mm256_or_si256(single, _mm256_cmpeq_epi8(_mm256_and_si256(v, bool_mask), _mm256_set1_epi8((char)0xc2)));
+        single = _mm256_or_si256(single, _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)0x80)));
+        single = _mm256_or_si256(single, _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)0x90)));
+        single = _mm256_or_si256(single, _mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)0xa0)));
+        unsigned int others = ~(unsigned int)_mm256_movemask_epi8(single);
+        if (others)
+            return (unsigned long)(p - start) + (unsigned long)__builtin_ctz(others);
+        p += 32;
+    }
+    return (unsigned long)(p - start) + sse2_single_byte_run(p, end, max - (unsigned long)(p - start));
+}
+
+#endif
+
+typedef unsigned long (*run_scanner)(const uint8_t* p, const uint8_t* end, unsigned long max);
+
+inline run_scanner select_single_byte_run ()
+{
+#ifdef CWPACK_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &avx2_single_byte_run;
+    return &sse2_single_byte_run;
+#else
+    return &scalar_single_byte_run;
+#endif
+}
+
+inline unsigned long single_byte_run (const uint8_t* p, const uint8_t* end, unsigned long max)
+{
+    static const run_scanner scanner = select_single_byte_run();
+    return scanner(p, end, max);
+}
+
+}
+}
@@ -0,0 +1,484 @@
+/*      CWPack/test cwpack_decode_benchmark.cpp   */
+
+
+/*
+ * Compares the table driven decoder with the switch based decoder it replaced.
+ * For each payload the same buffer is decoded with both and the time per item is
+ * reported. The item streams are also compared, so the benchmark doubles as a check.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "cwpack.hpp"
+#include "basic_contexts.h"
+
+
+#define ITEMS       200000
+#define ROUNDS      7
+
+
+/*************************   SWITCH DECODER (REFERENCE)   ********************/
+
+template <class Source>
+inline static void legacy_unpack_next(cwpack::basic_unpack_context<Source>* unpack_context)
+{
+    if (unpack_context->return_code)
+        return;
+
+    uint64_t    tmpu64;
+    uint32_t    tmpu32;
+    uint16_t    tmpu16;
+    uint8_t*    p;
+
+    {
+        constexpr auto buffer_end_return_code = CWP_RC_END_OF_INPUT;
+        cw_unpack_assert_space(1);
+    }
+    uint8_t c = *p;
+    constexpr auto buffer_end_return_code = CWP_RC_BUFFER_UNDERFLOW;
+    switch (c)
+    {
+        case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
+        case 0x08: case 0x09: case 0x0a: case 0x0b: case 0x0c: case 0x0d: case 0x0e: case 0x0f:
+        case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17:
+        case 0x18: case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e: case 0x1f:
+        case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27:
+        case 0x28: case 0x29: case 0x2a: case 0x2b: case 0x2c: case 0x2d: case 0x2e: case 0x2f:
+        case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
+        case 0x38: case 0x39: case 0x3a: case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f:
+        case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47:
+        case 0x48: case 0x49: case 0x4a: case 0x4b: case 0x4c: case 0x4d: case 0x4e: case 0x4f:
+        case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x56: case 0x57:
+        case 0x58: case 0x59: case 0x5a: case 0x5b: case 0x5c: case 0x5d: case 0x5e: case 0x5f:
+        case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x66: case 0x67:
+        case 0x68: case 0x69: case 0x6a: case 0x6b: case 0x6c: case 0x6d: case 0x6e: case 0x6f:
+        case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
+        case 0x78: case 0x79: case 0x7a: case 0x7b: case 0x7c: case 0x7d: case 0x7e: case 0x7f:
+                    getDDItem(cwpack::item_type::POSITIVE_INTEGER, i64, c);       return;  // positive fixnum
+        case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x86: case 0x87:
+        case 0x88: case 0x89: case 0x8a: case 0x8b: case 0x8c: case 0x8d: case 0x8e: case 0x8f:
+                    getDDItem(cwpack::item_type::MAP, map.size, c & 0x0f);        return;  // fixmap
+        case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x96: case 0x97:
+        case 0x98: case 0x99: case 0x9a: case 0x9b: case 0x9c: case 0x9d: case 0x9e: case 0x9f:
+                    getDDItem(cwpack::item_type::ARRAY, array.size, c & 0x0f);    return;  // fixarray
+        case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6: case 0xa7:
+        case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf:
+        case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7:
+        case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+                    getDDItem(cwpack::item_type::STR, str.length, c & 0x1f);              // fixraw
+                    cw_unpack_assert_blob(str);
+        case 0xc0:  unpack_context->item.type = cwpack::item_type::NIL;           return;  // nil
+        case 0xc2:  getDDItem(cwpack::item_type::BOOLEAN, boolean, false);        return;  // false
+        case 0xc3:  getDDItem(cwpack::item_type::BOOLEAN, boolean, true);         return;  // true
+        case 0xc4:  getDDItem1(cwpack::item_type::BIN, bin.length, uint8_t);              // bin 8
+                    cw_unpack_assert_blob(bin);
+        case 0xc5:  getDDItem2(cwpack::item_type::BIN, bin.length, uint16_t);             // bin 16
+                    cw_unpack_assert_blob(bin);
+        case 0xc6:  getDDItem4(cwpack::item_type::BIN, bin.length, uint32_t);             // bin 32
+                    cw_unpack_assert_blob(bin);
+        case 0xc7:  getDDItem1(cwpack::item_type::EXT, ext.length, uint8_t);              // ext 8
+                    cw_unpack_assert_space(1);
+                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
+                    if (unpack_context->item.type == cwpack::item_type::TIMESTAMP)
+                    {
+                        if (unpack_context->item.as.ext.length == 12)
+                        {
+                            cw_unpack_assert_space(4);
+                            cw_load32(p);
+                            unpack_context->item.as.time.tv_nsec = tmpu32;
+                            cw_unpack_assert_space(8);
+                            cw_load64(p,tmpu64);
+                            unpack_context->item.as.time.tv_sec = (int64_t)tmpu64;
+                            return;
+                        }
+                        UNPACK_ERROR(CWP_RC_WRONG_TIMESTAMP_LENGTH)
+                    }
+                    cw_unpack_assert_blob(ext);
+        case 0xc8:  getDDItem2(cwpack::item_type::EXT, ext.length, uint16_t);             // ext 16
+                    cw_unpack_assert_space(1);
+                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
+                    cw_unpack_assert_blob(ext);
+        case 0xc9:  getDDItem4(cwpack::item_type::EXT, ext.length, uint32_t);             // ext 32
+                    cw_unpack_assert_space(1);
+                    unpack_context->item.type = (cwpack_item_types)*(int8_t*)p;
+                    cw_unpack_assert_blob(ext);
+        case 0xca:  unpack_context->item.type = cwpack::item_type::FLOAT;                 // float
+                    cw_unpack_assert_space(4);
+                    cw_load32(p);
+                    unpack_context->item.as.real = *(float*)&tmpu32;     return;
+        case 0xcb:  getDDItem8(cwpack::item_type::DOUBLE);                         return;  // double
+        case 0xcc:  getDDItem1(cwpack::item_type::POSITIVE_INTEGER, u64, uint8_t); return;  // unsigned int  8
+        case 0xcd:  getDDItem2(cwpack::item_type::POSITIVE_INTEGER, u64, uint16_t); return; // unsigned int 16
+        case 0xce:  getDDItem4(cwpack::item_type::POSITIVE_INTEGER, u64, uint32_t); return; // unsigned int 32
+        case 0xcf:  getDDItem8(cwpack::item_type::POSITIVE_INTEGER);               return;  // unsigned int 64
+        case 0xd0:  getDDItem1(cwpack::item_type::NEGATIVE_INTEGER, i64, int8_t);          // signed int  8
+                    if (unpack_context->item.as.i64 >= 0)
+                        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
+                    return;
+        case 0xd1:  getDDItem2(cwpack::item_type::NEGATIVE_INTEGER, i64, int16_t);        // signed int 16
+                    if (unpack_context->item.as.i64 >= 0)
+                        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
+                    return;
+        case 0xd2:  getDDItem4(cwpack::item_type::NEGATIVE_INTEGER, i64, int32_t);        // signed int 32
+                    if (unpack_context->item.as.i64 >= 0)
+                        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
+                    return;
+        case 0xd3:  getDDItem8(cwpack::item_type::NEGATIVE_INTEGER);                      // signed int 64
+                    if (unpack_context->item.as.i64 >= 0)
+                        unpack_context->item.type = cwpack::item_type::POSITIVE_INTEGER;
+                    return;
+        case 0xd4:  getDDItemFix(1);                                            // fixext 1
+        case 0xd5:  getDDItemFix(2);                                            // fixext 2
+        case 0xd6:  getDDItemFix(4);                                            // fixext 4
+        case 0xd7:  getDDItemFix(8);                                            // fixext 8
+        case 0xd8:  getDDItemFix(16);                                           // fixext 16
+        case 0xd9:  getDDItem1(cwpack::item_type::STR, str.length, uint8_t);              // str 8
+                    cw_unpack_assert_blob(str);
+        case 0xda:  getDDItem2(cwpack::item_type::STR, str.length, uint16_t);             // str 16
+                    cw_unpack_assert_blob(str);
+        case 0xdb:  getDDItem4(cwpack::item_type::STR, str.length, uint32_t);             // str 32
+                    cw_unpack_assert_blob(str);
+        case 0xdc:  getDDItem2(cwpack::item_type::ARRAY, array.size, uint16_t);   return;  // array 16
+        case 0xdd:  getDDItem4(cwpack::item_type::ARRAY, array.size, uint32_t);   return;  // array 32
+        case 0xde:  getDDItem2(cwpack::item_type::MAP, map.size, uint16_t);       return;  // map 16
+        case 0xdf:  getDDItem4(cwpack::item_type::MAP, map.size, uint32_t);       return;  // map 32
+        case 0xe0: case 0xe1: case 0xe2: case 0xe3: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
+        case 0xe8: case 0xe9: case 0xea: case 0xeb: case 0xec: case 0xed: case 0xee: case 0xef:
+        case 0xf0: case 0xf1: case 0xf2: case 0xf3: case 0xf4: case 0xf5: case 0xf6: case 0xf7:
+        case 0xf8: case 0xf9: case 0xfa: case 0xfb: case 0xfc: case 0xfd: case 0xfe: case 0xff:
+                    getDDItem(cwpack::item_type::NEGATIVE_INTEGER, i64, (int8_t)c); return;    // negative fixnum
+        default:
+                    UNPACK_ERROR(CWP_RC_MALFORMED_INPUT)
+    }
+}
+
+#define cw_skip_bytes(n)                                \
+    cw_unpack_assert_space((n));                          \
+    break;
+
+template <class Source>
+inline static void legacy_skip_items (cwpack::basic_unpack_context<Source>* unpack_context, long item_count)
+{
+    if (unpack_context->return_code)
+        return;
+
+    uint32_t    tmpu32;
+    uint16_t    tmpu16;
+    uint8_t*    p;
+
+    while (item_count-- > 0)
+    {
+        {
+            constexpr auto buffer_end_return_code = CWP_RC_END_OF_INPUT;
+            cw_unpack_assert_space(1);
+        }
+        uint8_t c = *p;
+
+        constexpr auto buffer_end_return_code = CWP_RC_BUFFER_UNDERFLOW;
+        switch (c)
+        {
+            case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
+            case 0x08: case 0x09: case 0x0a: case 0x0b: case 0x0c: case 0x0d: case 0x0e: case 0x0f:
+            case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17:
+            case 0x18: case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e: case 0x1f:
+            case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27:
+            case 0x28: case 0x29: case 0x2a: case 0x2b: case 0x2c: case 0x2d: case 0x2e: case 0x2f:
+            case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
+            case 0x38: case 0x39: case 0x3a: case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f:
+            case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47:
+            case 0x48: case 0x49: case 0x4a: case 0x4b: case 0x4c: case 0x4d: case 0x4e: case 0x4f:
+            case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x56: case 0x57:
+            case 0x58: case 0x59: case 0x5a: case 0x5b: case 0x5c: case 0x5d: case 0x5e: case 0x5f:
+            case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x66: case 0x67:
+            case 0x68: case 0x69: case 0x6a: case 0x6b: case 0x6c: case 0x6d: case 0x6e: case 0x6f:
+            case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
+            case 0x78: case 0x79: case 0x7a: case 0x7b: case 0x7c: case 0x7d: case 0x7e: case 0x7f:
+                                                                // unsigned fixint
+            case 0xe0: case 0xe1: case 0xe2: case 0xe3: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
+            case 0xe8: case 0xe9: case 0xea: case 0xeb: case 0xec: case 0xed: case 0xee: case 0xef:
+            case 0xf0: case 0xf1: case 0xf2: case 0xf3: case 0xf4: case 0xf5: case 0xf6: case 0xf7:
+            case 0xf8: case 0xf9: case 0xfa: case 0xfb: case 0xfc: case 0xfd: case 0xfe: case 0xff:
+                                                                // signed fixint
+            case 0xc0:                                          // nil
+            case 0xc2:                                          // false
+            case 0xc3:  break;                                  // true
+            case 0xcc:                                          // unsigned int  8
+            case 0xd0:	cw_skip_bytes(1);                       // signed int  8
+            case 0xcd:                                          // unsigned int 16
+            case 0xd1:                                          // signed int 16
+            case 0xd4:  cw_skip_bytes(2);                       // fixext 1
+            case 0xd5:  cw_skip_bytes(3);                       // fixext 2
+            case 0xca:                                          // float
+            case 0xce:                                          // unsigned int 32
+            case 0xd2:  cw_skip_bytes(4);                       // signed int 32
+            case 0xd6:  cw_skip_bytes(5);                       // fixext 4
+            case 0xcb:                                          // double
+            case 0xcf:                                          // unsigned int 64
+            case 0xd3:  cw_skip_bytes(8);                       // signed int 64
+            case 0xd7:  cw_skip_bytes(9);                       // fixext 8
+            case 0xd8:  cw_skip_bytes(17);                      // fixext 16
+            case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6: case 0xa7:
+            case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf:
+            case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7:
+            case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+                cw_skip_bytes(c & 0x1f);                        // fixstr
+            case 0xd9:                                          // str 8
+            case 0xc4:                                          // bin 8
+                cw_unpack_assert_space(1);
+                tmpu32 = *p;
+                cw_skip_bytes(tmpu32);
+
+            case 0xda:                                          // str 16
+            case 0xc5:                                          // bin 16
+                cw_unpack_assert_space(2);
+                cw_load16(p);
+                cw_skip_bytes(tmpu16);
+
+            case 0xdb:                                          // str 32
+            case 0xc6:                                          // bin 32
+                cw_unpack_assert_space(4);
+                cw_load32(p);
+                cw_skip_bytes(tmpu32);
+
+            case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x86: case 0x87:
+            case 0x88: case 0x89: case 0x8a: case 0x8b: case 0x8c: case 0x8d: case 0x8e: case 0x8f:
+                item_count += 2*(c & 15);                       // FixMap
+                break;
+
+            case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x96: case 0x97:
+            case 0x98: case 0x99: case 0x9a: case 0x9b: case 0x9c: case 0x9d: case 0x9e: case 0x9f:
+                item_count += c & 15;                           // FixArray
+                break;
+
+            case 0xdc:                                          // array 16
+                cw_unpack_assert_space(2);
+                cw_load16(p);
+                item_count += tmpu16;
+                break;
+
+            case 0xde:                                          // map 16
+                cw_unpack_assert_space(2);
+                cw_load16(p);
+                item_count += 2*tmpu16;
+                break;
+
+            case 0xdd:                                          // array 32
+                cw_unpack_assert_space(4);
+                cw_load32(p);
+                item_count += tmpu32;
+                break;
+
+            case 0xdf:                                          // map 32
+                cw_unpack_assert_space(4);
+                cw_load32(p);
+                item_count += 2*tmpu32;
+                break;
+
+            case 0xc7:                                          // ext 8
+                cw_unpack_assert_space(1);
+                tmpu32 = *p;
+                cw_skip_bytes(tmpu32 +1);
+
+            case 0xc8:                                          // ext 16
+                cw_unpack_assert_space(2);
+                cw_load16(p);
+                cw_skip_bytes(tmpu16 +1);
+
+            case 0xc9:                                          // ext 32
+                cw_unpack_assert_space(4);
+                cw_load32(p);
+                cw_skip_bytes(tmpu32 +1);
+
+            default:                                            // illegal
+                UNPACK_ERROR(CWP_RC_MALFORMED_INPUT)
+        }
+    }
+}
+
+
+
+/*************************   P A Y L O A D S   *******************************/
+
+typedef void (*payload_generator)(cw_pack_context* pc, int i);
+
+static void gen_fixint (cw_pack_context* pc, int i)     { cw_pack_signed(pc, (i % 150) - 30); }
+static void gen_uint16 (cw_pack_context* pc, int i)     { cw_pack_unsigned(pc, 1000 + i % 60000); }
+static void gen_int32 (cw_pack_context* pc, int i)      { cw_pack_signed(pc, -100000 - i); }
+static void gen_double (cw_pack_context* pc, int i)     { cw_pack_double(pc, i * 1.25); }
+static void gen_fixstr (cw_pack_context* pc, int i)     { cw_pack_str(pc, "hostname", 4 + i % 5); }
+static void gen_str8 (cw_pack_context* pc, int i)       { cw_pack_str(pc, "a log message of moderate length, longer than 32", 40 + i % 8); }
+static void gen_bin16 (cw_pack_context* pc, int i)
+{
+    static uint8_t blob[400];
+    cw_pack_bin(pc, blob, 300 + i % 100);
+}
+static void gen_timestamp (cw_pack_context* pc, int i)  { cw_pack_time(pc, 1700000000 + i, (uint32_t)i); }
+
+/* A telemetry record as found in our logs, a map with mixed content */
+static void gen_record (cw_pack_context* pc, int i)
+{
+    cw_pack_map_size(pc, 6);
+    cw_pack_str(pc, "ts", 2);       cw_pack_time(pc, 1700000000 + i, 0);
+    cw_pack_str(pc, "host", 4);     cw_pack_str(pc, "web-frontend-17", 15);
+    cw_pack_str(pc, "cpu", 3);      cw_pack_double(pc, 0.37 * (i % 100));
+    cw_pack_str(pc, "mem", 3);      cw_pack_unsigned(pc, 1000000u + (unsigned)i);
+    cw_pack_str(pc, "tags", 4);
+    cw_pack_array_size(pc, 3);
+    cw_pack_str(pc, "prod", 4);     cw_pack_str(pc, "eu-west", 7);      cw_pack_nil(pc);
+    cw_pack_str(pc, "vals", 4);
+    cw_pack_array_size(pc, 8);
+    for (int j = 0; j < 8; j++)
+        cw_pack_signed(pc, (i + j) % 200 - 50);
+}
+
+/* A telemetry sample array, mostly small integers with an occasional larger value */
+static void gen_samples (cw_pack_context* pc, int i)
+{
+    cw_pack_array_size(pc, 32);
+    for (int j = 0; j < 32; j++)
+    {
+        if ((i + j) % 29 == 0)
+            cw_pack_unsigned(pc, 70000);
+        else if ((i + j) % 13 == 0)
+            cw_pack_nil(pc);
+        else
+            cw_pack_signed(pc, (i * 7 + j) % 120 - 20);
+    }
+}
+
+
+struct payload {
+    const char*         name;
+    payload_generator   generate;
+};
+
+static const payload payloads[] = {
+    {"fixint",      gen_fixint},
+    {"uint16",      gen_uint16},
+    {"int32",       gen_int32},
+    {"double",      gen_double},
+    {"fixstr",      gen_fixstr},
+    {"str8",        gen_str8},
+    {"bin16",       gen_bin16},
+    {"timestamp",   gen_timestamp},
+    {"record",      gen_record},
+    {"samples",     gen_samples},
+};
+
+
+
+/*************************   M E A S U R E M E N T   *************************/
+
+static uint8_t* volatile decoded_end;     /* keeps the optimizer from dropping the decode */
+
+template <class Decoder>
+static double best_ns_per_item (const dynamic_memory_pack_context& dmpc, unsigned long items, Decoder decode)
+{
+    double best = 1e30;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        cw_static_unpack_context uc;
+        cw_unpack_context_init(&uc, dmpc.pc.start, (unsigned long)(dmpc.pc.current - dmpc.pc.start));
+        auto start = std::chrono::steady_clock::now();
+        decode(&uc);
+        auto stop = std::chrono::steady_clock::now();
+        decoded_end = uc.current;
+        double ns = std::chrono::duration<double, std::nano>(stop - start).count() / (double)items;
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+
+static unsigned long count_items (const dynamic_memory_pack_context& dmpc)
+{
+    cw_static_unpack_context uc;
+    cw_unpack_context_init(&uc, dmpc.pc.start, (unsigned long)(dmpc.pc.current - dmpc.pc.start));
+    unsigned long n = 0;
+    for (cw_unpack_next(&uc); !uc.return_code; cw_unpack_next(&uc))
+        n++;
+    return n;
+}
+
+
+static bool same_items (const dynamic_memory_pack_context& dmpc)
+{
+    cw_static_unpack_context a, b;
+    unsigned long length = (unsigned long)(dmpc.pc.current - dmpc.pc.start);
+    cw_unpack_context_init(&a, dmpc.pc.start, length);
+    cw_unpack_context_init(&b, dmpc.pc.start, length);
+    for (;;)
+    {
+        cw_unpack_next(&a);
+        legacy_unpack_next(&b);
+        if (a.return_code != b.return_code || a.current != b.current || a.item.type != b.item.type)
+            return false;
+        if (a.return_code)
+            return true;
+        switch (a.item.type)
+        {
+            case cwpack::item_type::NIL:                                                        break;
+            case cwpack::item_type::BOOLEAN:    if (a.item.as.boolean != b.item.as.boolean)     return false; break;
+            case cwpack::item_type::FLOAT:      if (a.item.as.real != b.item.as.real)           return false; break;
+            case cwpack::item_type::ARRAY:
+            case cwpack::item_type::MAP:        if (a.item.as.map.size != b.item.as.map.size)   return false; break;
+            case cwpack::item_type::TIMESTAMP:
+                if (a.item.as.time.tv_sec != b.item.as.time.tv_sec || a.item.as.time.tv_nsec != b.item.as.time.tv_nsec)
+                    return false;
+                break;
+            case cwpack::item_type::POSITIVE_INTEGER:
+            case cwpack::item_type::NEGATIVE_INTEGER:
+            case cwpack::item_type::DOUBLE:     if (a.item.as.u64 != b.item.as.u64)             return false; break;
+            default:
+                if (a.item.as.ext.start != b.item.as.ext.start || a.item.as.ext.length != b.item.as.ext.length)
+                    return false;
+        }
+    }
+}
+
+
+int main(int argc, const char * argv[])
+{
+    (void)argc;(void)argv;
+    int errors = 0;
+
+    printf("CWPack decode benchmark, ns/item, best of %d rounds\n\n", ROUNDS);
+    printf("%-10s %10s %10s %10s %10s %10s\n", "payload", "items", "next:sw", "next:tab", "skip:sw", "skip:tab");
+
+    for (const payload& pl : payloads)
+    {
+        dynamic_memory_pack_context dmpc;
+        init_dynamic_memory_pack_context(&dmpc, 1 << 20);
+        for (int i = 0; i < ITEMS; i++)
+            pl.generate(&dmpc.pc, i);
+
+        unsigned long items = count_items(dmpc);
+        double next_switch = best_ns_per_item(dmpc, items, [](cw_static_unpack_context* uc) {
+            for (legacy_unpack_next(uc); !uc->return_code; legacy_unpack_next(uc));
+        });
+        double next_table = best_ns_per_item(dmpc, items, [](cw_static_unpack_context* uc) {
+            for (cw_unpack_next(uc); !uc->return_code; cw_unpack_next(uc));
+        });
+        double skip_switch = best_ns_per_item(dmpc, items, [](cw_static_unpack_context* uc) {
+            legacy_skip_items(uc, ITEMS);
+        });
+        double skip_table = best_ns_per_item(dmpc, items, [](cw_static_unpack_context* uc) {
+            cw_skip_items(uc, ITEMS);
+        });
+        printf("%-10s %10lu %10.2f %10.2f %10.2f %10.2f\n", pl.name, items, next_switch, next_table, skip_switch, skip_table);
+
+        if (!same_items(dmpc))
+        {
+            printf("ERROR: decoders differ for %s\n", pl.name);
+            errors++;
+        }
+        free_dynamic_memory_pack_context(&dmpc);
+    }
+
+    return errors;
+}
@@ -26,10 +26,32 @@
 #include <string.h>
 
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cmath>
+#include <string>
 
 #include "cwpack.hpp"
 #include "cwpack_config.h"
 #include "cwpack_utils.h"
+#include "cwpack_tape.h"
+#include "cwpack_view.h"
+#include "cwpack_path.h"
+#include "cwpack_reflect.h"
+#include "basic_contexts.h"
+#include "iovec_context.h"
+#include "uring_context.h"
+#include "readahead_context.h"
+#include "mmap_context.h"
+#include "rope_context.h"
+#include "ring_context.h"
+#include "frame_stream.h"
+#include "cwpack_parallel.h"
+#include "compress_context.h"
+#include "checksum_context.h"
+#include "cwpack_json.h"
 
 
 cw_pack_context pack_ctx;
@@ -39,6 +61,30 @@ uint8_t outbuffer[70000];
 
 int error_count;
 
+namespace reflect_test {
+
+enum class side : uint8_t { buy, sell };
+
+struct line {
+    std::string         sku;
+    uint32_t            quantity = 0;
+    double              price = 0;
+};
+CWPACK_DEFINE(line, sku, quantity, price)
+
+struct order {
+    int64_t             id = 0;
+    side                direction = side::buy;
+    bool                urgent = false;
+    float               discount = 0;
+    std::vector<line>   lines;
+    std::vector<int16_t> tags;
+    std::string         a_rather_long_field_name_for_str8_keys;
+};
+CWPACK_DEFINE(order, id, direction, urgent, discount, lines, tags, a_rather_long_field_name_for_str8_keys)
+
+}
+
 static void ERROR(const char* msg)
 {
     error_count++;
@@ -330,6 +376,22 @@ int main(int argc, const char * argv[])
 
     TESTP(time_interval,-0.5,"c70cff1dcd6500ffffffffffffffff");
 
+    //*******************   TEST static pack context   ***************
+
+    {
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, 4);
+        cw_pack_unsigned (&spc, 65535);
+        if (spc.return_code || spc.current - spc.start != 3 || memcmp(outbuffer, "\xcd\xff\xff", 3))
+            ERROR("In static context pack");
+        cw_pack_unsigned (&spc, 65535);
+        if (spc.return_code != CWP_RC_BUFFER_OVERFLOW)
+            ERROR("In static context, no overflow");
+        cw_pack_flush (&spc);
+        if (spc.return_code != CWP_RC_BUFFER_OVERFLOW)
+            ERROR("In static context, flush changed error");
+    }
+
     //*******************   TEST cwpack unpack   **********************
 
     char inputbuf[30];
@@ -480,6 +542,1354 @@ int main(int argc, const char * argv[])
     }
 
 
+    //*******************   TEST static unpack context   ***************
+
+    {
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, pack_ctx.start, (unsigned long)(pack_ctx.current-pack_ctx.start));
+        cw_skip_items (&suc, 1);
+        if (cw_unpack_next_unsigned32 (&suc) != 0x952 || suc.return_code)
+            ERROR("In static context unpack");
+        cw_unpack_next (&suc);
+        if (suc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR("In static context, no end of input");
+
+        cw_unpack_context_init (&suc, pack_ctx.start, (unsigned long)(pack_ctx.current-pack_ctx.start) - 1);
+        cw_skip_items (&suc, 1);
+        cw_unpack_next (&suc);
+        if (suc.return_code != CWP_RC_BUFFER_UNDERFLOW)
+            ERROR("In static context, no underflow");
+    }
+
+
+    //*******************   TEST skip of single byte runs   ***********
+
+    {
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_array_size (&spc, 100);
+        for (int i = 0; i < 100; i++)
+        {
+            if (i == 70)
+                cw_pack_unsigned (&spc, 1000);
+            else if (i % 9 == 0)
+                cw_pack_nil (&spc);
+            else if (i % 11 == 0)
+                cw_pack_boolean (&spc, i & 1);
+            else
+                cw_pack_signed (&spc, i - 50);
+        }
+        cw_pack_unsigned (&spc, 0x952);
+
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        cw_skip_items (&suc, 1);
+        if (cw_unpack_next_unsigned32 (&suc) != 0x952 || suc.return_code)
+            ERROR("In skip of single byte run");
+
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        cw_unpack_next (&suc);
+        cw_skip_items (&suc, 40);
+        if (cw_unpack_next_signed32 (&suc) != -10 || suc.return_code)
+            ERROR("In partial skip of single byte run");
+
+        for (unsigned long start = 0; start < 64; start++)
+        {
+            const uint8_t* p = spc.start + start;
+            if (cwpack::simd::single_byte_run (p, spc.current, 1000) != cwpack::simd::scalar_single_byte_run (p, spc.current, 1000))
+                ERROR("Vectorized single byte run differs from scalar");
+        }
+    }
+
+
+    //*******************   TEST tape   *******************************
+
+    {
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_map_size (&spc, 2);
+        cw_pack_str (&spc, "list", 4);
+        cw_pack_array_size (&spc, 300);
+        for (int i = 0; i < 300; i++)
+        {
+            cw_pack_array_size (&spc, 2);
+            cw_pack_unsigned (&spc, i);
+            cw_pack_str (&spc, TEST_area, i);
+        }
+        cw_pack_str (&spc, "tail", 4);
+        cw_pack_time (&spc, 17, 4711);
+        cw_pack_nil (&spc);
+
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        cw_tape tape;
+        init_cw_tape (&tape, 16);
+        if (build_cw_tape (&tape, &suc) || suc.current != spc.current || tape.count != 3 + 3*300 + 3)
+            ERROR("In tape build");
+
+        unsigned long list = cw_tape_child (&tape, 0, 1);
+        unsigned long element = cw_tape_child (&tape, list, 250);
+        cw_tape_unpack (&tape, cw_tape_child (&tape, element, 0), &suc);
+        if (cw_tape_type (&tape, list) != cwpack::item_type::ARRAY || suc.item.as.u64 != 250)
+            ERROR("In tape child");
+        if (cw_tape_item_length (&tape, cw_tape_child (&tape, element, 1)) != 2 + 250)
+            ERROR("In tape item length");
+
+        unsigned long tail = cw_tape_next_sibling (&tape, list);
+        cw_tape_unpack (&tape, cw_tape_child (&tape, 0, 3), &suc);
+        if (cw_tape_type (&tape, tail) != cwpack::item_type::STR ||
+            suc.item.type != cwpack::item_type::TIMESTAMP || suc.item.as.time.tv_nsec != 4711)
+            ERROR("In tape sibling");
+        if (cw_tape_next_sibling (&tape, 0) != tape.count - 1 || cw_tape_child (&tape, 0, 4) != tape.count - 1)
+            ERROR("In tape subtree end");
+
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start) - 1 - 5);
+        if (build_cw_tape (&tape, &suc) != CWP_RC_BUFFER_UNDERFLOW)
+            ERROR("In tape of truncated buffer");
+        free_cw_tape (&tape);
+    }
+
+
+    //*******************   TEST view   *******************************
+
+    {
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_map_size (&spc, 52);
+        for (int i = 0; i < 50; i++)
+        {
+            char key[8];
+            snprintf (key, sizeof(key), "f%d", i);
+            cw_pack_cstr (&spc, key);
+            cw_pack_signed (&spc, -i);
+        }
+        cw_pack_cstr (&spc, "orders");
+        cw_pack_array_size (&spc, 3);
+        for (int i = 0; i < 3; i++)
+        {
+            cw_pack_map_size (&spc, 2);
+            cw_pack_cstr (&spc, "price");
+            cw_pack_double (&spc, 1.5 * i);
+            cw_pack_cstr (&spc, "code");
+            cw_pack_bin (&spc, TEST_area, i);
+        }
+        cw_pack_cstr (&spc, "name");
+        cw_pack_cstr (&spc, "view");
+
+        cwpack::document doc (spc.start, (unsigned long)(spc.current - spc.start));
+        cwpack::view root = doc.root();
+        if (root["f42"].as_int64() != -42 || root["f7"].as_int64() != -7 || root["f49"].as_double() != -49.0)
+            ERROR("In view map lookup");
+        if (root["orders"][2]["price"].as_double() != 3.0 || root["orders"][1]["code"].as_binary().size() != 1)
+            ERROR("In view path");
+        if (root["name"].as_string() != "view" || root.size() != 52 || root.key(50).as_string() != "orders")
+            ERROR("In view string");
+        if (root["missing"]["price"].exists() || root["orders"][3].exists() || root["f1"].as_uint64(17) != 17)
+            ERROR("In view of missing item");
+        if (root["orders"][0].raw().size() != 1 + 6 + 9 + 5 + 2)
+            ERROR("In view raw");
+
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_array_size (&spc, 4);
+        cw_pack_time (&spc, 1, 0);
+        cw_pack_time (&spc, 1, 999999999);
+        cw_pack_time (&spc, -1, 999999999);
+        cw_pack_ext (&spc, 5, "abc", 3);
+        cwpack::document times (spc.start, (unsigned long)(spc.current - spc.start));
+        cwpack::view t = times.root();
+        if (t[0].size() != 4 || t[1].size() != 8 || t[2].size() != 12 || t[3].size() != 3 || t[2].type() != cwpack::item_type::TIMESTAMP)
+            ERROR("In view size of timestamps");
+    }
+
+
+    //*******************   TEST find key   ***************************
+
+    {
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_map_size (&spc, 6);
+        cw_pack_unsigned (&spc, 5);
+        cw_pack_cstr (&spc, "route");
+        cw_pack_cstr (&spc, "rout");
+        cw_pack_array_size (&spc, 2);
+        cw_pack_nil (&spc);
+        cw_pack_nil (&spc);
+        cw_pack_str (&spc, TEST_area, 40);
+        cw_pack_unsigned (&spc, 40);
+        cw_pack_cstr (&spc, "route");
+        cw_pack_unsigned (&spc, 17);
+        cw_pack_set_compatibility (&spc, true);
+        cw_pack_cstr (&spc, "id");
+        cw_pack_unsigned (&spc, 4711);
+        cw_pack_str (&spc, TEST_area, 33);
+        cw_pack_unsigned (&spc, 33);
+        cw_pack_unsigned (&spc, 0x952);
+
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        uint32_t pairs = cw_unpack_next_map_size (&suc);
+        long found = cw_unpack_find_key (&suc, pairs, "route", 5);
+        if (found != 3 || cw_unpack_next_unsigned32 (&suc) != 17)
+            ERROR("In find key");
+        if (cw_unpack_find_key (&suc, pairs - found - 1, "none", 4) != -1 || cw_unpack_next_unsigned32 (&suc) != 0x952)
+            ERROR("In find missing key");
+
+        cwpack::map_key keys[3] = {{TEST_area, 33}, {"id", 2}, {TEST_area, 40}};
+        int key_index = -1;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        pairs = cw_unpack_next_map_size (&suc);
+        found = cw_unpack_find_keys (&suc, pairs, keys, 3, &key_index);
+        if (found != 2 || key_index != 2 || cw_unpack_next_unsigned32 (&suc) != 40)
+            ERROR("In find keys");
+        pairs -= found + 1;
+        found = cw_unpack_find_keys (&suc, pairs, keys, 3, &key_index);
+        if (found != 1 || key_index != 1 || cw_unpack_next_unsigned32 (&suc) != 4711)
+            ERROR("In find keys, second key");
+        pairs -= found + 1;
+        found = cw_unpack_find_keys (&suc, pairs, keys, 3, &key_index);
+        if (found != 0 || key_index != 0 || cw_unpack_next_unsigned32 (&suc) != 33 || suc.return_code)
+            ERROR("In find keys, compatibility header");
+    }
+
+
+    //*******************   TEST path   *******************************
+
+    {
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_map_size (&spc, 2);
+        cw_pack_cstr (&spc, "a/b");
+        cw_pack_unsigned (&spc, 1);
+        cw_pack_cstr (&spc, "orders");
+        cw_pack_array_size (&spc, 3);
+        for (int i = 0; i < 3; i++)
+        {
+            cw_pack_map_size (&spc, 2);
+            cw_pack_cstr (&spc, "items");
+            cw_pack_array_size (&spc, i + 2);
+            for (int j = 0; j < i + 2; j++)
+            {
+                cw_pack_map_size (&spc, 1);
+                cw_pack_cstr (&spc, "price");
+                cw_pack_unsigned (&spc, 10 * i + j);
+            }
+            cw_pack_cstr (&spc, "id");
+            cw_pack_unsigned (&spc, i);
+        }
+        cw_pack_unsigned (&spc, 0x952);
+
+        cwpack::path price ("/orders/*/items/3/price");
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        uint64_t sum = 0;
+        int count = 0;
+        price.evaluate (&suc, [&](const cwpack::path_match& match)
+        {
+            sum += match.item.as.u64;
+            count++;
+            return true;
+        });
+        if (count != 1 || sum != 23 || cw_unpack_next_unsigned32 (&suc) != 0x952)
+            ERROR("In path evaluate");
+
+        std::vector<std::span<const uint8_t>> ids = cwpack::path("/orders/*/id").select (spc.start, (unsigned long)(spc.current - spc.start));
+        if (ids.size() != 3 || ids[2].size() != 1 || ids[2][0] != 2)
+            ERROR("In path select");
+        if (cwpack::path("/a~1b").select (spc.start, (unsigned long)(spc.current - spc.start)).size() != 1 ||
+            cwpack::path("/orders/1/items").select (spc.start, (unsigned long)(spc.current - spc.start))[0][0] != 0x93 ||
+            cwpack::path("").select (spc.start, (unsigned long)(spc.current - spc.start))[0].size() != (unsigned long)(spc.current - spc.start) - 3)
+            ERROR("In path steps");
+        if (cwpack::path("orders").status() != CWP_RC_MALFORMED_INPUT || cwpack::path("/a~2").status() != CWP_RC_MALFORMED_INPUT)
+            ERROR("In path compile");
+
+        uint8_t zeros[16];
+        cw_static_pack_context zpc;
+        cw_pack_context_init (&zpc, zeros, sizeof(zeros));
+        cw_pack_array_size (&zpc, 1);
+        cw_pack_map_size (&zpc, 1);
+        cw_pack_cstr (&zpc, "00");
+        cw_pack_true (&zpc);
+        if (cwpack::path("/00").select (zpc.start, (unsigned long)(zpc.current - zpc.start)).size() != 0 ||
+            cwpack::path("/0/00").select (zpc.start, (unsigned long)(zpc.current - zpc.start)).size() != 1)
+            ERROR("In path of a zero padded key");
+
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        if (cwpack::path("/orders/*").evaluate (&suc, [](const cwpack::path_match&) { return false; }) != CWP_RC_STOPPED)
+            ERROR("In path stop");
+
+        FILE* file = tmpfile();
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_array_size (&spc, 21);
+        for (int i = 0; i < 20; i++)
+            cw_pack_unsigned (&spc, 0x10000000 + i);
+        cw_pack_cstr (&spc, "straddles a refill");
+        fwrite (spc.start, 1, (size_t)(spc.current - spc.start), file);
+        rewind (file);
+        stream_unpack_context stuc;
+        init_stream_unpack_context (&stuc, 8, file);
+        count = 0;
+        cwpack::path("/*").evaluate (&stuc.uc, [&](const cwpack::path_match& match)
+        {
+            if (count < 20 ? match.start[0] != 0xce || match.start[4] != count : match.start[0] != 0xb2 || match.start + 1 != match.item.as.str.start)
+                ERROR("In path evaluate on stream context");
+            count++;
+            return true;
+        });
+        if (count != 21 || stuc.uc.return_code)
+            ERROR("In path evaluate on stream context, count");
+        terminate_stream_unpack_context (&stuc);
+        fclose (file);
+    }
+
+
+    //*******************   TEST reflection   *************************
+
+    {
+        reflect_test::order o;
+        o.id = -4711;
+        o.direction = reflect_test::side::sell;
+        o.urgent = true;
+        o.discount = 0.5f;
+        o.lines = {{"apple", 3, 1.25}, {"pear", 1, 2.5}};
+        o.tags = {-1, 300};
+        o.a_rather_long_field_name_for_str8_keys = "long";
+
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_struct (&spc, o);
+        if (outbuffer[0] != 0x87 || outbuffer[1] != 0xa2 || outbuffer[2] != 'i' || outbuffer[3] != 'd')
+            ERROR("In reflection pack");
+
+        reflect_test::order r;
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        cw_unpack_next_struct (&suc, r);
+        if (suc.return_code || r.id != o.id || r.direction != o.direction || !r.urgent || r.discount != 0.5f ||
+            r.lines.size() != 2 || r.lines[1].sku != "pear" || r.lines[0].price != 1.25 || r.tags[1] != 300 ||
+            r.a_rather_long_field_name_for_str8_keys != "long")
+            ERROR("In reflection round trip");
+
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_set_compatibility (&spc, true);
+        cw_pack_struct (&spc, o);
+        std::string_view packed ((const char*)spc.start, (size_t)(spc.current - spc.start));
+        size_t k = packed.find ("a_rather_long_field_name_for_str8_keys");
+        reflect_test::order rc;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        cw_unpack_next_struct (&suc, rc);
+        if (k == std::string_view::npos || k < 3 || packed.substr(k - 3, 3) != std::string_view("\xda\x00\x26", 3) || suc.return_code ||
+            rc.id != o.id || rc.a_rather_long_field_name_for_str8_keys != "long")
+            ERROR("In reflection in compatibility mode");
+
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cw_pack_map_size (&spc, 3);
+        cw_pack_cstr (&spc, "unknown");
+        cw_pack_array_size (&spc, 1);
+        cw_pack_nil (&spc);
+        cw_pack_cstr (&spc, "quantity");
+        cw_pack_unsigned (&spc, 12);
+        cw_pack_cstr (&spc, "sku");
+        cw_pack_cstr (&spc, "plum");
+        reflect_test::line l;
+        l.price = 9;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        cw_unpack_next_struct (&suc, l);
+        if (suc.return_code || l.quantity != 12 || l.sku != "plum" || l.price != 9)
+            ERROR("In reflection of reordered keys");
+
+        const uint8_t huge_tags[] = {0x81, 0xa4, 't', 'a', 'g', 's', 0xdd, 0xff, 0xff, 0xff, 0xff, 1};
+        cw_unpack_context_init (&suc, huge_tags, sizeof(huge_tags));
+        cw_unpack_next_struct (&suc, r);
+        if (suc.return_code != CWP_RC_END_OF_INPUT || r.tags.size() > 2 || r.tags.capacity() > 16)
+            ERROR("In reflection of an untrusted array size");
+    }
+
+
+    //*******************   TEST deferred container size   ************
+
+    {
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, sizeof(outbuffer));
+        cwpack::container_slot outer = cw_pack_map_begin (&spc);
+        cw_pack_cstr (&spc, "list");
+        cwpack::container_slot inner = cw_pack_array_begin (&spc);
+        for (int i = 0; i < 20; i++)
+            cw_pack_unsigned (&spc, i);
+        cw_pack_array_end (&spc, inner, 20, true);
+        cw_pack_cstr (&spc, "empty");
+        cw_pack_array_end (&spc, cw_pack_array_begin (&spc), 0, true);
+        cw_pack_map_end (&spc, outer, 2);
+        if (spc.return_code || outbuffer[0] != 0xdf || outbuffer[4] != 2 || outbuffer[10] != 0xdc ||
+            outbuffer[12] != 20 || outbuffer[39] != 0x90 || spc.current - spc.start != 40)
+            ERROR("In deferred container size");
+
+        cw_pack_map_end (&spc, outer, 2, true);
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, spc.start, (unsigned long)(spc.current - spc.start));
+        if (cw_unpack_next_map_size (&suc) != 2 || outbuffer[0] != 0x82 || spc.current - spc.start != 36)
+            ERROR("In compacted container size");
+        cw_skip_items (&suc, 3);
+        if (cw_unpack_next_array_size (&suc) != 0 || suc.current != spc.current)
+            ERROR("In compacted container contents");
+
+        FILE* file = tmpfile();
+        file_pack_context fpc;
+        init_file_pack_context (&fpc, 64, fileno(file));
+        cw_pack_unsigned ((cw_pack_context*)&fpc, 0x952);
+        cwpack::container_slot slot = file_pack_context_array_begin (&fpc);
+        for (int i = 0; i < 100; i++)
+            cw_pack_unsigned ((cw_pack_context*)&fpc, 1000 + i);
+        file_pack_context_array_end (&fpc, slot, 100, true);
+        cw_pack_nil ((cw_pack_context*)&fpc);
+        if (fpc.barrier || fpc.pc.return_code)
+            ERROR("In deferred size with file context");
+        terminate_file_pack_context (&fpc);
+
+        uint8_t* written = (uint8_t*)TEST_area;
+        rewind (file);
+        unsigned long length = fread (written, 1, sizeof(TEST_area), file);
+        fclose (file);
+        cw_unpack_context_init (&suc, written, length);
+        if (cw_unpack_next_unsigned32 (&suc) != 0x952 || cw_unpack_next_array_size (&suc) != 100 || written[3] != 0xdc)
+            ERROR("In deferred size with file context, header");
+        cw_skip_items (&suc, 99);
+        if (cw_unpack_next_unsigned32 (&suc) != 1099 || (cw_unpack_next_nil (&suc), suc.return_code) || suc.current != suc.end)
+            ERROR("In deferred size with file context, contents");
+        for (ui=0; ui<70000; ui++)
+            TEST_area[ui] = ui & 0x7fUL;
+    }
+
+
+    //*******************   TEST iovec pack context   ****************
+
+    {
+        iovec_pack_context ipc;
+        init_iovec_pack_context (&ipc, 64, 1000);
+        cw_pack_map_size (&ipc, 3);
+        cw_pack_cstr (&ipc, "attachment");
+        cw_pack_bin (&ipc, TEST_area, 60000);
+        cw_pack_cstr (&ipc, "note");
+        cw_pack_str (&ipc, TEST_area, 999);
+        cw_pack_cstr (&ipc, "ext");
+        cw_pack_ext (&ipc, 5, TEST_area + 1, 2000);
+
+        int count;
+        const struct iovec* iov = iovec_pack_context_iov (&ipc, &count);
+        unsigned long length = iovec_pack_context_length (&ipc);
+        if (ipc.return_code || count != 6 || iov[1].iov_base != TEST_area || iov[5].iov_base != TEST_area + 1 ||
+            length != 1 + 11 + 3 + 60000 + 5 + 3 + 999 + 4 + 4 + 2000)
+            ERROR("In iovec pack context");
+
+        FILE* file = tmpfile();
+        if (iovec_pack_context_writev (&ipc, fileno(file)))
+            ERROR("In iovec pack context writev");
+        rewind (file);
+        if (fread (outbuffer, 1, sizeof(outbuffer), file) != length)
+            ERROR("In iovec pack context, written length");
+        fclose (file);
+
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, outbuffer, length);
+        if (cw_unpack_next_map_size (&suc) != 3)
+            ERROR("In iovec pack context, map");
+        cw_skip_items (&suc, 1);
+        cw_unpack_next (&suc);
+        if (suc.item.type != cwpack::item_type::BIN || suc.item.as.bin.length != 60000 || memcmp (suc.item.as.bin.start, TEST_area, 60000))
+            ERROR("In iovec pack context, referenced bin");
+        cw_skip_items (&suc, 3);
+        cw_unpack_next (&suc);
+        if (suc.item.type != (cwpack::item_type)5 || suc.item.as.ext.length != 2000 || suc.current != suc.end)
+            ERROR("In iovec pack context, referenced ext");
+
+        reset_iovec_pack_context (&ipc);
+        cw_pack_nil (&ipc);
+        if (iovec_pack_context_length (&ipc) != 1)
+            ERROR("In iovec pack context reset");
+
+        reset_iovec_pack_context (&ipc);
+        cwpack::container_slot slot = cw_pack_array_begin (&ipc);
+        cw_pack_nil (&ipc);
+        cw_pack_bin (&ipc, TEST_area, 5000);
+        cw_pack_array_end (&ipc, slot, 2, true);
+        if (ipc.return_code != CWP_RC_ILLEGAL_CALL)
+            ERROR("In iovec pack context, compacting over a reference");
+        reset_iovec_pack_context (&ipc);
+        slot = cw_pack_array_begin (&ipc);
+        cw_pack_nil (&ipc);
+        cw_pack_bin (&ipc, TEST_area, 5000);
+        cw_pack_array_end (&ipc, slot, 2);
+        cw_static_unpack_context ruc;
+        iov = iovec_pack_context_iov (&ipc, &count);
+        cw_unpack_context_init (&ruc, iov[0].iov_base, (unsigned long)iov[0].iov_len);
+        if (ipc.return_code || count != 2 || iov[1].iov_base != TEST_area || cw_unpack_next_array_size (&ruc) != 2)
+            ERROR("In iovec pack context, deferred size over a reference");
+        terminate_iovec_pack_context (&ipc);
+    }
+
+
+    //*******************   TEST uring file pack context   ****************
+
+    {
+        FILE* file = tmpfile();
+        uring_file_pack_context upc;
+        init_uring_file_pack_context (&upc, 64, 3, fileno(file));
+        cw_pack_array_size (&upc.pc, 1000);
+        for (int i = 0; i < 1000; i++)
+        {
+            if (i == 500)
+                uring_file_pack_context_set_barrier (&upc);
+            cw_pack_unsigned (&upc.pc, (uint64_t)i * 1000);
+        }
+        if (upc.pc.return_code || upc.pc.end - upc.pc.start < 500 * 3)
+            ERROR("In uring file pack context with barrier");
+        uring_file_pack_context_release_barrier (&upc);
+        cw_pack_str (&upc.pc, TEST_area, 300);
+        terminate_uring_file_pack_context (&upc);
+        if (upc.pc.return_code)
+            ERROR("In uring file pack context terminate");
+
+        long length = ftell (file);
+        rewind (file);
+        if (length <= 0 || fread (outbuffer, 1, sizeof(outbuffer), file) != (unsigned long)length)
+            ERROR("In uring file pack context, written length");
+        fclose (file);
+
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, outbuffer, length);
+        if (cw_unpack_next_array_size (&suc) != 1000)
+            ERROR("In uring file pack context, array");
+        for (int i = 0; i < 1000; i++)
+            if (cw_unpack_next_unsigned64 (&suc) != (uint64_t)i * 1000)
+            {
+                ERROR("In uring file pack context, item");
+                break;
+            }
+        cw_unpack_next (&suc);
+        if (suc.item.type != cwpack::item_type::STR || suc.item.as.str.length != 300 || suc.current != suc.end)
+            ERROR("In uring file pack context, str");
+    }
+
+
+    //*******************   TEST readahead file unpack context   ****************
+
+    {
+        FILE* file = tmpfile();
+        file_pack_context fpc;
+        init_file_pack_context (&fpc, 256, fileno(file));
+        cw_pack_array_size (&fpc.pc, 2000);
+        for (int i = 0; i < 2000; i++)
+        {
+            cw_pack_unsigned (&fpc.pc, (uint64_t)i * 1000);
+            if (i % 100 == 0)
+                cw_pack_str (&fpc.pc, TEST_area, 300);
+        }
+        terminate_file_pack_context (&fpc);
+        rewind (file);
+
+        readahead_file_unpack_context rauc;
+        init_readahead_file_unpack_context (&rauc, 128, 3, fileno(file));
+        if (cw_unpack_next_array_size (&rauc.uc) != 2000)
+            ERROR("In readahead file unpack context, array");
+        for (int i = 0; i < 2000; i++)
+        {
+            if (i == 1000)
+                readahead_file_unpack_context_set_barrier (&rauc);
+            if (cw_unpack_next_unsigned64 (&rauc.uc) != (uint64_t)i * 1000)
+            {
+                ERROR("In readahead file unpack context, item");
+                break;
+            }
+            if (i % 100 == 0)
+            {
+                cw_unpack_next (&rauc.uc);
+                if (rauc.uc.item.type != cwpack::item_type::STR || rauc.uc.item.as.str.length != 300 || memcmp (rauc.uc.item.as.str.start, TEST_area, 300))
+                    ERROR("In readahead file unpack context, str");
+            }
+        }
+        readahead_file_unpack_context_rescan_from_barrier (&rauc);
+        if (cw_unpack_next_unsigned64 (&rauc.uc) != 1000000)
+            ERROR("In readahead file unpack context, rescan");
+        readahead_file_unpack_context_release_barrier (&rauc);
+        cw_skip_items (&rauc.uc, 999 + 10);
+        if (rauc.uc.return_code)
+            ERROR("In readahead file unpack context, skip");
+        cw_unpack_next (&rauc.uc);
+        if (rauc.uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR("In readahead file unpack context, end of input");
+        readahead_stats stats = readahead_file_unpack_context_stats (&rauc);
+        if (stats.blocks < 60 || stats.waits > stats.blocks || !stats.copies)
+            ERROR("In readahead file unpack context, stats");
+        terminate_readahead_file_unpack_context (&rauc);
+        fclose (file);
+
+        file = tmpfile();
+        init_file_pack_context (&fpc, 4096, fileno(file));
+        for (int i = 0; i < 200000; i++)
+            cw_pack_unsigned (&fpc.pc, 0x10000000 + i);
+        terminate_file_pack_context (&fpc);
+        rewind (file);
+        init_readahead_file_unpack_context (&rauc, 4096, 3, fileno(file));
+        for (int i = 0; i < 200000; i++)
+        {
+            if (cw_unpack_next_unsigned32 (&rauc.uc) != 0x10000000u + i)
+            {
+                ERROR("In readahead file unpack context, straddling item");
+                break;
+            }
+        }
+        stats = readahead_file_unpack_context_stats (&rauc);
+        if (stats.blocks != 245 || stats.copies || rauc.buffer_length != 4096)
+            ERROR("In readahead file unpack context, swapping blocks after a straddle");
+        terminate_readahead_file_unpack_context (&rauc);
+        fclose (file);
+    }
+
+
+    //*******************   TEST mmap unpack context   ****************
+
+    {
+        char path[] = "/tmp/cwpack_mmap_XXXXXX";
+        int fileDescriptor = mkstemp (path);
+        file_pack_context fpc;
+        init_file_pack_context (&fpc, 64, fileDescriptor);
+        cw_pack_array_size (&fpc.pc, 3);
+        cw_pack_unsigned (&fpc.pc, 4711);
+        cw_pack_bin (&fpc.pc, TEST_area, 10000);
+        cw_pack_cstr (&fpc.pc, "last");
+        terminate_file_pack_context (&fpc);
+        close (fileDescriptor);
+
+        mmap_unpack_context muc;
+        init_mmap_unpack_context (&muc, path, CW_MMAP_SEQUENTIAL | CW_MMAP_WILLNEED | CW_MMAP_HUGE_PAGES);
+        if (muc.uc.return_code || muc.mapping_length != 1 + 3 + 3 + 10000 + 5)
+            ERROR("In mmap unpack context init");
+        if (cw_unpack_next_array_size (&muc.uc) != 3 || cw_unpack_next_unsigned32 (&muc.uc) != 4711)
+            ERROR("In mmap unpack context, array");
+        cw_unpack_next (&muc.uc);
+        if (muc.uc.item.as.bin.start != (uint8_t*)muc.mapping + 7 || memcmp (muc.uc.item.as.bin.start, TEST_area, 10000))
+            ERROR("In mmap unpack context, bin");
+        cw_skip_items (&muc.uc, 1);
+        cw_unpack_next (&muc.uc);
+        if (muc.uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR("In mmap unpack context, end of input");
+        terminate_mmap_unpack_context (&muc);
+        unlink (path);
+
+        init_mmap_unpack_context (&muc, path, 0);
+        if (muc.uc.return_code != CWP_RC_ERROR_IN_HANDLER || muc.uc.err_no != ENOENT)
+            ERROR("In mmap unpack context, missing file");
+    }
+
+
+    //*******************   TEST mmap pack context   ****************
+
+    {
+        char path[] = "/tmp/cwpack_mmap_XXXXXX";
+        close (mkstemp (path));
+        mmap_pack_context mpc;
+        init_mmap_pack_context (&mpc, path, 1);
+        if (mpc.pc.return_code || mpc.extent < 4096)
+            ERROR("In mmap pack context init");
+        cwpack::container_slot slot = cw_pack_array_begin (&mpc.pc);
+        for (int i = 0; i < 3000; i++)
+            cw_pack_unsigned (&mpc.pc, (uint64_t)i * 1000);
+        cw_pack_bin (&mpc.pc, TEST_area, 20000);
+        cw_pack_array_end (&mpc.pc, slot, 3001);
+        unsigned long length = mmap_pack_context_length (&mpc);
+        terminate_mmap_pack_context (&mpc);
+        if (mpc.pc.return_code)
+            ERROR("In mmap pack context terminate");
+
+        mmap_unpack_context muc;
+        init_mmap_unpack_context (&muc, path, 0);
+        if (muc.mapping_length != length)
+            ERROR("In mmap pack context, trimmed length");
+        if (cw_unpack_next_array_size (&muc.uc) != 3001)
+            ERROR("In mmap pack context, array");
+        for (int i = 0; i < 3000; i++)
+            if (cw_unpack_next_unsigned64 (&muc.uc) != (uint64_t)i * 1000)
+            {
+                ERROR("In mmap pack context, item");
+                break;
+            }
+        cw_unpack_next (&muc.uc);
+        if (muc.uc.item.as.bin.length != 20000 || memcmp (muc.uc.item.as.bin.start, TEST_area, 20000) || muc.uc.current != muc.uc.end)
+            ERROR("In mmap pack context, bin");
+        terminate_mmap_unpack_context (&muc);
+        unlink (path);
+    }
+
+
+    //*******************   TEST rope pack context   ****************
+
+    {
+        cw_rope_pool pool;
+        init_cw_rope_pool (&pool, 100);
+        rope_pack_context rpc;
+        init_rope_pack_context (&rpc, &pool);
+        cw_pack_array_size (&rpc, 1001);
+        for (int i = 0; i < 1000; i++)
+            cw_pack_unsigned (&rpc, (uint64_t)i * 1000);
+        cw_pack_bin (&rpc, TEST_area, 500);
+        const uint8_t* first_chunk = rope_pack_context_chunks (&rpc)->data();
+
+        unsigned long length = rope_pack_context_length (&rpc);
+        int chunks = 0;
+        unsigned long chunked_length = 0;
+        for (const cwpack::rope_chunk* chunk = rope_pack_context_chunks (&rpc); chunk; chunk = chunk->next, chunks++)
+        {
+            if (chunk->length > chunk->capacity || (chunk->next && chunk->capacity != 100))
+                ERROR("In rope pack context, chunk");
+            chunked_length += chunk->length;
+        }
+        if (rpc.return_code || chunks < 30 || chunked_length != length || rope_pack_context_chunks (&rpc)->data() != first_chunk)
+            ERROR("In rope pack context");
+
+        struct iovec iov[100];
+        if (rope_pack_context_iov (&rpc, iov, 100) != chunks || iov[0].iov_base != first_chunk)
+            ERROR("In rope pack context iov");
+
+        FILE* file = tmpfile();
+        if (rope_pack_context_writev (&rpc, fileno(file)))
+            ERROR("In rope pack context writev");
+        rewind (file);
+        if (fread (outbuffer, 1, sizeof(outbuffer), file) != length)
+            ERROR("In rope pack context, written length");
+        fclose (file);
+
+        const uint8_t* flat = rope_pack_context_flatten (&rpc);
+        if (!flat || memcmp (flat, outbuffer, length) || rope_pack_context_length (&rpc) != length)
+            ERROR("In rope pack context flatten");
+
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, flat, length);
+        if (cw_unpack_next_array_size (&suc) != 1001)
+            ERROR("In rope pack context, array");
+        for (int i = 0; i < 1000; i++)
+            if (cw_unpack_next_unsigned64 (&suc) != (uint64_t)i * 1000)
+            {
+                ERROR("In rope pack context, item");
+                break;
+            }
+        cw_unpack_next (&suc);
+        if (suc.item.as.bin.length != 500 || memcmp (suc.item.as.bin.start, TEST_area, 500) || suc.current != suc.end)
+            ERROR("In rope pack context, bin");
+
+        cw_pack_nil (&rpc);
+        if (rope_pack_context_length (&rpc) != length + 1)
+            ERROR("In rope pack context, pack after flatten");
+        reset_rope_pack_context (&rpc);
+        if (rope_pack_context_length (&rpc) != 0 || pool.free_count == 0)
+            ERROR("In rope pack context reset");
+        terminate_rope_pack_context (&rpc);
+        free_cw_rope_pool (&pool);
+    }
+
+
+    //*******************   TEST buffer pool and context reset   ****************
+
+    {
+        unsigned long length = 100;
+        void* buffer = cw_buffer_pool_get (&length);
+        if (!buffer || length != 128)
+            ERROR("In buffer pool get");
+        cw_buffer_pool_put (buffer, length);
+        unsigned long length2 = 65;
+        if (cw_buffer_pool_get (&length2) != buffer || length2 != 128)
+            ERROR("In buffer pool reuse");
+        cw_buffer_pool_put (buffer, length2);
+
+        dynamic_memory_pack_context dmpc;
+        init_dynamic_memory_pack_context (&dmpc, 100);
+        if (dmpc.pc.start != buffer || dmpc.pc.end - dmpc.pc.start != 128)
+            ERROR("In dynamic memory pack context from pool");
+        cw_pack_str (&dmpc.pc, TEST_area, 200);
+        reset_dynamic_memory_pack_context (&dmpc);
+        uint8_t* grown = dmpc.pc.start;
+        cw_pack_unsigned (&dmpc.pc, 4711);
+        if (dmpc.pc.start != grown || dmpc.pc.current - dmpc.pc.start != 3 || dmpc.pc.end - dmpc.pc.start != 256)
+            ERROR("In dynamic memory pack context reset");
+        free_dynamic_memory_pack_context (&dmpc);
+
+        FILE* file1 = tmpfile();
+        FILE* file2 = tmpfile();
+        file_pack_context fpc;
+        init_file_pack_context (&fpc, 256, fileno(file1));
+        cw_pack_cstr (&fpc.pc, "first");
+        file_pack_context_set_barrier (&fpc);
+        cw_pack_nil (&fpc.pc);
+        uint8_t* kept = fpc.pc.start;
+        reset_file_pack_context (&fpc, fileno(file2));
+        cw_pack_cstr (&fpc.pc, "second");
+        if (fpc.pc.start != kept || fpc.barrier)
+            ERROR("In file pack context reset");
+        terminate_file_pack_context (&fpc);
+        if (ftell (file1) != 7 || ftell (file2) != 7)
+            ERROR("In file pack context reset, written");
+
+        file_unpack_context fuc;
+        rewind (file1);
+        init_file_unpack_context (&fuc, 256, fileno(file1));
+        cw_unpack_next (&fuc.uc);
+        if (fuc.uc.item.type != cwpack::item_type::STR || fuc.uc.item.as.str.length != 5)
+            ERROR("In file unpack context before reset");
+        kept = fuc.uc.start;
+        rewind (file2);
+        reset_file_unpack_context (&fuc, fileno(file2));
+        cw_unpack_next (&fuc.uc);
+        if (fuc.uc.start != kept || fuc.uc.item.as.str.length != 6 || memcmp (fuc.uc.item.as.str.start, "second", 6))
+            ERROR("In file unpack context reset");
+        terminate_file_unpack_context (&fuc);
+        fclose (file1);
+        fclose (file2);
+        cw_buffer_pool_trim ();
+    }
+
+
+    //*******************   TEST ring file unpack context   ****************
+
+    {
+        FILE* file = tmpfile();
+        file_pack_context fpc;
+        init_file_pack_context (&fpc, 4096, fileno(file));
+        for (int i = 0; i < 5000; i++)
+        {
+            cw_pack_unsigned (&fpc.pc, (uint64_t)i * 1000);
+            if (i % 500 == 0)
+                cw_pack_str (&fpc.pc, TEST_area, 1000);
+        }
+        cw_pack_bin (&fpc.pc, TEST_area, 10000);
+        terminate_file_pack_context (&fpc);
+        rewind (file);
+
+        ring_file_unpack_context rfuc;
+        init_ring_file_unpack_context (&rfuc, 1, fileno(file));
+        uint8_t* ring = rfuc.ring;
+        unsigned long ring_length = rfuc.ring_length;
+        if (rfuc.uc.return_code || ring_length < 4096)
+            ERROR("In ring file unpack context init");
+        bool wrapped = false;
+        bool rescanned = false;
+        for (int i = 0; i < 5000; i++)
+        {
+            if (i == 2500 && !rescanned)
+                ring_file_unpack_context_set_barrier (&rfuc);
+            if (i == 2600 && !rescanned)
+            {
+                rescanned = true;
+                ring_file_unpack_context_rescan_from_barrier (&rfuc);
+                ring_file_unpack_context_release_barrier (&rfuc);
+                i = 2500;
+            }
+            if (cw_unpack_next_unsigned64 (&rfuc.uc) != (uint64_t)i * 1000)
+            {
+                ERROR("In ring file unpack context, item");
+                break;
+            }
+            if (i % 500 == 0)
+            {
+                cw_unpack_next (&rfuc.uc);
+                if (rfuc.uc.item.as.str.length != 1000 || memcmp (rfuc.uc.item.as.str.start, TEST_area, 1000))
+                    ERROR("In ring file unpack context, str");
+                wrapped |= (const uint8_t*)rfuc.uc.item.as.str.start + 1000 > ring + ring_length;
+            }
+        }
+        if (!wrapped || rfuc.ring != ring)
+            ERROR("In ring file unpack context, wrap");
+        cw_unpack_next (&rfuc.uc);
+        if (rfuc.uc.item.as.bin.length != 10000 || memcmp (rfuc.uc.item.as.bin.start, TEST_area, 10000) || rfuc.ring_length < 10000)
+            ERROR("In ring file unpack context, grown ring");
+        cw_unpack_next (&rfuc.uc);
+        if (rfuc.uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR("In ring file unpack context, end of input");
+        terminate_ring_file_unpack_context (&rfuc);
+        fclose (file);
+    }
+
+
+    //*******************   TEST frame stream   ****************
+
+    {
+        for (int with_index = 0; with_index < 2; with_index++)
+        {
+            FILE* file = tmpfile();
+            frame_writer fw;
+            init_frame_writer (&fw, 64, fileno(file), with_index);
+            for (int i = 0; i < 300; i++)
+            {
+                frame_writer_begin (&fw);
+                cw_pack_array_size (&fw.fpc.pc, 2);
+                cw_pack_unsigned (&fw.fpc.pc, i);
+                cw_pack_bin (&fw.fpc.pc, TEST_area, i);
+                frame_writer_end (&fw);
+            }
+            unsigned char packed[] = {0x91, 0xc0};
+            frame_writer_write (&fw, packed, 2);
+            terminate_frame_writer (&fw);
+            if (fw.fpc.pc.return_code || fw.count != 301)
+                ERROR("In frame writer");
+            rewind (file);
+
+            frame_reader fr;
+            init_frame_reader (&fr, 64, fileno(file));
+            const uint8_t* record;
+            unsigned long length;
+            int records = 0;
+            while (frame_reader_next (&fr, &record, &length) == CWP_RC_OK)
+            {
+                cw_static_unpack_context suc;
+                cw_unpack_context_init (&suc, record, length);
+                if (records < 300)
+                {
+                    cw_unpack_next_array_size (&suc);
+                    if (cw_unpack_next_unsigned32 (&suc) != (uint32_t)records)
+                        ERROR("In frame reader, record");
+                    cw_unpack_next (&suc);
+                    if (suc.item.as.bin.length != (uint32_t)records || suc.current != suc.end)
+                        ERROR("In frame reader, record length");
+                }
+                else if (length != 2 || memcmp (record, packed, 2))
+                    ERROR("In frame reader, written record");
+                records++;
+            }
+            if (records != 301 || fr.fuc.uc.return_code != CWP_RC_END_OF_INPUT)
+                ERROR("In frame reader, end");
+
+            if (frame_reader_load_index (&fr) || fr.count != 301)
+                ERROR("In frame reader index");
+            if (frame_reader_seek (&fr, 250) || frame_reader_next (&fr, &record, &length))
+                ERROR("In frame reader seek");
+            cw_static_unpack_context suc;
+            cw_unpack_context_init (&suc, record, length);
+            cw_unpack_next_array_size (&suc);
+            if (cw_unpack_next_unsigned32 (&suc) != 250 || frame_reader_seek (&fr, 301) != CWP_RC_VALUE_ERROR)
+                ERROR("In frame reader, seeked record");
+            terminate_frame_reader (&fr);
+            fclose (file);
+        }
+
+        FILE* file = tmpfile();
+        const uint8_t corrupt_length[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x91, 0xc0};
+        fwrite (corrupt_length, 1, sizeof(corrupt_length), file);
+        fflush (file);
+        rewind (file);
+        frame_reader fr;
+        init_frame_reader (&fr, 64, fileno(file));
+        const uint8_t* record;
+        unsigned long length;
+        if (frame_reader_next (&fr, &record, &length) != CWP_RC_MALFORMED_INPUT || frame_reader_load_index (&fr) != CWP_RC_MALFORMED_INPUT)
+            ERROR("In frame reader, corrupt length");
+        terminate_frame_reader (&fr);
+        fclose (file);
+    }
+
+
+    //*******************   TEST parallel for each record   ****************
+
+    {
+        dynamic_memory_pack_context dmpc;
+        init_dynamic_memory_pack_context (&dmpc, 1024);
+        for (int i = 0; i < 10000; i++)
+        {
+            cw_pack_map_size (&dmpc.pc, 2);
+            cw_pack_cstr (&dmpc.pc, "id");
+            cw_pack_unsigned (&dmpc.pc, i);
+            cw_pack_cstr (&dmpc.pc, "blob");
+            cw_pack_bin (&dmpc.pc, TEST_area, i % 100);
+        }
+        unsigned long length = (unsigned long)(dmpc.pc.current - dmpc.pc.start);
+
+        auto decode = [] (cw_static_unpack_context* uc, unsigned long) -> unsigned long
+        {
+            cw_unpack_next_map_size (uc);
+            cw_skip_items (uc, 1);
+            unsigned long id = cw_unpack_next_unsigned32 (uc);
+            cw_skip_items (uc, 2);
+            return uc->return_code || uc->current != uc->end ? (unsigned long)-1 : id;
+        };
+        cwpack::parallel_options options;
+        options.threads = 4;
+        options.batch_records = 100;
+        unsigned long expected = 0;
+        bool in_order = true;
+        int rc = cwpack::parallel_for_each_record (dmpc.pc.start, length, decode,
+                                                   [&] (unsigned long index, unsigned long id) { in_order &= index == expected && id == expected; expected++; },
+                                                   options);
+        if (rc || !in_order || expected != 10000)
+            ERROR("In parallel for each record, ordered");
+
+        options.ordered = false;
+        unsigned long count = 0, sum = 0;
+        rc = cwpack::parallel_for_each_record (dmpc.pc.start, length, decode,
+                                               [&] (unsigned long index, unsigned long id) { count++; sum += id; in_order &= index == id; },
+                                               options);
+        if (rc || !in_order || count != 10000 || sum != 10000ul * 9999 / 2)
+            ERROR("In parallel for each record, unordered");
+
+        std::atomic<unsigned long> calls {0};
+        rc = cwpack::parallel_for_each_record (dmpc.pc.start, length - 1, [&] (cw_static_unpack_context*, unsigned long) { calls++; }, options);
+        if (rc != CWP_RC_BUFFER_UNDERFLOW || calls != 9999)
+            ERROR("In parallel for each record, truncated");
+
+        char path[] = "/tmp/cwpack_parallel_XXXXXX";
+        int fileDescriptor = mkstemp (path);
+        frame_writer fw;
+        init_frame_writer (&fw, 4096, fileDescriptor, true);
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, dmpc.pc.start, length);
+        for (int i = 0; i < 10000; i++)
+        {
+            const uint8_t* record = suc.current;
+            cw_skip_items (&suc, 1);
+            frame_writer_write (&fw, record, (unsigned long)(suc.current - record));
+        }
+        terminate_frame_writer (&fw);
+        close (fileDescriptor);
+        options.ordered = true;
+        expected = 0;
+        rc = cwpack::parallel_for_each_record_in_file (path, decode,
+                                                       [&] (unsigned long index, unsigned long id) { in_order &= index == expected && id == expected; expected++; },
+                                                       options);
+        if (rc || !in_order || expected != 10000)
+            ERROR("In parallel for each record in framed file");
+        unlink (path);
+        free_dynamic_memory_pack_context (&dmpc);
+    }
+
+
+    //*******************   TEST parallel pack array   ****************
+
+    {
+        auto pack = [] (cw_pack_context* pc, unsigned long i)
+        {
+            cw_pack_array_size (pc, 2);
+            cw_pack_unsigned (pc, i);
+            cw_pack_str (pc, TEST_area, (uint32_t)(i % 50));
+        };
+        cwpack::parallel_options options;
+        options.threads = 3;
+
+        dynamic_memory_pack_context serial;
+        init_dynamic_memory_pack_context (&serial, 1024);
+        cw_pack_array_size (&serial.pc, 2000);
+        for (unsigned long i = 0; i < 2000; i++)
+            pack (&serial.pc, i);
+        unsigned long length = (unsigned long)(serial.pc.current - serial.pc.start);
+
+        dynamic_memory_pack_context merged;
+        init_dynamic_memory_pack_context (&merged, 64);
+        if (cwpack::parallel_pack_array (&merged.pc, 2000, pack, options) ||
+            (unsigned long)(merged.pc.current - merged.pc.start) != length || memcmp (merged.pc.start, serial.pc.start, length))
+            ERROR("In parallel pack array");
+
+        cwpack::packed_array array = cwpack::parallel_pack_array (2000, pack, options);
+        std::vector<struct iovec> iov = array.iov();
+        if (array.return_code || array.length() != length || iov.size() != 13 || iov[0].iov_len != 3)
+            ERROR("In parallel pack array, slices");
+        FILE* file = tmpfile();
+        if (writev (fileno(file), iov.data(), (int)iov.size()) != (long)length)
+            ERROR("In parallel pack array, writev");
+        rewind (file);
+        if (fread (outbuffer, 1, sizeof(outbuffer), file) != length || memcmp (outbuffer, serial.pc.start, length))
+            ERROR("In parallel pack array, written");
+        fclose (file);
+
+        cwpack::packed_array empty = cwpack::parallel_pack_array (0, pack, options);
+        if (empty.return_code || empty.length() != 1 || empty.header[0] != 0x90)
+            ERROR("In parallel pack array, empty");
+
+        free_dynamic_memory_pack_context (&merged);
+        free_dynamic_memory_pack_context (&serial);
+    }
+
+
+    //*******************   TEST compress contexts   ****************
+
+    {
+        static uint8_t raw[20000], compressed[CW_BLOCK_COMPRESS_BOUND(20000)], restored[20000];
+        for (int i = 0; i < 20000; i++)
+            raw[i] = i < 10000 ? (uint8_t)(i * 7919 >> 3 ^ i >> 5) : (uint8_t)"abcab"[i % 5];
+        unsigned long length = cw_block_compress (raw, 20000, compressed, sizeof(compressed));
+        if (!length || length > 12000 || cw_block_decompress (compressed, length, restored, 20000) != 20000 || memcmp (raw, restored, 20000))
+            ERROR("In block compression");
+        if (cw_block_compress (raw, 20000, compressed, 100) || cw_block_decompress (compressed, length / 2, restored, 20000) == 20000)
+            ERROR("In block compression limits");
+
+        FILE* file = tmpfile();
+        stream_pack_context spc;
+        init_stream_pack_context (&spc, 1024, file);
+        compressing_pack_context cpc;
+        init_compressing_pack_context (&cpc, 4096, &spc.pc);
+        for (int i = 0; i < 5000; i++)
+        {
+            cw_pack_map_size (&cpc.pc, 3);
+            cw_pack_cstr (&cpc.pc, "sequence");
+            cw_pack_unsigned (&cpc.pc, i);
+            cw_pack_cstr (&cpc.pc, "status");
+            cw_pack_cstr (&cpc.pc, i % 10 ? "ok" : "retry");
+            cw_pack_cstr (&cpc.pc, "payload");
+            cw_pack_bin (&cpc.pc, TEST_area, i == 2500 ? 10000 : 20);
+        }
+        terminate_compressing_pack_context (&cpc);
+        terminate_stream_pack_context (&spc);
+        if (cpc.pc.return_code || cpc.compressed_bytes * 3 > cpc.raw_bytes || (unsigned long long)ftell (file) != cpc.compressed_bytes)
+            ERROR("In compressing pack context");
+        rewind (file);
+
+        file_unpack_context fuc;
+        init_file_unpack_context (&fuc, 1024, fileno(file));
+        decompressing_unpack_context duc;
+        init_decompressing_unpack_context (&duc, 1024, &fuc.uc);
+        for (int i = 0; i < 5000; i++)
+        {
+            cw_unpack_next_map_size (&duc.uc);
+            cw_skip_items (&duc.uc, 1);
+            if (cw_unpack_next_unsigned32 (&duc.uc) != (uint32_t)i)
+            {
+                ERROR("In decompressing unpack context");
+                break;
+            }
+            cw_skip_items (&duc.uc, 3);
+            cw_unpack_next (&duc.uc);
+            if (duc.uc.item.as.bin.length != (i == 2500 ? 10000u : 20u) || memcmp (duc.uc.item.as.bin.start, TEST_area, duc.uc.item.as.bin.length))
+                ERROR("In decompressing unpack context, bin");
+        }
+        cw_unpack_next (&duc.uc);
+        if (duc.uc.return_code != CWP_RC_END_OF_INPUT)
+            ERROR("In decompressing unpack context, end of input");
+        terminate_decompressing_unpack_context (&duc);
+        terminate_file_unpack_context (&fuc);
+        fclose (file);
+
+        const uint8_t huge_block[] = {0xff, 0xff, 0xff, 0x7f, 0x10, 0, 0, 0, 0xc0};
+        cw_unpack_context block_source;
+        cw_unpack_context_init (&block_source, huge_block, sizeof(huge_block), NULL);
+        init_decompressing_unpack_context (&duc, 1024, &block_source);
+        cw_unpack_next (&duc.uc);
+        if (duc.uc.return_code != CWP_RC_MALFORMED_INPUT || duc.buffer_length != 1024)
+            ERROR("In decompressing unpack context, untrusted block length");
+        terminate_decompressing_unpack_context (&duc);
+    }
+
+
+    //*******************   TEST checksum contexts   ****************
+
+    {
+        if (cw_crc32c (0, "123456789", 9) != 0xE3069283 || cw_crc32c (cw_crc32c (0, "1234", 4), "56789", 5) != 0xE3069283)
+            ERROR("In cw_crc32c");
+        static uint8_t crc_data[30000];
+        for (int i = 0; i < 30000; i++)
+            crc_data[i] = (uint8_t)(i * 2654435761u >> 13);
+        if (cw_crc32c (0, crc_data, 30000) != cw_crc32c (cw_crc32c (0, crc_data, 12347), crc_data + 12347, 30000 - 12347))
+            ERROR("In cw_crc32c, in parts");
+
+        FILE* file = tmpfile();
+        stream_pack_context spc;
+        init_stream_pack_context (&spc, 1024, file);
+        checksum_pack_context cpc;
+        init_checksum_pack_context (&cpc, 4096, &spc.pc);
+        for (int i = 0; i < 3000; i++)
+        {
+            cw_pack_array_size (&cpc.pc, 2);
+            cw_pack_unsigned (&cpc.pc, i);
+            cw_pack_bin (&cpc.pc, TEST_area, i == 1500 ? 10000 : 20);
+        }
+        terminate_checksum_pack_context (&cpc);
+        terminate_stream_pack_context (&spc);
+        if (cpc.pc.return_code)
+            ERROR("In checksum pack context");
+        long file_length = ftell (file);
+
+        for (int corrupt = 0; corrupt < 2; corrupt++)
+        {
+            if (corrupt)
+            {
+                fseek (file, file_length / 2, SEEK_SET);
+                int c = fgetc (file);
+                fseek (file, file_length / 2, SEEK_SET);
+                fputc (c ^ 0x10, file);
+                fflush (file);
+            }
+            rewind (file);
+            file_unpack_context fuc;
+            init_file_unpack_context (&fuc, 1024, fileno(file));
+            checksum_unpack_context cuc;
+            init_checksum_unpack_context (&cuc, 1024, &fuc.uc);
+            int i;
+            for (i = 0; i < 3000; i++)
+            {
+                cw_unpack_next_array_size (&cuc.uc);
+                if (cw_unpack_next_unsigned32 (&cuc.uc) != (uint32_t)i)
+                    break;
+                cw_unpack_next (&cuc.uc);
+                if (cuc.uc.item.as.bin.length != (i == 1500 ? 10000u : 20u) || memcmp (cuc.uc.item.as.bin.start, TEST_area, cuc.uc.item.as.bin.length))
+                    break;
+            }
+            cw_unpack_next (&cuc.uc);
+            if (corrupt ? i == 3000 || cuc.uc.return_code != CWP_RC_CHECKSUM_ERROR : cuc.uc.return_code != CWP_RC_END_OF_INPUT || cuc.blocks < 10)
+                ERROR("In checksum unpack context");
+            terminate_checksum_unpack_context (&cuc);
+            terminate_file_unpack_context (&fuc);
+        }
+        fclose (file);
+
+        const uint8_t huge_block[] = {0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0, 0xc0};
+        cw_unpack_context block_source;
+        cw_unpack_context_init (&block_source, huge_block, sizeof(huge_block), NULL);
+        checksum_unpack_context cuc;
+        init_checksum_unpack_context (&cuc, 1024, &block_source);
+        cw_unpack_next (&cuc.uc);
+        if (cuc.uc.return_code != CWP_RC_MALFORMED_INPUT || cuc.buffer_length != 1024)
+            ERROR("In checksum unpack context, untrusted block length");
+        terminate_checksum_unpack_context (&cuc);
+    }
+
+
+    //*******************   TEST msgpack to json   ****************
+
+    {
+        cw_static_pack_context spc;
+        cw_pack_context_init (&spc, outbuffer, 70000);
+        cw_pack_map_size (&spc, 6);
+        cw_pack_cstr (&spc, "text");
+        cw_pack_cstr (&spc, "a \"quoted\"\\ line\n\x01 \xc3\xa5 and a somewhat longer tail");
+        cw_pack_unsigned (&spc, 18446744073709551615ull);
+        cw_pack_array_size (&spc, 6);
+        cw_pack_signed (&spc, -9223372036854775807ll - 1);
+        cw_pack_double (&spc, 0.1);
+        cw_pack_float (&spc, 2.5f);
+        cw_pack_double (&spc, 3);
+        cw_pack_double (&spc, 1.0 / 0.0);
+        cw_pack_array_size (&spc, 0);
+        cw_pack_cstr (&spc, "bin");
+        cw_pack_bin (&spc, "\x00\xff\x10\x20", 4);
+        cw_pack_boolean (&spc, true);
+        cw_pack_nil (&spc);
+        cw_pack_cstr (&spc, "time");
+        cw_pack_time (&spc, 1614834367, 890000000);
+        cw_pack_cstr (&spc, "ext");
+        cw_pack_ext (&spc, 7, "ab", 2);
+        cw_pack_array_size (&spc, 2);
+        cw_pack_map_size (&spc, 0);
+        cw_pack_time (&spc, -1, 0);
+        const char* expected = "{\"text\":\"a \\\"quoted\\\"\\\\ line\\n\\u0001 \xc3\xa5 and a somewhat longer tail\","
+                               "\"18446744073709551615\":[-9223372036854775808,0.1,2.5,3.0,null,[]],"
+                               "\"bin\":\"AP8QIA==\",\"true\":null,\"time\":\"2021-03-04T05:06:07.89Z\","
+                               "\"ext\":{\"type\":7,\"data\":\"YWI=\"}}\n[{},\"1969-12-31T23:59:59Z\"]\n";
+
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, outbuffer, (unsigned long)(spc.current - spc.start));
+        dynamic_memory_pack_context dmpc;
+        init_dynamic_memory_pack_context (&dmpc, 16);
+        if (cw_unpack_to_json_lines (&suc, &dmpc.pc) || dmpc.pc.current - dmpc.pc.start != (long)strlen (expected) ||
+            memcmp (dmpc.pc.start, expected, strlen (expected)))
+            ERROR("In msgpack to json");
+
+        cw_unpack_context_init (&suc, outbuffer, 20);
+        reset_dynamic_memory_pack_context (&dmpc);
+        if (cw_unpack_to_json_lines (&suc, &dmpc.pc) != CWP_RC_BUFFER_UNDERFLOW)
+            ERROR("In msgpack to json, truncated");
+
+        cw_pack_context_init (&spc, outbuffer, 100);
+        cw_pack_map_size (&spc, 1);
+        cw_pack_array_size (&spc, 0);
+        cw_pack_nil (&spc);
+        cw_unpack_context_init (&suc, outbuffer, 100);
+        reset_dynamic_memory_pack_context (&dmpc);
+        if (cw_unpack_to_json (&suc, &dmpc.pc) != CWP_RC_TYPE_ERROR)
+            ERROR("In msgpack to json, container key");
+
+        char small[10];
+        cw_static_pack_context json;
+        cw_pack_context_init (&json, small, sizeof(small));
+        cw_pack_context_init (&spc, outbuffer, 100);
+        cw_pack_cstr (&spc, "longer than ten bytes");
+        cw_unpack_context_init (&suc, outbuffer, 100);
+        if (cw_unpack_to_json (&suc, &json) != CWP_RC_BUFFER_OVERFLOW)
+            ERROR("In msgpack to json, overflow");
+        free_dynamic_memory_pack_context (&dmpc);
+    }
+
+
+    //*******************   TEST json to msgpack   ****************
+
+    {
+        const char* json = "{\"name\" : \"caf\\u00e9 \\ud83d\\ude00 \\\"x\\\"\\/\\n\", \"list\":[1, -2, 18446744073709551615,"
+                           " -9223372036854775808, 18446744073709551616, 0.5, -1.5e3, 1e400, true, false, null, [], {}],\n"
+                           "\t\"a long key that is there to make the text cross a block boundary of sixty four bytes\": \"\\\\\"}\r\n"
+                           "[\"line two\",{\"x\":{\"y\":[[0]]}}] 7";
+        const char* expected = "{\"name\":\"caf\xc3\xa9 \xf0\x9f\x98\x80 \\\"x\\\"/\\n\",\"list\":[1,-2,18446744073709551615,"
+                               "-9223372036854775808,18446744073709551616.0,0.5,-1500.0,null,true,false,null,[],{}],"
+                               "\"a long key that is there to make the text cross a block boundary of sixty four bytes\":\"\\\\\"}\n"
+                               "[\"line two\",{\"x\":{\"y\":[[0]]}}]\n7\n";
+        dynamic_memory_pack_context dmpc;
+        init_dynamic_memory_pack_context (&dmpc, 16);
+        unsigned long position = 0;
+        if (cw_json_to_msgpack (json, strlen (json), &dmpc.pc, &position) || position != strlen (json))
+            ERROR("In json to msgpack");
+        if (dmpc.pc.start[0] != 0x83 || dmpc.pc.start[1] != 0xa4)
+            ERROR("In json to msgpack, compact headers");
+
+        cw_static_unpack_context suc;
+        cw_unpack_context_init (&suc, dmpc.pc.start, (unsigned long)(dmpc.pc.current - dmpc.pc.start));
+        dynamic_memory_pack_context text;
+        init_dynamic_memory_pack_context (&text, 16);
+        if (cw_unpack_to_json_lines (&suc, &text.pc) || text.pc.current - text.pc.start != (long)strlen (expected) ||
+            memcmp (text.pc.start, expected, strlen (expected)))
+            ERROR("In json to msgpack, round trip");
+        free_dynamic_memory_pack_context (&text);
+
+        std::string tiny = "[0." + std::string(400, '0') + "1, -0." + std::string(400, '0') + "1e2, 0." + std::string(400, '0') + "1e800]";
+        reset_dynamic_memory_pack_context (&dmpc);
+        cw_json_to_msgpack (tiny.data(), (unsigned long)tiny.size(), &dmpc.pc);
+        cw_unpack_context_init (&suc, dmpc.pc.start, (unsigned long)(dmpc.pc.current - dmpc.pc.start));
+        cw_unpack_next_array_size (&suc);
+        double tiny0 = cw_unpack_next_double (&suc), tiny1 = cw_unpack_next_double (&suc), large = cw_unpack_next_double (&suc);
+        if (suc.return_code || tiny0 != 0.0 || tiny1 != 0.0 || !std::signbit (tiny1) || large != HUGE_VAL)
+            ERROR("In json to msgpack, out of range numbers");
+
+        const char* malformed[] = {"[1,]", "{\"a\" 1}", "{\"a\":1,}", "[1 2]", "{1:2}", "tru", "truex", "01x", "[-]", "1.", "1e",
+                                   "\"\\x\"", "\"\\ud800\"", "\"a\nb\"", "[1}", "{\"a\":[1]", "\"open", "]", ",", "[nul]", "+1", "[.5]"};
+        for (unsigned i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+        {
+            reset_dynamic_memory_pack_context (&dmpc);
+            if (cw_json_to_msgpack (malformed[i], strlen (malformed[i]), &dmpc.pc) != CWP_RC_MALFORMED_INPUT)
+                ERROR2("In json to msgpack, malformed text ", (int)i, -1);
+        }
+
+        static char big[40000];
+        unsigned long length = 0;
+        length += (unsigned long)sprintf (big + length, "[");
+        for (int i = 0; i < 1000; i++)
+            length += (unsigned long)sprintf (big + length, "%s{\"i\":%d,\"s\":\"%*s\"}", i ? "," : "", i, i % 7, "\\\\");
+        length += (unsigned long)sprintf (big + length, "]");
+        FILE* file = tmpfile();
+        file_pack_context fpc;
+        init_file_pack_context (&fpc, 256, fileno(file));
+        if (cw_json_to_msgpack (big, length, &fpc) || (terminate_file_pack_context (&fpc), fpc.pc.return_code))
+            ERROR("In json to msgpack, file pack context");
+        rewind (file);
+        file_unpack_context fuc;
+        init_file_unpack_context (&fuc, 256, fileno(file));
+        if (cw_unpack_next_array_size (&fuc.uc) != 1000)
+            ERROR("In json to msgpack, file array");
+        for (int i = 0; i < 1000; i++)
+        {
+            cw_unpack_next_map_size (&fuc.uc);
+            cw_skip_items (&fuc.uc, 1);
+            if (cw_unpack_next_unsigned32 (&fuc.uc) != (uint32_t)i)
+            {
+                ERROR("In json to msgpack, file item");
+                break;
+            }
+            cw_skip_items (&fuc.uc, 2);
+        }
+        terminate_file_unpack_context (&fuc);
+        fclose (file);
+        free_dynamic_memory_pack_context (&dmpc);
+    }
+
+
     //*************************************************************
 
     printf("CWPack module test completed, ");